@@ -0,0 +1,36 @@
+#!/bin/bash
+
+set -ue
+
+# Compare the hand written lexer with the one generated from cc3.l. The time
+# spent lexing is counted in cycles under -stats, and the parse phase gives
+# the rate of the cycle counter. The best of several runs is kept.
+
+: ${CC:=./cc2}
+: ${INPUT:=cc1.c}
+: ${RUNS:=10}
+
+bench() {
+	name=$1
+	shift
+
+	for i in $(seq ${RUNS}); do
+		${CC} -stats "$@" < ${INPUT} 2>&1 >/dev/null
+	done | awk -v name="${name}" '
+		/^stats: parse / { rate = $5 / $3 }
+		/^stats: lex / { cycles = $3 }
+		/^stats: tokens / {
+			if (!best || cycles < best) {
+				best = cycles
+				tokens = $3
+				mhz = rate
+			}
+		}
+		END {
+			printf "%s: %d tokens %d cycles %.0f tokens/s\n", name, tokens, best, tokens / best * mhz * 1000000
+		}
+	'
+}
+
+bench hand
+bench dfa -fdfa
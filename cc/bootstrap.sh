@@ -21,4 +21,31 @@ chmod +x cc2
 diff <(xxd cc1) <(xxd cc2) || :
 cmp cc1 cc2 || { echo "output mismatch"; exit 1; }
 
+# Check each optimizing configuration reproduces itself and still produces
+# the same unoptimized code
+for flags in -fpeep -ffold -fbranch -O -fir -finline -fregcall "-O -fregcall" "-fir -fregcall" -floop "-O -floop" "-O -floop -fregcall" -fdfa; do
+	timeout 1 sh -c "./cc2 ${flags}" < cc1.c > cc3 || { echo "cc2 ${flags} failed"; exit 1; }
+	chmod +x cc3
+	timeout 1 sh -c "./cc3 ${flags}" < cc1.c > cc4 || { echo "cc3 ${flags} failed"; exit 1; }
+	cmp cc3 cc4 || { echo "output mismatch with ${flags}"; exit 1; }
+	timeout 1 sh -c ./cc3 < cc1.c | cmp - cc2 || { echo "cc3 ${flags} output mismatch"; exit 1; }
+done
+
+# Check the generated lexer reports bad input where the hand written one does
+for input in \
+		'main(): int {\n\tputs("abc\\q");\n}\n' \
+		'main(): int {\n\n\tx = $;\n}\n' \
+		'main(): int {\n\tputs("abc\n' \
+		'main(): int {\n\tputs("a\\x41b' \
+		'main(): int {\n\tputs("ab\\x41cd\n\t);\n}\n"' \
+		"main(): int {\n\tx = 'ab';\n}\n" \
+		"main(): int {\n\tx = '';\n}\n" \
+		'main(): int {\n\tx = "\\x4g";\n}\n' \
+		'main(): int {\n\tx = 0x;\n\ty = "\\x41b\\n" + @;\n}\n'; do
+	printf "${input}" | timeout 1 ./cc2 2> err1 > /dev/null && { echo "cc2 accepted bad input"; exit 1; }
+	printf "${input}" | timeout 1 ./cc2 -fdfa 2> err2 > /dev/null && { echo "cc2 -fdfa accepted bad input"; exit 1; }
+	diff err1 err2 || { echo "lexer error mismatch"; exit 1; }
+done
+rm -f err1 err2
+
 exit 0
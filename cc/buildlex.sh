@@ -7,4 +7,19 @@ set -ue
 ${CC} < lex.c > lex
 chmod +x lex
 
-./lex < cc3.l
+# Replace the generated lexer in cc1.c with a fresh one built from cc3.l.
+# The names are prefixed with L_ to keep them apart from the parser tokens.
+# LEXFLAGS=-t generates the table driven form instead of goto chains.
+./lex ${LEXFLAGS:-} L_ < cc3.l > lexstep.out
+awk '
+	/^\/\/ END lexstep/ { skip = 0 }
+	!skip { print }
+	/^\/\/ BEGIN lexstep/ {
+		while ((getline line < "lexstep.out") > 0) {
+			print line
+		}
+		skip = 1
+	}
+' cc1.c > cc1.c.new
+mv cc1.c.new cc1.c
+rm lexstep.out
@@ -11,6 +11,7 @@ struct type;
 struct label;
 struct fix;
 struct sdecl;
+struct decl;
 
 struct node *type(void);
 struct node *stmt_list(void);
@@ -19,6 +20,7 @@ struct label *mklabel(void);
 void compute_struct(struct sdecl *s);
 int type_sizeof(struct type *t);
 void addfixup(struct label *l);
+void reach(struct decl *d);
 
 ///////////////////////////////////////////////////////////////////////////////
 // Helpers                                                                   //
@@ -31,6 +33,98 @@ die(char *msg)
 	exit(1);
 }
 
+// Region allocator: objects are bumped out of large pages and only released
+// all at once, the same way cc1 allocates
+struct page {
+	struct page *next;
+	unsigned char *buf;
+	int fill;
+	int size;
+};
+
+// The page being filled is at the head
+struct page *pages;
+
+// Size of each page, and of the largest object placed in a shared page
+int page_size = 64 * 1024;
+int page_max = 2048;
+
+struct page *
+newpage(int size)
+{
+	struct page *p;
+
+	p = malloc(sizeof(*p));
+	if (!p) {
+		die("out of memory");
+	}
+
+	p->buf = malloc(size);
+	if (!p->buf) {
+		die("out of memory");
+	}
+
+	p->next = 0;
+	p->fill = 0;
+	p->size = size;
+
+	return p;
+}
+
+// Allocate size bytes aligned for any object
+void *
+alloc(int size)
+{
+	struct page *p;
+	void *ret;
+
+	size = (size + 7) & ~7;
+
+	// Large objects get a page of their own behind the current one
+	if (size >= page_max) {
+		p = newpage(size);
+		p->fill = size;
+
+		if (pages) {
+			p->next = pages->next;
+			pages->next = p;
+		} else {
+			pages = p;
+		}
+
+		return p->buf;
+	}
+
+	if (!pages || pages->size - pages->fill < size) {
+		p = newpage(page_size);
+		p->next = pages;
+		pages = p;
+	}
+
+	ret = pages->buf + pages->fill;
+	pages->fill = pages->fill + size;
+
+	return ret;
+}
+
+// Release everything that was allocated
+void
+release(void)
+{
+	struct page *p;
+
+	while (1) {
+		p = pages;
+		if (!p) {
+			break;
+		}
+
+		pages = p->next;
+		free(p->buf);
+		free(p);
+	}
+}
+
 // strlen-ish
 int
 slen(unsigned char *s)
@@ -47,6 +141,22 @@ slen(unsigned char *s)
 	}
 }
 
+// memcpy-ish
+void
+copy(unsigned char *dest, unsigned char *src, int n)
+{
+	int i;
+
+	i = 0;
+	while (1) {
+		if (i >= n) {
+			break;
+		}
+		dest[i] = src[i];
+		i = i + 1;
+	}
+}
+
 // strcmp-ish
 int
 cmp(unsigned char *a, unsigned char *b)
@@ -528,6 +638,8 @@ enum {
 	N_BREAK,
 	N_CONTINUE,
 	N_RETURN,
+	N_LABEL,
+	N_GOTO,
 	N_VARDECL,
 	N_ASSIGN,
 	N_SIZEOF,
@@ -565,10 +677,7 @@ mknode(int kind, struct node *a, struct node *b)
 {
 	struct node *n;
 
-	n = malloc(sizeof(*n));
-	if (!n) {
-		die("out of memory");
-	}
+	n = alloc(sizeof(*n));
 
 	n->kind = kind;
 	n->a = a;
@@ -582,29 +691,115 @@ mknode(int kind, struct node *a, struct node *b)
 	return n;
 }
 
-// Copy the current token
-unsigned char *
-intern(void)
+// Interned strings, so names can be compared by pointer
+struct istr {
+	struct istr *next;
+	unsigned hash;
+	int len;
+	unsigned char *s;
+	struct label *lit;
+	int lit_at;
+	struct istr *lit_next;
+};
+
+struct istr *istr_table[4096];
+
+// Hash len bytes of s
+unsigned
+hash(unsigned char *s, int len)
 {
-	unsigned char *ret;
+	unsigned h;
 	int i;
 
-	ret = malloc(tlen + 1);
-	if (!ret) {
-		return 0;
+	h = 5381;
+	i = 0;
+	while (1) {
+		if (i >= len) {
+			return h;
+		}
+
+		h = h * 33 + s[i];
+		i = i + 1;
+	}
+}
+
+// Find the single copy of len bytes of s
+struct istr *
+intern_istr(unsigned char *s, int len)
+{
+	struct istr **link;
+	struct istr *p;
+	unsigned h;
+	int i;
+
+	h = hash(s, len);
+	link = &istr_table[h % 4096];
+	while (1) {
+		p = *link;
+		if (!p) {
+			break;
+		}
+
+		if (p->hash == h && p->len == len) {
+			i = 0;
+			while (1) {
+				if (i >= len || p->s[i] != s[i]) {
+					break;
+				}
+				i = i + 1;
+			}
+
+			if (i >= len) {
+				return p;
+			}
+		}
+
+		link = &p->next;
 	}
 
+	p = alloc(sizeof(*p));
+
+	p->s = alloc(len + 1);
+
 	i = 0;
 	while (1) {
-		if (i >= tlen) {
+		if (i >= len) {
 			break;
 		}
-		ret[i] = token[i];
+		p->s[i] = s[i];
 		i = i + 1;
 	}
-	ret[i] = 0;
+	p->s[i] = 0;
 
-	return ret;
+	p->next = 0;
+	p->hash = h;
+	p->len = len;
+	p->lit = 0;
+	p->lit_at = 0;
+	p->lit_next = 0;
+
+	*link = p;
+
+	return p;
+}
+
+unsigned char *
+intern_bytes(unsigned char *s, int len)
+{
+	return intern_istr(s, len)->s;
+}
+
+// Intern the current token
+unsigned char *
+intern(void)
+{
+	return intern_bytes(token, tlen);
+}
+
+unsigned char *
+intern_str(char *s)
+{
+	return intern_bytes((unsigned char *)s, slen((unsigned char *)s));
 }
 
 // ident := IDENT
@@ -1482,12 +1677,52 @@ var_stmt(void)
 	return a;
 }
 
+// label_stmt := ':' ident
+struct node *
+label_stmt(void)
+{
+	struct node *a;
+
+	if (tt != T_COLON) {
+		return 0;
+	}
+	feed();
+
+	a = ident();
+	if (!a) {
+		die("expected ident");
+	}
+
+	return mknode(N_LABEL, a, 0);
+}
+
+// goto_stmt := 'goto' ident
+struct node *
+goto_stmt(void)
+{
+	struct node *a;
+
+	if (tt != T_IDENT || cmp(token, (unsigned char *)"goto")) {
+		return 0;
+	}
+	feed();
+
+	a = ident();
+	if (!a) {
+		die("expected ident");
+	}
+
+	return mknode(N_GOTO, a, 0);
+}
+
 // stmt := if_stmt
 //       | loop_stmt
 //       | break_stmt ';'
 //       | continue_stmt ';'
 //       | return_stmt ';'
 //       | var_stmt ';'
+//       | label_stmt ';'
+//       | goto_stmt ';'
 //       | expr ';'
 struct node *
 stmt(void)
@@ -1544,6 +1779,26 @@ stmt(void)
 		return n;
 	}
 
+	n = label_stmt();
+	if (n) {
+		if (tt != T_SEMI) {
+			die("expected ;");
+		}
+		feed();
+
+		return n;
+	}
+
+	n = goto_stmt();
+	if (n) {
+		if (tt != T_SEMI) {
+			die("expected ;");
+		}
+		feed();
+
+		return n;
+	}
+
 	n = expr();
 	if (n) {
 		if (tt != T_SEMI) {
@@ -1997,37 +2252,38 @@ struct type {
 
 struct decl {
 	unsigned char *name;
-	struct decl *p;
-	struct decl *l;
-	struct decl *r;
+	struct decl *hnext;
+	struct decl *next;
 	struct type *ftype;
 	struct node *args;
 	struct node *body;
 	struct label *label;
-	struct vdecl *locals;
 	struct vdecl *vlocals;
 	struct vdecl *vargs;
 	int preamble;
+	unsigned char *zero;
+	int nzero;
+	int reached;
 	int defined;
 };
 
 struct vdecl {
 	unsigned char *name;
-	struct vdecl *p;
-	struct vdecl *l;
-	struct vdecl *r;
+	struct decl *f;
+	struct vdecl *hnext;
 	struct vdecl *next;
 	struct type *t;
 	int size;
 	int offset;
+	int init;
+	int used;
 	int defined;
 };
 
 struct mdecl {
 	unsigned char *name;
-	struct mdecl *p;
-	struct mdecl *l;
-	struct mdecl *r;
+	struct sdecl *s;
+	struct mdecl *hnext;
 	struct mdecl *next;
 	struct type *t;
 	int offset;
@@ -2036,10 +2292,8 @@ struct mdecl {
 
 struct sdecl {
 	unsigned char *name;
-	struct sdecl *p;
-	struct sdecl *l;
-	struct sdecl *r;
-	struct mdecl *mem;
+	struct sdecl *hnext;
+	struct sdecl *next;
 	struct mdecl *vmem;
 	struct mdecl *vmem_last;
 	int size;
@@ -2049,16 +2303,31 @@ struct sdecl {
 
 struct edecl {
 	unsigned char *name;
-	struct edecl *p;
-	struct edecl *l;
-	struct edecl *r;
+	struct edecl *hnext;
 	int val;
 	int defined;
 };
 
+struct gdecl {
+	unsigned char *name;
+	struct decl *f;
+	struct gdecl *hnext;
+	struct label *label;
+	int defined;
+};
+
+// Symbol tables, hashed on the address of the interned name and chained
+// through hnext
+
 struct decl *decls;
 struct sdecl *structs;
-struct edecl *enums;
+
+struct decl *decl_table[4096];
+struct vdecl *vdecl_table[4096];
+struct mdecl *mdecl_table[4096];
+struct sdecl *sdecl_table[4096];
+struct edecl *edecl_table[4096];
+struct gdecl *gdecl_table[4096];
 
 // Unify two types
 void
@@ -2092,56 +2361,61 @@ unify(struct type *a, struct type *b)
 	}
 }
 
+// Hash an interned name by its address
+unsigned
+phash(void *p)
+{
+	unsigned long x;
+
+	x = (unsigned long)p;
+
+	return x ^ (x >> 12);
+}
+
 // Find a function declaration by name
 struct decl *
-find(unsigned char *name)
+find(unsigned char *name, int def)
 {
 	struct decl **link;
 	struct decl *d;
-	struct decl *p;
-	int c;
 
-	p = 0;
-	link = &decls;
+	link = &decl_table[phash(name) % 4096];
 	while (1) {
 		d = *link;
 		if (!d) {
 			break;
 		}
 
-		c = cmp(name, d->name);
-
-		if (c < 0) {
-			p = d;
-			link = &d->l;
-		} else if (c > 0) {
-			p = d;
-			link = &d->r;
-		} else {
+		if (d->name == name) {
 			return d;
 		}
+
+		link = &d->hnext;
 	}
 
-	d = malloc(sizeof(*d));
-	if (!d) {
-		die("out of memory");
+	if (!def) {
+		return 0;
 	}
 
+	d = alloc(sizeof(*d));
+
 	d->name = name;
+	d->hnext = 0;
+	d->next = decls;
 	d->ftype = 0;
 	d->args = 0;
 	d->body = 0;
-	d->p = p;
-	d->l = 0;
-	d->r = 0;
 	d->label = mklabel();
-	d->locals = 0;
 	d->vlocals = 0;
 	d->vargs = 0;
 	d->preamble = 0;
+	d->zero = 0;
+	d->nzero = 0;
+	d->reached = 0;
 	d->defined = 0;
 
 	*link = d;
+	decls = d;
 
 	return d;
 }
@@ -2152,47 +2426,74 @@ vfind(struct decl *f, unsigned char *name, int def)
 {
 	struct vdecl **link;
 	struct vdecl *d;
-	struct vdecl *p;
-	int c;
 
-	p = 0;
-	link = &f->locals;
+	link = &vdecl_table[(phash(name) * 31 + phash(f)) % 4096];
 	while (1) {
 		d = *link;
 		if (!d) {
 			break;
 		}
 
-		c = cmp(name, d->name);
-
-		if (c < 0) {
-			p = d;
-			link = &d->l;
-		} else if (c > 0) {
-			p = d;
-			link = &d->r;
-		} else {
+		if (d->f == f && d->name == name) {
 			return d;
 		}
+
+		link = &d->hnext;
 	}
 
 	if (!def) {
 		return 0;
 	}
 
-	d = malloc(sizeof(*d));
-	if (!d) {
-		die("out of memory");
-	}
+	d = alloc(sizeof(*d));
 
 	d->name = name;
-	d->p = p;
-	d->l = 0;
-	d->r = 0;
+	d->f = f;
+	d->hnext = 0;
 	d->t = 0;
 	d->next = 0;
 	d->size = 0;
 	d->offset = 0;
+	d->init = 0;
+	d->used = 0;
+	d->defined = 0;
+
+	*link = d;
+
+	return d;
+}
+
+// Find a goto label by name
+struct gdecl *
+gfind(struct decl *f, unsigned char *name, int def)
+{
+	struct gdecl **link;
+	struct gdecl *d;
+
+	link = &gdecl_table[(phash(name) * 31 + phash(f)) % 4096];
+	while (1) {
+		d = *link;
+		if (!d) {
+			break;
+		}
+
+		if (d->f == f && d->name == name) {
+			return d;
+		}
+
+		link = &d->hnext;
+	}
+
+	if (!def) {
+		return 0;
+	}
+
+	d = alloc(sizeof(*d));
+
+	d->name = name;
+	d->f = f;
+	d->hnext = 0;
+	d->label = mklabel();
 	d->defined = 0;
 
 	*link = d;
@@ -2206,39 +2507,26 @@ mfind(struct sdecl *s, unsigned char *name)
 {
 	struct mdecl **link;
 	struct mdecl *d;
-	struct mdecl *p;
-	int c;
 
-	p = 0;
-	link = &s->mem;
+	link = &mdecl_table[(phash(name) * 31 + phash(s)) % 4096];
 	while (1) {
 		d = *link;
 		if (!d) {
 			break;
 		}
 
-		c = cmp(name, d->name);
-
-		if (c < 0) {
-			p = d;
-			link = &d->l;
-		} else if (c > 0) {
-			p = d;
-			link = &d->r;
-		} else {
+		if (d->s == s && d->name == name) {
 			return d;
 		}
-	}
 
-	d = malloc(sizeof(*d));
-	if (!d) {
-		die("out of memory");
+		link = &d->hnext;
 	}
 
+	d = alloc(sizeof(*d));
+
 	d->name = name;
-	d->p = p;
-	d->l = 0;
-	d->r = 0;
+	d->s = s;
+	d->hnext = 0;
 	d->t = 0;
 	d->next = 0;
 	d->offset = 0;
@@ -2262,40 +2550,26 @@ sfind(unsigned char *name)
 {
 	struct sdecl **link;
 	struct sdecl *d;
-	struct sdecl *p;
-	int c;
 
-	p = 0;
-	link = &structs;
+	link = &sdecl_table[phash(name) % 4096];
 	while (1) {
 		d = *link;
 		if (!d) {
 			break;
 		}
 
-		c = cmp(name, d->name);
-
-		if (c < 0) {
-			p = d;
-			link = &d->l;
-		} else if (c > 0) {
-			p = d;
-			link = &d->r;
-		} else {
+		if (d->name == name) {
 			return d;
 		}
-	}
 
-	d = malloc(sizeof(*d));
-	if (!d) {
-		die("out of memory");
+		link = &d->hnext;
 	}
 
+	d = alloc(sizeof(*d));
+
 	d->name = name;
-	d->p = p;
-	d->l = 0;
-	d->r = 0;
-	d->mem = 0;
+	d->hnext = 0;
+	d->next = structs;
 	d->vmem_last = 0;
 	d->vmem = 0;
 	d->size = 0;
@@ -2303,6 +2577,7 @@ sfind(unsigned char *name)
 	d->defined = 0;
 
 	*link = d;
+	structs = d;
 
 	return d;
 }
@@ -2313,43 +2588,29 @@ efind(unsigned char *name, int def)
 {
 	struct edecl **link;
 	struct edecl *d;
-	struct edecl *p;
-	int c;
 
-	p = 0;
-	link = &enums;
+	link = &edecl_table[phash(name) % 4096];
 	while (1) {
 		d = *link;
 		if (!d) {
 			break;
 		}
 
-		c = cmp(name, d->name);
-
-		if (c < 0) {
-			p = d;
-			link = &d->l;
-		} else if (c > 0) {
-			p = d;
-			link = &d->r;
-		} else {
+		if (d->name == name) {
 			return d;
 		}
+
+		link = &d->hnext;
 	}
 
 	if (!def) {
 		return 0;
 	}
 
-	d = malloc(sizeof(*d));
-	if (!d) {
-		die("out of memory");
-	}
+	d = alloc(sizeof(*d));
 
 	d->name = name;
-	d->p = p;
-	d->l = 0;
-	d->r = 0;
+	d->hnext = 0;
 	d->val = 0;
 	d->defined = 0;
 
@@ -2363,10 +2624,7 @@ mktype(int kind, struct type *val, struct type *arg, struct sdecl *s)
 {
 	struct type *t;
 
-	t = malloc(sizeof(*t));
-	if (!t) {
-		die("out of memory");
-	}
+	t = alloc(sizeof(*t));
 
 	t->s = s;
 	t->kind = kind;
@@ -2440,7 +2698,7 @@ declare(struct node *n)
 {
 	struct decl *d;
 	struct type *t;
-	d = find(n->a->s);
+	d = find(n->a->s, 1);
 	t = prototype(n->b);
 	lineno = n->lineno;
 	if (d->ftype) {
@@ -2548,7 +2806,7 @@ typeexpr(struct node *n)
 			if (v) {
 				n->t = v->t;
 			} else {
-				d = find(n->s);
+				d = find(n->s, 1);
 				if (!d->ftype) {
 					die("no such variable");
 				}
@@ -2874,22 +3132,146 @@ typearg(struct node *n, int offset)
 	link_arg = &v->next;
 }
 
-// Type a statement
+// Find the local a name refers to, if it is one
+struct vdecl *
+localdecl(struct node *n)
+{
+	struct vdecl *v;
+
+	if (n->kind != N_IDENT) {
+		return 0;
+	}
+
+	if (efind(n->s, 0)) {
+		return 0;
+	}
+
+	v = vfind(curfunc, n->s, 0);
+	if (!v || v->offset >= 0) {
+		return 0;
+	}
+
+	return v;
+}
+
+// Mark every local mentioned in an expression as used
 void
-typestmt(struct node *n)
+uselocals(struct node *n)
 {
-	int kind;
+	struct vdecl *v;
 
 	if (!n) {
 		return;
 	}
 
-	lineno = n->lineno;
+	if (n->kind == N_IDENT) {
+		v = localdecl(n);
+		if (v) {
+			v->used = 1;
+		}
+		return;
+	}
 
-	kind = n->kind;
-	if (kind == N_CONDLIST) {
-		while (1) {
-			if (!n) {
+	uselocals(n->a);
+	uselocals(n->b);
+}
+
+// Find the locals that the assignments at the very start of a function
+// store to before anything could read them
+void
+initlocals(struct node *n)
+{
+	struct node *s;
+	struct vdecl *v;
+
+	while (1) {
+		if (!n) {
+			break;
+		}
+
+		s = n->a;
+		if (s->kind == N_ASSIGN) {
+			uselocals(s->b);
+			v = localdecl(s->a);
+			if (v && !v->used && type_isprim(v->t)) {
+				v->init = 1;
+			} else {
+				uselocals(s->a);
+			}
+		} else if (s->kind != N_VARDECL) {
+			break;
+		}
+
+		n = n->b;
+	}
+}
+
+// Mark the frame slots holding locals that still need to start out zero
+void
+zerolocals(struct decl *d)
+{
+	struct vdecl *v;
+	int size;
+	int lo;
+	int hi;
+	int i;
+
+	size = (d->preamble + 7) / 8 + 1;
+	d->zero = alloc(size);
+	i = 0;
+	while (1) {
+		if (i == size) {
+			break;
+		}
+		d->zero[i] = 0;
+		i = i + 1;
+	}
+
+	v = d->vlocals;
+	while (1) {
+		if (!v) {
+			break;
+		}
+
+		size = type_sizeof(v->t);
+		if (!v->init && size != 0) {
+			// Slots are numbered down from the frame pointer
+			lo = -(v->offset + size) / 8;
+			hi = (-v->offset - 1) / 8;
+			while (1) {
+				if (lo > hi) {
+					break;
+				}
+				d->zero[lo] = 1;
+				lo = lo + 1;
+			}
+
+			if (hi + 1 > d->nzero) {
+				d->nzero = hi + 1;
+			}
+		}
+
+		v = v->next;
+	}
+}
+
+// Type a statement
+void
+typestmt(struct node *n)
+{
+	struct gdecl *g;
+	int kind;
+
+	if (!n) {
+		return;
+	}
+
+	lineno = n->lineno;
+
+	kind = n->kind;
+	if (kind == N_CONDLIST) {
+		while (1) {
+			if (!n) {
 				break;
 			}
 			typestmt(n->a->a);
@@ -2920,21 +3302,72 @@ typestmt(struct node *n)
 		}
 	} else if (kind == N_VARDECL) {
 		typelocal(n);
-	} else if (kind != N_BREAK && kind != N_CONTINUE) {
+	} else if (kind == N_LABEL) {
+		g = gfind(curfunc, n->a->s, 1);
+		if (g->defined) {
+			die("duplicate goto");
+		}
+		g->defined = 1;
+	} else if (kind != N_BREAK && kind != N_CONTINUE && kind != N_GOTO) {
 		typeexpr(n);
 	}
 }
 
-// Find the first decl in a subtree
+// Merge sort a list of declarations by name
 struct decl *
-mindecl(struct decl *d)
+sortdecls(struct decl *d)
 {
+	struct decl *head;
+	struct decl **link;
+	struct decl *a;
+	struct decl *b;
+
+	if (!d || !d->next) {
+		return d;
+	}
+
+	// Split the list in half
+	a = d;
+	b = d->next;
 	while (1) {
-		if (!d || !d->l) {
-			return d;
+		if (!b || !b->next) {
+			break;
 		}
-		d = d->l;
+		a = a->next;
+		b = b->next->next;
 	}
+
+	b = a->next;
+	a->next = 0;
+
+	a = sortdecls(d);
+	b = sortdecls(b);
+
+	// Merge the halves
+	link = &head;
+	while (1) {
+		if (!a || !b) {
+			break;
+		}
+
+		if (cmp(a->name, b->name) <= 0) {
+			*link = a;
+			link = &a->next;
+			a = a->next;
+		} else {
+			*link = b;
+			link = &b->next;
+			b = b->next;
+		}
+	}
+
+	if (a) {
+		*link = a;
+	} else {
+		*link = b;
+	}
+
+	return head;
 }
 
 // Find the next declaration
@@ -2945,43 +3378,79 @@ nextdecl(struct decl *d)
 		return 0;
 	}
 
-	if (d->r) {
-		return mindecl(d->r);
-	}
-
-	while (1) {
-		if (!d->p) {
-			return 0;
-		}
-		if (d->p->l == d) {
-			return d->p;
-		}
-		d = d->p;
-	}
+	return d->next;
 }
 
-// Find the first declaration
+// Find the first declaration, visiting them in order of name
 struct decl *
 firstdecl(void)
 {
-	return mindecl(decls);
+	decls = sortdecls(decls);
+	return decls;
 }
 
+// Merge sort a list of structures by name
 struct sdecl *
-minsdecl(struct sdecl *d)
+sortsdecls(struct sdecl *d)
 {
+	struct sdecl *head;
+	struct sdecl **link;
+	struct sdecl *a;
+	struct sdecl *b;
+
+	if (!d || !d->next) {
+		return d;
+	}
+
+	// Split the list in half
+	a = d;
+	b = d->next;
 	while (1) {
-		if (!d || !d->l) {
-			return d;
+		if (!b || !b->next) {
+			break;
+		}
+		a = a->next;
+		b = b->next->next;
+	}
+
+	b = a->next;
+	a->next = 0;
+
+	a = sortsdecls(d);
+	b = sortsdecls(b);
+
+	// Merge the halves
+	link = &head;
+	while (1) {
+		if (!a || !b) {
+			break;
+		}
+
+		if (cmp(a->name, b->name) <= 0) {
+			*link = a;
+			link = &a->next;
+			a = a->next;
+		} else {
+			*link = b;
+			link = &b->next;
+			b = b->next;
 		}
-		d = d->l;
 	}
+
+	if (a) {
+		*link = a;
+	} else {
+		*link = b;
+	}
+
+	return head;
 }
 
 struct sdecl *
 sfirst(void)
 {
-	return minsdecl(structs);
+	structs = sortsdecls(structs);
+	return structs;
 }
 
 struct sdecl *
@@ -2991,19 +3460,7 @@ snext(struct sdecl *d)
 		return 0;
 	}
 
-	if (d->r) {
-		return minsdecl(d->r);
-	}
-
-	while (1) {
-		if (!d->p) {
-			return 0;
-		}
-		if (d->p->l == d) {
-			return d->p;
-		}
-		d = d->p;
-	}
+	return d->next;
 }
 
 // Define a struct member
@@ -3224,6 +3681,11 @@ typecheck(struct node *p)
 
 		typestmt(d->body);
 
+		// Only the slots of locals that might be read before they are
+		// assigned need to be zeroed
+		initlocals(d->body);
+		zerolocals(d);
+
 		d = nextdecl(d);
 	}
 }
@@ -3243,6 +3705,19 @@ struct fix {
 	struct fix *next;
 	unsigned char *ptr;
 	int at;
+	struct label *l;
+	int kind;
+	int cc;
+	int op;
+	int rel8;
+	struct fix *all;
+};
+
+// What a fixup patches
+enum {
+	FIX_REL32,
+	FIX_JMP,
+	FIX_JCC,
 };
 
 struct buf {
@@ -3256,6 +3731,14 @@ int at;
 struct label *labels;
 struct buf *text;
 struct buf *text_end;
+struct fix *fixups;
+struct fix *fixups_end;
+int nbranch;
+
+// String literals in the read-only data
+struct istr *rodata;
+struct istr *rodata_end;
+int rodata_size;
 
 // Create a new label
 struct label *
@@ -3263,10 +3746,7 @@ mklabel(void)
 {
 	struct label *l;
 
-	l = malloc(sizeof(*l));
-	if (!l) {
-		die("out of memory");
-	}
+	l = alloc(sizeof(*l));
 
 	l->next = labels;
 	l->fix = 0;
@@ -3293,15 +3773,9 @@ reserve(int n)
 		n = 4096;
 	}
 
-	m = malloc(n);
-	if (!m) {
-		die("out of memory");
-	}
+	m = alloc(n);
 
-	b = malloc(sizeof(*b));
-	if (!b) {
-		die("out of memory");
-	}
+	b = alloc(sizeof(*b));
 
 	b->buf = m;
 	b->fill = 0;
@@ -3337,9 +3811,10 @@ fixup(unsigned char *here, int delta)
 	here[3] = delta >> 24;
 }
 
-// Add an new fixup for the current position
+// Add a fixup for the current position. Every fixup is remembered so jumps
+// can be shortened once the whole text is known.
 void
-addfixup(struct label *l)
+addbranch(struct label *l, int kind, int cc)
 {
 	struct fix *f;
 	unsigned char *here;
@@ -3352,25 +3827,50 @@ addfixup(struct label *l)
 	emit(0);
 	emit(0);
 
+	f = alloc(sizeof(*f));
+	f->next = 0;
+	f->ptr = here;
+	f->at = at;
+	f->l = l;
+	f->kind = kind;
+	f->cc = cc;
+	f->op = 0;
+	f->rel8 = 0;
+	f->all = 0;
+
+	if (kind == FIX_JMP) {
+		f->op = at - 5;
+		nbranch = nbranch + 1;
+	} else if (kind == FIX_JCC) {
+		f->op = at - 6;
+		nbranch = nbranch + 1;
+	}
+
+	if (fixups_end) {
+		fixups_end->all = f;
+	} else {
+		fixups = f;
+	}
+	fixups_end = f;
+
 	if (l->fixed) {
 		fixup(here, l->at - at);
 	} else {
-		f = malloc(sizeof(*f));
-		if (!f) {
-			die("out of memory");
-		}
-
 		f->next = l->fix;
-		f->ptr = here;
-		f->at = at;
-
 		l->fix = f;
 	}
 }
 
-// Fix references to a label to the current position
+// Add an new fixup for the current position
 void
-fixup_label(struct label *l)
+addfixup(struct label *l)
+{
+	addbranch(l, FIX_REL32, 0);
+}
+
+// Fix references to a label to the position x
+void
+place_label(struct label *l, int x)
 {
 	struct fix *f;
 
@@ -3378,7 +3878,7 @@ fixup_label(struct label *l)
 		die("already fixed");
 	}
 
-	l->at = at;
+	l->at = x;
 	l->fixed = 1;
 
 	f = l->fix;
@@ -3391,6 +3891,13 @@ fixup_label(struct label *l)
 	}
 }
 
+// Fix references to a label to the current position
+void
+fixup_label(struct label *l)
+{
+	place_label(l, at);
+}
+
 void
 emit_ptr(struct label *l)
 {
@@ -3408,7 +3915,7 @@ emit_jmp(struct label *l)
 {
 	// jmp l
 	emit(0xe9);
-	addfixup(l);
+	addbranch(l, FIX_JMP, 0);
 }
 
 void
@@ -3422,45 +3929,37 @@ emit_num(int x)
 	emit(x >> 24);
 }
 
-void
-emit_str(unsigned char *s)
+// Add a string constant to the read-only data, sharing identical strings.
+// The label is placed after the text is finished.
+struct label *
+emit_strlit(unsigned char *s)
 {
-	struct label *a;
-	struct label *b;
-	int i;
+	struct istr *p;
 
-	a = mklabel();
-	b = mklabel();
+	p = intern_istr(s, slen(s));
+	if (p->lit) {
+		return p->lit;
+	}
 
-	// jmp b
-	emit_jmp(b);
+	p->lit = mklabel();
+	p->lit_at = rodata_size;
+	rodata_size = rodata_size + p->len + 1;
 
-	// a:
-	fixup_label(a);
-	// .string s
-	while (1) {
-		if (!*s) {
-			break;
-		}
-		emit(*s);
-		s = s + 1;
+	if (rodata_end) {
+		rodata_end->lit_next = p;
+	} else {
+		rodata = p;
 	}
-	emit(0);
+	rodata_end = p;
 
-	// nop sled
-	emit(0x90);
-	emit(0x90);
-	emit(0x90);
-	emit(0x90);
-	emit(0x90);
-	emit(0x90);
-	emit(0x90);
-	emit(0x90);
+	return p->lit;
+}
 
-	// b:
-	fixup_label(b);
-	// push a
-	emit_ptr(a);
+void
+emit_str(unsigned char *s)
+{
+	// push s
+	emit_ptr(emit_strlit(s));
 }
 
 void
@@ -3477,23 +3976,74 @@ emit_pop(int n)
 	emit(n >> 24);
 }
 
+// sub rsp, 8*n
 void
-emit_preamble(int n)
+emit_reserve(int n)
+{
+	n = n * 8;
+	emit(0x48);
+	emit(0x81);
+	emit(0xec);
+	emit(n);
+	emit(n >> 8);
+	emit(n >> 16);
+	emit(n >> 24);
+}
+
+void
+emit_preamble(struct decl *d)
 {
 	int i;
+	int n;
 	// push rbp
 	emit(0x55);
 	// mov rbp, rsp
 	emit(0x48);
 	emit(0x89);
 	emit(0xe5);
-	i = 0;
-	while (1) {
-		if (i >= n) {
-			break;
+
+	// Zero the slots up to the last local that needs it. Large frames use
+	// rep stosq instead of a push per slot.
+	n = d->nzero;
+	if (n > 16) {
+		emit_reserve(n);
+		// mov rdi, rsp
+		emit(0x48);
+		emit(0x89);
+		emit(0xe7);
+		// mov ecx, n
+		emit(0xb9);
+		emit(n);
+		emit(n >> 8);
+		emit(n >> 16);
+		emit(n >> 24);
+		// xor eax, eax
+		emit(0x31);
+		emit(0xc0);
+		// rep stosq
+		emit(0xf3);
+		emit(0x48);
+		emit(0xab);
+	} else {
+		i = 0;
+		while (1) {
+			if (i == n) {
+				break;
+			}
+			if (d->zero[i]) {
+				emit_num(0);
+			} else {
+				// push rax
+				emit(0x50);
+			}
+			i = i + 1;
 		}
-		emit_num(0);
-		i = i + 8;
+	}
+
+	// The rest of the frame is only reserved
+	i = (d->preamble + 7) / 8 - n;
+	if (i > 0) {
+		emit_reserve(i);
 	}
 }
 
@@ -3557,7 +4107,7 @@ emit_jz(struct label *l)
 	// jz no
 	emit(0x0f);
 	emit(0x84);
-	addfixup(l);
+	addbranch(l, FIX_JCC, 4);
 }
 
 void
@@ -3666,6 +4216,18 @@ emit_call(int n)
 	emit(0x50);
 }
 
+void
+emit_call_label(struct label *l, int n)
+{
+	// call l
+	emit(0xe8);
+	addfixup(l);
+	// add rsp, 8*n
+	emit_pop(n);
+	// push rax
+	emit(0x50);
+}
+
 void
 emit_gt(void)
 {
@@ -3952,6 +4514,258 @@ emit_neg(void)
 	emit(0x50);
 }
 
+// Position of old text offset x once the short jumps in sites are shrunk
+int
+relax_pos(struct fix **sites, int *saved, int n, int x)
+{
+	int lo;
+	int hi;
+	int mid;
+
+	// Count the jumps that start before x
+	lo = 0;
+	hi = n;
+	while (1) {
+		if (lo >= hi) {
+			break;
+		}
+		mid = (lo + hi) >> 1;
+		if (sites[mid]->op < x) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return x - saved[lo];
+}
+
+// Find the next jump from i on that was shortened
+int
+relax_next(struct fix **sites, int n, int i)
+{
+	while (1) {
+		if (i == n || sites[i]->rel8) {
+			return i;
+		}
+		i = i + 1;
+	}
+}
+
+// Shorten jumps whose target is in reach of a rel8 and rebuild the text.
+// Shrinking code only brings targets closer, so iterate until no more
+// jumps fit.
+void
+relax(void)
+{
+	struct fix **sites;
+	int *saved;
+	struct fix *f;
+	struct label *l;
+	struct buf *b;
+	unsigned char *buf;
+	int n;
+	int i;
+	int j;
+	int k;
+	int changed;
+	int disp;
+	int size;
+	int skip;
+	int pos;
+	int next;
+	int m;
+
+	n = nbranch;
+	if (n == 0) {
+		return;
+	}
+
+	sites = alloc(n * sizeof(*sites));
+	saved = alloc((n + 1) * sizeof(*saved));
+
+	i = 0;
+	f = fixups;
+	while (1) {
+		if (!f) {
+			break;
+		}
+		if (f->kind != FIX_REL32) {
+			sites[i] = f;
+			i = i + 1;
+		}
+		f = f->all;
+	}
+
+	while (1) {
+		saved[0] = 0;
+		i = 0;
+		while (1) {
+			if (i == n) {
+				break;
+			}
+			f = sites[i];
+			saved[i + 1] = saved[i];
+			if (f->rel8 && f->kind == FIX_JMP) {
+				saved[i + 1] = saved[i] + 3;
+			} else if (f->rel8) {
+				saved[i + 1] = saved[i] + 4;
+			}
+			i = i + 1;
+		}
+
+		changed = 0;
+		i = 0;
+		while (1) {
+			if (i == n) {
+				break;
+			}
+			f = sites[i];
+			if (!f->rel8 && f->l->fixed) {
+				// The jump itself is the last one before its end
+				disp = relax_pos(sites, saved, n, f->l->at) - (f->at - saved[i + 1]);
+				if (disp >= -128 && disp <= 127) {
+					f->rel8 = 1;
+					changed = 1;
+				}
+			}
+			i = i + 1;
+		}
+
+		if (!changed) {
+			break;
+		}
+	}
+
+	if (saved[n] == 0) {
+		return;
+	}
+
+	// Copy the text, replacing shortened jumps by their rel8 forms
+	size = at - saved[n];
+	buf = alloc(size);
+
+	k = relax_next(sites, n, 0);
+	next = at;
+	if (k < n) {
+		next = sites[k]->op;
+	}
+
+	pos = 0;
+	j = 0;
+	skip = 0;
+	b = text;
+	i = 0;
+	while (1) {
+		if (!b) {
+			break;
+		}
+
+		if (i == b->fill) {
+			b = b->next;
+			i = 0;
+			continue;
+		}
+
+		m = b->fill - i;
+		if (skip > 0) {
+			if (m > skip) {
+				m = skip;
+			}
+			skip = skip - m;
+			i = i + m;
+			pos = pos + m;
+			continue;
+		}
+
+		if (pos == next) {
+			f = sites[k];
+			if (f->kind == FIX_JMP) {
+				// jmp rel8
+				buf[j] = 0xeb;
+				skip = 5;
+			} else {
+				// jcc rel8
+				buf[j] = 0x70 + f->cc;
+				skip = 6;
+			}
+			buf[j + 1] = 0;
+			j = j + 2;
+
+			k = relax_next(sites, n, k + 1);
+			next = at;
+			if (k < n) {
+				next = sites[k]->op;
+			}
+			continue;
+		}
+
+		if (m > next - pos) {
+			m = next - pos;
+		}
+		copy(&buf[j], &b->buf[i], m);
+		i = i + m;
+		j = j + m;
+		pos = pos + m;
+	}
+
+	// Move every fixup and label to the new text. The fixups are in order.
+	k = 0;
+	f = fixups;
+	while (1) {
+		if (!f) {
+			break;
+		}
+		while (1) {
+			if (k == n || sites[k]->op >= f->at) {
+				break;
+			}
+			k = k + 1;
+		}
+		f->at = f->at - saved[k];
+		if (f->rel8) {
+			f->ptr = &buf[f->at - 1];
+		} else {
+			f->ptr = &buf[f->at - 4];
+		}
+		f = f->all;
+	}
+
+	l = labels;
+	while (1) {
+		if (!l) {
+			break;
+		}
+		if (l->fixed) {
+			l->at = relax_pos(sites, saved, n, l->at);
+		}
+		l = l->next;
+	}
+
+	f = fixups;
+	while (1) {
+		if (!f) {
+			break;
+		}
+		if (f->l->fixed && f->rel8) {
+			f->ptr[0] = f->l->at - f->at;
+		} else if (f->l->fixed) {
+			fixup(f->ptr, f->l->at - f->at);
+		}
+		f = f->all;
+	}
+
+	b = alloc(sizeof(*b));
+	b->buf = buf;
+	b->fill = size;
+	b->cap = size;
+	b->next = 0;
+
+	text = b;
+	text_end = b;
+	at = size;
+}
+
 // Write the output
 void
 writeout(void)
@@ -3959,16 +4773,33 @@ writeout(void)
 	int i;
 	int load_addr;
 	int entry;
+	int rodata_off;
+	int rodata_addr;
 	struct decl *d;
 	struct buf *b;
+	struct istr *p;
 
 	load_addr = 0x100000;
 
-	d = find((unsigned char *)"_start");
+	d = find(intern_str("_start"), 1);
 	if (!d->defined || !d->label->fixed) {
 		die("no _start function");
 	}
 
+	// The read-only data follows the text in the file but is mapped a page
+	// later so it does not share the executable mapping
+	rodata_off = at + 176;
+	rodata_addr = load_addr + rodata_off + 4096;
+
+	p = rodata;
+	while (1) {
+		if (!p) {
+			break;
+		}
+		place_label(p->lit, at + 4096 + p->lit_at);
+		p = p->lit_next;
+	}
+
 	// magic
 	putchar(0x7f);
 	putchar('E');
@@ -4013,7 +4844,7 @@ writeout(void)
 	putchar(0);
 	putchar(0);
 
-	entry = load_addr + d->label->at + 128;
+	entry = load_addr + d->label->at + 176;
 
 	// entry point
 	putchar(entry);
@@ -4060,7 +4891,7 @@ writeout(void)
 	putchar(0);
 
 	// phnum
-	putchar(1);
+	putchar(2);
 	putchar(0);
 
 	// shentsize
@@ -4117,7 +4948,7 @@ writeout(void)
 	putchar(0);
 	putchar(0);
 
-	at = at + 128;
+	at = at + 176;
 
 	// phdr[0].filesize
 	putchar(at);
@@ -4149,15 +4980,77 @@ writeout(void)
 	putchar(0);
 	putchar(0);
 
-	// nop sled
-	putchar(0x90);
-	putchar(0x90);
-	putchar(0x90);
-	putchar(0x90);
-	putchar(0x90);
-	putchar(0x90);
-	putchar(0x90);
-	putchar(0x90);
+	// phdr[1].type
+	putchar(1);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+
+	// phdr[1].flags
+	putchar(4);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+
+	// phdr[1].offset
+	putchar(rodata_off);
+	putchar(rodata_off >> 8);
+	putchar(rodata_off >> 16);
+	putchar(rodata_off >> 24);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+
+	// phdr[1].vaddr
+	putchar(rodata_addr);
+	putchar(rodata_addr >> 8);
+	putchar(rodata_addr >> 16);
+	putchar(rodata_addr >> 24);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+
+	// phdr[1].paddr
+	putchar(0);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+
+	// phdr[1].filesize
+	putchar(rodata_size);
+	putchar(rodata_size >> 8);
+	putchar(rodata_size >> 16);
+	putchar(rodata_size >> 24);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+
+	// phdr[1].memsize
+	putchar(rodata_size);
+	putchar(rodata_size >> 8);
+	putchar(rodata_size >> 16);
+	putchar(rodata_size >> 24);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+
+	// phdr[1].align
+	putchar(0);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+	putchar(0);
+	putchar(0);
 
 	// text
 	b = text;
@@ -4175,6 +5068,23 @@ writeout(void)
 		}
 		b = b->next;
 	}
+
+	// rodata
+	p = rodata;
+	while (1) {
+		if (!p) {
+			break;
+		}
+		i = 0;
+		while (1) {
+			if (i > p->len) {
+				break;
+			}
+			putchar(p->s[i]);
+			i = i + 1;
+		}
+		p = p->lit_next;
+	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -4189,7 +5099,7 @@ add_stdlib(void)
 	struct label *b;
 	struct decl *d;
 
-	d = find((unsigned char *)"syscall");
+	d = find(intern_str("syscall"), 1);
 	if (!d->defined) {
 		d->defined = 1;
 		fixup_label(d->label);
@@ -4242,6 +5152,26 @@ add_stdlib(void)
 		// ret
 		emit(0xc3);
 	}
+
+	d = find(intern_str("rdtsc"), 1);
+	if (d->ftype && !d->defined) {
+		d->defined = 1;
+		fixup_label(d->label);
+		// rdtsc
+		emit(0x0f);
+		emit(0x31);
+		// shl rdx, 32
+		emit(0x48);
+		emit(0xc1);
+		emit(0xe2);
+		emit(0x20);
+		// or rax, rdx
+		emit(0x48);
+		emit(0x09);
+		emit(0xd0);
+		// ret
+		emit(0xc3);
+	}
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -4275,7 +5205,7 @@ texpr(struct node *n, int rhs)
 					emit_load(n->t);
 				}
 			} else {
-				d = find(n->s);
+				d = find(n->s, 1);
 				emit_ptr(d->label);
 			}
 		}
@@ -4315,8 +5245,14 @@ texpr(struct node *n, int rhs)
 		if (n->b) {
 			texpr(n->b, 1);
 		}
-		texpr(n->a, 0);
-		emit_call(nargs);
+		// Call named functions directly
+		a = n->a;
+		if (a->kind == N_IDENT && !efind(a->s, 0) && !vfind(curfunc, a->s, 0)) {
+			emit_call_label(find(a->s, 1)->label, nargs);
+		} else {
+			texpr(n->a, 0);
+			emit_call(nargs);
+		}
 	} else if (kind == N_DOT) {
 		texpr(n->a, 0);
 		if (n->a->t->kind == TY_PTR) {
@@ -4564,6 +5500,7 @@ tstmt(struct node *n)
 	struct label *no;
 	struct label *saved_top;
 	struct label *saved_out;
+	struct gdecl *g;
 	int kind;
 
 	if (!n) {
@@ -4629,6 +5566,15 @@ tstmt(struct node *n)
 			emit_num(0);
 		}
 		emit_ret();
+	} else if (kind == N_LABEL) {
+		g = gfind(curfunc, n->a->s, 0);
+		fixup_label(g->label);
+	} else if (kind == N_GOTO) {
+		g = gfind(curfunc, n->a->s, 0);
+		if (!g || !g->defined) {
+			die("label not defined");
+		}
+		emit_jmp(g->label);
 	} else if (kind != N_VARDECL) {
 		texpr(n, 1);
 		emit_pop(1);
@@ -4647,11 +5593,12 @@ tfunc(struct decl *d)
 
 	curfunc = d;
 
-	emit_str(d->name);
+	// Keep the name in the read-only data for debugging
+	emit_strlit(d->name);
 
 	fixup_label(d->label);
 
-	emit_preamble(d->preamble);
+	emit_preamble(d);
 
 	tstmt(d->body);
 
@@ -4659,18 +5606,135 @@ tfunc(struct decl *d)
 	emit_ret();
 }
 
-// Translate all functions
+// Check if a statement contains a label
+int
+haslabel(struct node *n)
+{
+	if (!n) {
+		return 0;
+	}
+
+	if (n->kind == N_LABEL) {
+		return 1;
+	}
+
+	return haslabel(n->a) || haslabel(n->b);
+}
+
+// Drop the statements following a return, break, continue or goto in the
+// same list, up to the next one containing a label. Declarations are kept
+// since locals are already laid out.
+void
+prune(struct node *n)
+{
+	struct node *p;
+	int kind;
+
+	if (!n) {
+		return;
+	}
+
+	kind = n->kind;
+	if (kind == N_CONDLIST) {
+		while (1) {
+			if (!n) {
+				break;
+			}
+			prune(n->a->b);
+			n = n->b;
+		}
+	} else if (kind == N_LOOP) {
+		prune(n->a);
+	} else if (kind == N_STMTLIST) {
+		while (1) {
+			if (!n) {
+				break;
+			}
+
+			prune(n->a);
+
+			kind = n->a->kind;
+			if (kind == N_RETURN || kind == N_BREAK || kind == N_CONTINUE || kind == N_GOTO) {
+				p = n;
+				while (1) {
+					if (!p->b || haslabel(p->b->a)) {
+						break;
+					}
+
+					if (p->b->a->kind == N_VARDECL) {
+						p = p->b;
+					} else {
+						p->b = p->b->b;
+					}
+				}
+				n = p;
+			}
+
+			n = n->b;
+		}
+	}
+}
+
+// Visit the functions named in the body of f
+void
+reachnode(struct decl *f, struct node *n)
+{
+	struct decl *d;
+
+	if (!n) {
+		return;
+	}
+
+	if (n->kind == N_IDENT) {
+		if (efind(n->s, 0) || vfind(f, n->s, 0)) {
+			return;
+		}
+
+		d = find(n->s, 0);
+		if (d && d->ftype) {
+			reach(d);
+		}
+
+		return;
+	}
+
+	reachnode(f, n->a);
+	reachnode(f, n->b);
+}
+
+// Mark a function and everything it refers to as reachable
+void
+reach(struct decl *d)
+{
+	if (d->reached) {
+		return;
+	}
+
+	d->reached = 1;
+
+	prune(d->body);
+	reachnode(d, d->body);
+}
+
+// Translate the functions reachable from _start
 void
 translate(struct node *p)
 {
 	struct decl *d;
 
+	d = find(intern_str("_start"), 0);
+	if (d) {
+		reach(d);
+	}
+
 	d = firstdecl();
 	while (1) {
 		if (!d) {
 			break;
 		}
-		tfunc(d);
+		if (d->reached) {
+			tfunc(d);
+		}
 		d = nextdecl(d);
 	}
 }
@@ -4699,8 +5763,13 @@ main(int argc, char **argv)
 	// Define _start, syscall
 	add_stdlib();
 
+	// Shorten jumps
+	relax();
+
 	// Write output
 	writeout();
 
+	release();
+
 	return 0;
 }
@@ -1,4 +1,10 @@
 syscall(n: int, a1: int, a2: int, a3: int, a4: int, a5: int, a6: int): int;
+rdtsc(): int;
+
+struct timespec {
+	sec: int;
+	nsec: int;
+}
 
 struct page {
 	ptr: *byte;
@@ -6,6 +12,27 @@ struct page {
 	size: int;
 }
 
+struct file {
+	fd: int;
+	buf: *byte;
+	pos: int;
+	len: int;
+	cap: int;
+}
+
+// State of the generated lexer. The text of the token being matched starts
+// at start in the input buffer, and mark is the end of the longest match.
+// The table driven form keeps its transitions in tab.
+struct lex_state {
+	c: *compiler;
+	f: *file;
+	start: int;
+	mark: int;
+	tag: int;
+	tab: *int;
+	ntab: int;
+}
+
 struct node {
 	kind: int;
 	a: *node;
@@ -15,6 +42,7 @@ struct node {
 	n: int;
 	s: *byte;
 	t: *type;
+	d: *decl;
 }
 
 struct type {
@@ -28,14 +56,67 @@ struct fixup {
 	next: *fixup;
 	ptr: *byte;
 	at: int;
+	l: *label;
+	kind: int;
+	cc: int;
+	op: int;
+	rel8: int;
+	all: *fixup;
 }
 
 struct label {
+	next: *label;
 	fix: *fixup;
 	at: int;
 	fixed: int;
 }
 
+struct irarg {
+	next: *irarg;
+	t: int;
+}
+
+struct irop {
+	next: *irop;
+	op: int;
+	k: int;
+	dst: int;
+	a: int;
+	b: int;
+	n: int;
+	t: *type;
+	l: *label;
+	s: *byte;
+	args: *irarg;
+	live: int;
+	fused: int;
+	hoist: int;
+}
+
+struct irblock {
+	next: *irblock;
+	first: *irop;
+	last: *irop;
+	term: int;
+	cond: int;
+	to: *irblock;
+	alt: *irblock;
+	label: *label;
+	mark: int;
+	seq: int;
+}
+
+struct irloop {
+	next: *irloop;
+	lo: int;
+	hi: int;
+	pre: *irblock;
+	calls: int;
+	stores: **irop;
+	nstores: int;
+	pins: int;
+}
+
 struct chunk {
 	next: *chunk;
 	buf: *byte;
@@ -43,17 +124,36 @@ struct chunk {
 	cap: int;
 }
 
+struct istr {
+	next: *istr;
+	hash: int;
+	len: int;
+	s: *byte;
+	lit: *label;
+	lit_at: int;
+	lit_next: *istr;
+}
+
 struct decl {
 	name: *byte;
 	member_name: *byte;
-	p: *decl;
-	l: *decl;
-	r: *decl;
+	hash: int;
+	hnext: *decl;
+	next: *decl;
 
 	func_defined: int;
 	func_type: *type;
 	func_label: *label;
 	func_def: *node;
+	func_framed: int;
+	func_frame: int;
+	func_nregs: int;
+	func_zero: *byte;
+	func_nzero: int;
+	func_reached: int;
+	func_cost: int;
+	func_nret: int;
+	func_inlining: int;
 
 	struct_defined: int;
 	struct_size: int;
@@ -73,31 +173,114 @@ struct decl {
 	var_type: *type;
 	var_offset: int;
 	var_def: *node;
+	var_init: int;
+	var_used: int;
 
 	goto_defined: int;
 	goto_label: *label;
+	goto_block: *irblock;
 }
 
 struct compiler {
 	// Allocator
 	page: *page;
 
+	// Buffered stdin and stdout
+	in: file;
+	out: file;
+
 	// Lexer
 	nc: int;
 	lineno: int;
 	colno: int;
 	tt: int;
+	kw: int;
 	token: *byte;
 	tlen: int;
 	tmax: int;
+	cclass: *byte;
+	ctok: *byte;
+	kw_name: **byte;
+	kw_id: *int;
+	lex: *lex_state;
+	lex_tt: *byte;
+	lex_kw: *byte;
+
+	// Interned strings
+	istr_table: **istr;
+	istr_cap: int;
+	istr_count: int;
 
 	// Assembler
 	at: int;
 	text: *chunk;
 	text_end: *chunk;
+	labels: *label;
+	fixups: *fixup;
+	fixups_end: *fixup;
+	nbranch: int;
+
+	// String literals in the read-only data
+	rodata: *istr;
+	rodata_end: *istr;
+	rodata_size: int;
 
 	// Namespace
 	decls: *decl;
+	decl_table: **decl;
+	decl_cap: int;
+	decl_count: int;
+
+	// IR of the current function
+	ir_entry: *irblock;
+	ir_end: *irblock;
+	ir_cur: *irblock;
+	ir_ntemps: int;
+	ir_frame: int;
+	ir_frame_max: int;
+	ir_bias: int;
+	ir_depth: int;
+	ir_retb: *irblock;
+	ir_rett: int;
+	ir_reg: *int;
+	ir_slot: *int;
+	ir_uses: *int;
+	ir_defb: **irblock;
+	ir_last: **irop;
+	ir_seq: int;
+	ir_loops: *irloop;
+	ir_lea: int;
+	ir_ndef: *int;
+	ir_def: **irop;
+	ir_pin: *int;
+
+	// Peephole
+	peep: int;
+	peep_reg: int;
+	peep_imm: int;
+
+	// Options
+	opt_regs: int;
+	opt_peep: int;
+	opt_ir: int;
+	opt_fold: int;
+	opt_branch: int;
+	opt_inline: int;
+	opt_regcall: int;
+	opt_loop: int;
+	opt_dfa: int;
+	opt_stats: int;
+
+	// Statistics
+	stat_wall: int;
+	stat_tsc: int;
+	stat_lex: int;
+	stat_tokens: int;
+	stat_nodes: int;
+	stat_labels: int;
+	stat_fixups: int;
+	stat_pages: int;
+	stat_mapped: int;
 }
 
 enum {
@@ -140,6 +323,30 @@ enum {
 	T_MOD,
 }
 
+enum {
+	K_NONE,
+	K_IF,
+	K_ELSE,
+	K_LOOP,
+	K_BREAK,
+	K_CONTINUE,
+	K_RETURN,
+	K_VAR,
+	K_GOTO,
+	K_ENUM,
+	K_STRUCT,
+	K_FUNC,
+	K_SIZEOF,
+}
+
+enum {
+	CL_NONE,
+	CL_SPACE,
+	CL_ALPHA,
+	CL_DIGIT,
+	CL_PUNCT,
+}
+
 enum {
 	N_IDENT,
 	N_NUM,
@@ -210,12 +417,99 @@ enum {
 	TY_STRUCT,
 }
 
+// x86 registers
+enum {
+	R_RAX,
+	R_RCX,
+	R_RDX,
+	R_RBX,
+	R_RSP,
+	R_RBP,
+	R_RSI,
+	R_RDI,
+	R_R8,
+	R_R9,
+	R_R10,
+	R_R11,
+	R_R12,
+	R_R13,
+	R_R14,
+	R_R15,
+}
+
+// x86 condition codes
+enum {
+	CC_O,
+	CC_NO,
+	CC_B,
+	CC_AE,
+	CC_E,
+	CC_NE,
+	CC_BE,
+	CC_A,
+	CC_S,
+	CC_NS,
+	CC_P,
+	CC_NP,
+	CC_L,
+	CC_GE,
+	CC_LE,
+	CC_G,
+}
+
+// x86 alu operations
+enum {
+	ALU_ADD,
+	ALU_OR,
+	ALU_ADC,
+	ALU_SBB,
+	ALU_AND,
+	ALU_SUB,
+	ALU_XOR,
+	ALU_CMP,
+}
+
+// IR instructions and block terminators
+enum {
+	IR_NOP,
+	IR_IMM,
+	IR_LEA,
+	IR_ADDR,
+	IR_STR,
+	IR_LOAD,
+	IR_STORE,
+	IR_MOV,
+	IR_UN,
+	IR_BIN,
+	IR_BINI,
+	IR_CALL,
+	IR_ARG,
+	IR_JMP,
+	IR_BR,
+	IR_RET,
+}
+
+// What a fixup patches
+enum {
+	FIX_REL32,
+	FIX_JMP,
+	FIX_JCC,
+}
+
+// Pending push held back by the peephole
+enum {
+	PEEP_NONE,
+	PEEP_REG,
+	PEEP_IMM,
+	PEEP_LEA,
+}
+
 exit(n: int): void {
 	syscall(60, n, 0, 0, 0, 0, 0);
 }
 
-_start(): void {
-	main();
+_start(argv0: *byte): void {
+	main(&argv0);
 	exit(0);
 }
 
@@ -231,6 +525,10 @@ mmap(addr: int, len: int, prot: int, flags: int, fd: int, off: int): int {
 	return syscall(9, addr, len, prot, flags, fd, off);
 }
 
+clock_gettime(id: int, ts: *timespec): int {
+	return syscall(228, id, ts: int, 0, 0, 0, 0);
+}
+
 alloc(c: *compiler, size: int): *byte {
 	var page: *page;
 	var mret: int;
@@ -248,6 +546,8 @@ alloc(c: *compiler, size: int): *byte {
 		if (mret == -1) {
 			die(c, "out of memory");
 		}
+		c.stat_pages = c.stat_pages + 1;
+		c.stat_mapped = c.stat_mapped + size;
 		ret = mret: *byte;
 		return ret;
 	}
@@ -268,6 +568,8 @@ alloc(c: *compiler, size: int): *byte {
 	if (mret == -1) {
 		die(c, "out of memory");
 	}
+	c.stat_pages = c.stat_pages + 1;
+	c.stat_mapped = c.stat_mapped + psize;
 
 	page = mret: *page;
 	page.ptr = (&page[1]): *byte;
@@ -280,27 +582,69 @@ alloc(c: *compiler, size: int): *byte {
 	return ret;
 }
 
-getchar(): int {
-	var b: byte;
+open_file(c: *compiler, f: *file, fd: int): void {
+	f.fd = fd;
+	f.cap = 64 * 1024;
+	f.buf = alloc(c, f.cap);
+	f.pos = 0;
+	f.len = 0;
+}
+
+fgetc(f: *file): int {
 	var ret: int;
-	ret = read(0, &b, 1);
-	if (ret < 0) {
-		exit(3);
-	}
-	if (ret == 0) {
-		return -1;
+
+	if (f.pos == f.len) {
+		ret = read(f.fd, f.buf, f.cap);
+		if (ret < 0) {
+			exit(3);
+		}
+		if (ret == 0) {
+			return -1;
+		}
+		f.pos = 0;
+		f.len = ret;
 	}
-	return b: int;
+
+	ret = f.buf[f.pos]: int;
+	f.pos = f.pos + 1;
+
+	return ret;
 }
 
-putchar(ch: int): void {
-	var b: byte;
+fflush(f: *file): void {
 	var ret: int;
-	b = ch: byte;
-	ret = write(1, &b, 1);
-	if (ret != 1) {
-		exit(3);
+	var off: int;
+
+	off = 0;
+	loop {
+		if (off == f.len) {
+			break;
+		}
+		ret = write(f.fd, &f.buf[off], f.len - off);
+		if (ret <= 0) {
+			exit(3);
+		}
+		off = off + ret;
+	}
+
+	f.len = 0;
+}
+
+fputc(f: *file, ch: int): void {
+	if (f.len == f.cap) {
+		fflush(f);
 	}
+
+	f.buf[f.len] = ch: byte;
+	f.len = f.len + 1;
+}
+
+getchar(c: *compiler): int {
+	return fgetc(&c.in);
+}
+
+putchar(c: *compiler, ch: int): void {
+	fputc(&c.out, ch);
 }
 
 strlen(s: *byte): int {
@@ -314,6 +658,32 @@ strlen(s: *byte): int {
 	}
 }
 
+// Copy n bytes a word at a time
+memcpy(dest: *byte, src: *byte, n: int): void {
+	var d: *int;
+	var s: *int;
+	var i: int;
+
+	d = dest: *int;
+	s = src: *int;
+	i = 0;
+	loop {
+		if (n - i < 8) {
+			break;
+		}
+		d[i >> 3] = s[i >> 3];
+		i = i + 8;
+	}
+
+	loop {
+		if (i == n) {
+			break;
+		}
+		dest[i] = src[i];
+		i = i + 1;
+	}
+}
+
 strcmp(a: *byte, b: *byte): int {
 	var i: int;
 
@@ -428,31 +798,197 @@ die(c: *compiler, msg: *byte): void {
 	fdput(2, "die: ");
 	fdput(2, msg);
 	fdput(2, "\n");
+	fflush(&c.out);
 	exit(1);
 }
 
 comp_setup(c: *compiler): void {
 	c.page = 0:*page;
 
-	c.nc = getchar();
+	c.opt_stats = 0;
+	c.stat_wall = 0;
+	c.stat_tsc = 0;
+	c.stat_lex = 0;
+	c.stat_tokens = 0;
+	c.stat_nodes = 0;
+	c.stat_labels = 0;
+	c.stat_fixups = 0;
+	c.stat_pages = 0;
+	c.stat_mapped = 0;
+
+	open_file(c, &c.in, 0);
+	open_file(c, &c.out, 1);
+
+	c.nc = -1;
 	c.lineno = 1;
 	c.colno = 1;
 	c.tlen = 0;
 	c.tmax = 4096;
 	c.token = alloc(c, c.tmax);
 	c.tt = 0;
+	c.kw = K_NONE;
+	c.lex = 0:*lex_state;
+	lex_setup(c);
+
+	c.istr_table = 0:**istr;
+	c.istr_cap = 0;
+	c.istr_count = 0;
+	istr_grow(c);
 
 	c.at = 0;
 	c.text = 0:*chunk;
 	c.text_end = 0:*chunk;
+	c.labels = 0:*label;
+	c.fixups = 0:*fixup;
+	c.fixups_end = 0:*fixup;
+	c.nbranch = 0;
+
+	c.rodata = 0:*istr;
+	c.rodata_end = 0:*istr;
+	c.rodata_size = 0;
 
 	c.decls = 0:*decl;
+	c.decl_table = 0:**decl;
+	c.decl_cap = 0;
+	c.decl_count = 0;
+	decl_grow(c);
+
+	c.peep = PEEP_NONE;
+
+	c.opt_regs = 0;
+	c.opt_peep = 0;
+	c.opt_ir = 0;
+	c.opt_fold = 0;
+	c.opt_branch = 0;
+	c.opt_inline = 0;
+	c.opt_regcall = 0;
+	c.opt_loop = 0;
+	c.opt_dfa = 0;
+}
+
+// Give each character in s the class k
+lex_class(c: *compiler, s: *byte, k: int): void {
+	var i: int;
 
-	feed(c);
+	i = 0;
+	loop {
+		if (!s[i]) {
+			break;
+		}
+		c.cclass[s[i]:int] = k:byte;
+		i = i + 1;
+	}
+}
+
+// A character that starts the token tt
+lex_punct(c: *compiler, ch: int, tt: int): void {
+	c.cclass[ch] = CL_PUNCT:byte;
+	c.ctok[ch] = tt:byte;
+}
+
+// Hash a keyword by its length and first and last characters. The
+// multiplier was picked so that no two keywords collide.
+kw_hash(s: *byte, len: int): int {
+	return ((s[0]:int) + 25 * (s[len - 1]:int) + len) & 31;
+}
+
+kw_add(c: *compiler, s: *byte, id: int): void {
+	var h: int;
+
+	h = kw_hash(s, strlen(s));
+	if (c.kw_name[h]) {
+		die(c, "keyword hash collision");
+	}
+
+	c.kw_name[h] = s;
+	c.kw_id[h] = id;
+}
+
+// Build the character class and keyword tables
+lex_setup(c: *compiler): void {
+	var p: *byte;
+	var i: int;
+
+	// End of input is -1, so the class table starts one entry early
+	p = alloc(c, 257);
+	c.cclass = &p[1];
+	c.ctok = alloc(c, 256);
+
+	i = -1;
+	loop {
+		if (i == 256) {
+			break;
+		}
+		c.cclass[i] = CL_NONE:byte;
+		if (i >= 0) {
+			c.ctok[i] = 0:byte;
+		}
+		i = i + 1;
+	}
+
+	lex_class(c, " \t\r\n", CL_SPACE);
+	lex_class(c, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_", CL_ALPHA);
+	lex_class(c, "0123456789", CL_DIGIT);
+
+	lex_punct(c, '(', T_LPAR);
+	lex_punct(c, ')', T_RPAR);
+	lex_punct(c, '{', T_LBRA);
+	lex_punct(c, '}', T_RBRA);
+	lex_punct(c, ',', T_COMMA);
+	lex_punct(c, ';', T_SEMI);
+	lex_punct(c, ':', T_COLON);
+	lex_punct(c, '*', T_STAR);
+	lex_punct(c, '.', T_DOT);
+	lex_punct(c, '=', T_ASSIGN);
+	lex_punct(c, '&', T_AMP);
+	lex_punct(c, '~', T_NOT);
+	lex_punct(c, '|', T_OR);
+	lex_punct(c, '^', T_XOR);
+	lex_punct(c, '!', T_BANG);
+	lex_punct(c, '<', T_LT);
+	lex_punct(c, '>', T_GT);
+	lex_punct(c, '[', T_LSQ);
+	lex_punct(c, ']', T_RSQ);
+	lex_punct(c, '+', T_ADD);
+	lex_punct(c, '-', T_SUB);
+	lex_punct(c, '%', T_MOD);
+
+	c.kw_name = alloc(c, 32 * sizeof(p)):**byte;
+	c.kw_id = alloc(c, 32 * sizeof(i)):*int;
+
+	i = 0;
+	loop {
+		if (i == 32) {
+			break;
+		}
+		c.kw_name[i] = 0:*byte;
+		c.kw_id[i] = K_NONE;
+		i = i + 1;
+	}
+
+	kw_add(c, "if", K_IF);
+	kw_add(c, "else", K_ELSE);
+	kw_add(c, "loop", K_LOOP);
+	kw_add(c, "break", K_BREAK);
+	kw_add(c, "continue", K_CONTINUE);
+	kw_add(c, "return", K_RETURN);
+	kw_add(c, "var", K_VAR);
+	kw_add(c, "goto", K_GOTO);
+	kw_add(c, "enum", K_ENUM);
+	kw_add(c, "struct", K_STRUCT);
+	kw_add(c, "func", K_FUNC);
+	kw_add(c, "sizeof", K_SIZEOF);
 }
 
 feedc(c: *compiler): void {
-	c.nc = getchar();
+	// Take the next byte straight from the buffer unless it needs a refill
+	if (c.in.pos != c.in.len) {
+		c.nc = c.in.buf[c.in.pos]:int;
+		c.in.pos = c.in.pos + 1;
+	} else {
+		c.nc = getchar(c);
+	}
+
 	if (c.nc == '\n') {
 		c.lineno = c.lineno + 1;
 		c.colno = 0;
@@ -470,20 +1006,44 @@ tappend(c: *compiler): void {
 	feedc(c);
 }
 
+// Read the next token, counting the time spent lexing
 feed(c: *compiler): void {
+	var start: int;
+
+	if (!c.opt_stats) {
+		if (c.lex) {
+			feed_dfa(c);
+		} else {
+			feed_token(c);
+		}
+		return;
+	}
+
+	start = rdtsc();
+	if (c.lex) {
+		feed_dfa(c);
+	} else {
+		feed_token(c);
+	}
+	c.stat_lex = c.stat_lex + rdtsc() - start;
+	c.stat_tokens = c.stat_tokens + 1;
+}
+
+feed_token(c: *compiler): void {
+	var k: int;
+
 	c.tlen = 0;
 	c.token[0] = 0:byte;
+	c.kw = K_NONE;
 
 	loop {
+		k = c.cclass[c.nc]:int;
 		if (c.nc == -1) {
 			// Reached the end of input
 			c.tt = T_EOF;
 			return;
-		} else if (c.nc == ' ' || c.nc == '\t' || c.nc == '\r') {
-			// Whitespace
-			feedc(c);
-		} else if (c.nc == '\n') {
-			// Line end
+		} else if (k == CL_SPACE) {
+			// Whitespace and line ends
 			feedc(c);
 		} else if (c.nc == '/') {
 			// Comment
@@ -508,7 +1068,7 @@ feed(c: *compiler): void {
 	}
 
 	// Identifier
-	if ((c.nc >= 'a' && c.nc <= 'z') || (c.nc >= 'A' && c.nc <= 'Z') || c.nc == '_') {
+	if (k == CL_ALPHA) {
 		feed_ident(c);
 		return;
 	}
@@ -526,137 +1086,86 @@ feed(c: *compiler): void {
 	}
 
 	// Number
-	if (c.nc >= '0' && c.nc <= '9') {
+	if (k == CL_DIGIT) {
 		feed_num(c);
 		return;
 	}
 
-	// Single character tokens
-	if (c.nc == '(') {
-		c.tt = T_LPAR;
-		feedc(c);
-	} else if (c.nc == ')') {
-		c.tt = T_RPAR;
-		feedc(c);
-	} else if (c.nc == '{') {
-		c.tt = T_LBRA;
-		feedc(c);
-	} else if (c.nc == '}') {
-		c.tt = T_RBRA;
-		feedc(c);
-	} else if (c.nc == ',') {
-		c.tt = T_COMMA;
-		feedc(c);
-	} else if (c.nc == ';') {
-		c.tt = T_SEMI;
-		feedc(c);
-	} else if (c.nc == ':') {
-		c.tt = T_COLON;
-		feedc(c);
-	} else if (c.nc == '*') {
-		c.tt = T_STAR;
-		feedc(c);
-	} else if (c.nc == '.') {
-		c.tt = T_DOT;
-		feedc(c);
-	} else if (c.nc == '=') {
-		c.tt = T_ASSIGN;
-		feedc(c);
-		if (c.nc == '=') {
+	if (k != CL_PUNCT) {
+		die(c, "invalid char");
+	}
+
+	// Operators, some of which have a second character
+	c.tt = c.ctok[c.nc]:int;
+	feedc(c);
+
+	if (c.nc == '=') {
+		if (c.tt == T_ASSIGN) {
 			c.tt = T_EQ;
-			feedc(c);
-		}
-	} else if (c.nc == '&') {
-		c.tt = T_AMP;
-		feedc(c);
-		if (c.nc == '&') {
-			c.tt = T_BAND;
-			feedc(c);
-		}
-	} else if (c.nc == '~') {
-		c.tt = T_NOT;
-		feedc(c);
-	} else if (c.nc == '|') {
-		c.tt = T_OR;
-		feedc(c);
-		if (c.nc == '|') {
-			c.tt = T_BOR;
-			feedc(c);
-		}
-	} else if (c.nc == '^') {
-		c.tt = T_XOR;
-		feedc(c);
-	} else if (c.nc == '!') {
-		c.tt = T_BANG;
-		feedc(c);
-		if (c.nc == '=') {
+		} else if (c.tt == T_BANG) {
 			c.tt = T_NE;
-			feedc(c);
-		}
-	} else if (c.nc == '<') {
-		c.tt = T_LT;
-		feedc(c);
-		if (c.nc == '<') {
-			c.tt = T_LSH;
-			feedc(c);
-		} else if (c.nc == '=') {
+		} else if (c.tt == T_LT) {
 			c.tt = T_LE;
-			feedc(c);
-		}
-	} else if (c.nc == '>') {
-		c.tt = T_GT;
-		feedc(c);
-		if (c.nc == '>') {
-			c.tt = T_RSH;
-			feedc(c);
-		} else if (c.nc == '=') {
+		} else if (c.tt == T_GT) {
 			c.tt = T_GE;
-			feedc(c);
+		} else {
+			return;
 		}
-	} else if (c.nc == '[') {
-		c.tt = T_LSQ;
 		feedc(c);
-	} else if (c.nc == ']') {
-		c.tt = T_RSQ;
+	} else if (c.nc == '&' && c.tt == T_AMP) {
+		c.tt = T_BAND;
 		feedc(c);
-	} else if (c.nc == '+') {
-		c.tt = T_ADD;
+	} else if (c.nc == '|' && c.tt == T_OR) {
+		c.tt = T_BOR;
 		feedc(c);
-	} else if (c.nc == '-') {
-		c.tt = T_SUB;
+	} else if (c.nc == '<' && c.tt == T_LT) {
+		c.tt = T_LSH;
 		feedc(c);
-	} else if (c.nc == '%') {
-		c.tt = T_MOD;
+	} else if (c.nc == '>' && c.tt == T_GT) {
+		c.tt = T_RSH;
 		feedc(c);
-	} else {
-		die(c, "invalid char");
 	}
 }
 
 feed_ident(c: *compiler): void {
+	var k: int;
+	var h: int;
+
 	c.tt = T_IDENT;
 	loop {
-		if (!((c.nc >= 'a' && c.nc <= 'z') ||
-				(c.nc >= 'A' && c.nc <= 'Z') ||
-				(c.nc >= '0' && c.nc <= '9') ||
-				c.nc == '_')) {
+		k = c.cclass[c.nc]:int;
+		if (k != CL_ALPHA && k != CL_DIGIT) {
 			break;
 		}
-		tappend(c);
+
+		c.token[c.tlen] = c.nc:byte;
+		c.tlen = c.tlen + 1;
+		if (c.tlen == c.tmax) {
+			die(c, "identifier too long");
+		}
+
+		feedc(c);
+	}
+	c.token[c.tlen] = 0:byte;
+
+	// Keywords are still identifiers, the parser decides where they count
+	h = kw_hash(c.token, c.tlen);
+	if (c.kw_name[h] && !strcmp(c.kw_name[h], c.token)) {
+		c.kw = c.kw_id[h];
 	}
 }
 
-hexdig(c: *compiler): int {
-	if (c.nc >= '0' && c.nc <= '9') {
-		return c.nc - '0';
+hexdig(c: *compiler, ch: int): int {
+	if (ch >= '0' && ch <= '9') {
+		return ch - '0';
 	}
 
-	if (c.nc >= 'A' && c.nc <= 'F') {
-		return (c.nc - 'F') + 10;
+	if (ch >= 'A' && ch <= 'F') {
+		return (ch - 'F') + 10;
 	}
 
-	if (c.nc >= 'a' && c.nc <= 'f') {
-		return (c.nc - 'a') + 10;
+	if (ch >= 'a' && ch <= 'f') {
+		return (ch - 'a') + 10;
 	}
 
 	die(c, "invalid hex digit");
@@ -676,11 +1185,11 @@ feed_escape(c: *compiler): void {
 	} else if (c.nc == 'n') {
 		c.nc = '\n';
 	} else if (c.nc == 'x') {
-		c.nc = getchar();
-		hex = hexdig(c) * 16;
+		c.nc = getchar(c);
+		hex = hexdig(c, c.nc) * 16;
 
-		c.nc = getchar();
-		hex = hex + hexdig(c);
+		c.nc = getchar(c);
+		hex = hex + hexdig(c, c.nc);
 
 		c.nc = hex;
 	} else if (c.nc != '\\' && c.nc != '\'' && c.nc != '"') {
@@ -779,80 +1288,1556 @@ feed_num(c: *compiler): void {
 	}
 }
 
-mknode(c: *compiler, kind: int, a: *node, b: *node): *node {
-	var ret: *node;
-	ret = alloc(c, sizeof(*ret)):*node;
-	ret.kind = kind;
-	ret.a = a;
-	ret.b = b;
-	ret.lineno = c.lineno;
-	ret.colno = c.colno;
-	ret.n = 0;
-	ret.s = 0:*byte;
-	ret.t = 0:*type;
-	return ret;
-}
+// Prime the lexer picked by the options with the first token
+lex_start(c: *compiler): void {
+	if (c.opt_dfa) {
+		lex_dfa_setup(c);
+	} else {
+		c.nc = getchar(c);
+	}
 
-mknode0(c: *compiler, kind: int): *node {
-	return mknode(c, kind, 0:*node, 0:*node);
+	feed(c);
 }
 
-mknode1(c: *compiler, kind: int, a: *node): *node {
-	return mknode(c, kind, a, 0:*node);
+// Translate a tag of the generated lexer into a token and keyword
+lex_tag(c: *compiler, tag: int, tt: int, kw: int): void {
+	c.lex_tt[tag] = tt:byte;
+	c.lex_kw[tag] = kw:byte;
 }
 
-// Copy the current token
-intern(c: *compiler): *byte {
-	var ret: *byte;
+lex_dfa_setup(c: *compiler): void {
+	var l: *lex_state;
 	var i: int;
 
-	ret = alloc(c, c.tlen + 1);
+	l = alloc(c, sizeof(*l)):*lex_state;
+	l.c = c;
+	l.f = &c.in;
+	l.start = 0;
+	l.mark = 0;
+	l.tag = L_invalid;
+	l.tab = 0:*int;
+	l.ntab = 0;
+	c.lex = l;
+	lexload(l);
+
+	c.lex_tt = alloc(c, 256);
+	c.lex_kw = alloc(c, 256);
 
 	i = 0;
 	loop {
-		if (i == c.tlen) {
-			ret[i] = 0:byte;
-			return ret;
+		if (i == 256) {
+			break;
 		}
-
-		ret[i] = c.token[i];
-
+		c.lex_tt[i] = T_EOF:byte;
+		c.lex_kw[i] = K_NONE:byte;
 		i = i + 1;
 	}
-}
-
-// ident := IDENT
-parse_ident(c: *compiler): *node {
-	var n: *node;
-
-	if (c.tt != T_IDENT) {
-		return 0:*node;
-	}
-
-	n = mknode0(c, N_IDENT);
-	n.s = intern(c);
-	feed(c);
 
-	return n;
-}
-
-parse_hex(c: *compiler): *node {
-	var n: *node;
+	// Keywords and the type names are still identifiers
+	lex_tag(c, L_RETURN, T_IDENT, K_RETURN);
+	lex_tag(c, L_BREAK, T_IDENT, K_BREAK);
+	lex_tag(c, L_SIZEOF, T_IDENT, K_SIZEOF);
+	lex_tag(c, L_IF, T_IDENT, K_IF);
+	lex_tag(c, L_ELSE, T_IDENT, K_ELSE);
+	lex_tag(c, L_LOOP, T_IDENT, K_LOOP);
+	lex_tag(c, L_CONTINUE, T_IDENT, K_CONTINUE);
+	lex_tag(c, L_GOTO, T_IDENT, K_GOTO);
+	lex_tag(c, L_VAR, T_IDENT, K_VAR);
+	lex_tag(c, L_ENUM, T_IDENT, K_ENUM);
+	lex_tag(c, L_STRUCT, T_IDENT, K_STRUCT);
+	lex_tag(c, L_FUNC, T_IDENT, K_FUNC);
+	lex_tag(c, L_BYTE, T_IDENT, K_NONE);
+	lex_tag(c, L_INT, T_IDENT, K_NONE);
+	lex_tag(c, L_VOID, T_IDENT, K_NONE);
+	lex_tag(c, L_IDENT, T_IDENT, K_NONE);
+
+	lex_tag(c, L_STR, T_STR, K_NONE);
+	lex_tag(c, L_CHR, T_CHAR, K_NONE);
+	lex_tag(c, L_DEC, T_NUM, K_NONE);
+	lex_tag(c, L_HEX, T_HEX, K_NONE);
+
+	lex_tag(c, L_LPAR, T_LPAR, K_NONE);
+	lex_tag(c, L_RPAR, T_RPAR, K_NONE);
+	lex_tag(c, L_LBRA, T_LBRA, K_NONE);
+	lex_tag(c, L_RBRA, T_RBRA, K_NONE);
+	lex_tag(c, L_COMMA, T_COMMA, K_NONE);
+	lex_tag(c, L_SEMI, T_SEMI, K_NONE);
+	lex_tag(c, L_COLON, T_COLON, K_NONE);
+	lex_tag(c, L_STAR, T_STAR, K_NONE);
+	lex_tag(c, L_EQUAL, T_ASSIGN, K_NONE);
+	lex_tag(c, L_EQ, T_EQ, K_NONE);
+	lex_tag(c, L_AND, T_AMP, K_NONE);
+	lex_tag(c, L_ANDTHEN, T_BAND, K_NONE);
+	lex_tag(c, L_OR, T_OR, K_NONE);
+	lex_tag(c, L_ORELSE, T_BOR, K_NONE);
+	lex_tag(c, L_XOR, T_XOR, K_NONE);
+	lex_tag(c, L_BANG, T_BANG, K_NONE);
+	lex_tag(c, L_NE, T_NE, K_NONE);
+	lex_tag(c, L_LT, T_LT, K_NONE);
+	lex_tag(c, L_LSH, T_LSH, K_NONE);
+	lex_tag(c, L_LE, T_LE, K_NONE);
+	lex_tag(c, L_GT, T_GT, K_NONE);
+	lex_tag(c, L_RSH, T_RSH, K_NONE);
+	lex_tag(c, L_GE, T_GE, K_NONE);
+	lex_tag(c, L_LSQ, T_LSQ, K_NONE);
+	lex_tag(c, L_RSQ, T_RSQ, K_NONE);
+	lex_tag(c, L_PLUS, T_ADD, K_NONE);
+	lex_tag(c, L_MINUS, T_SUB, K_NONE);
+	lex_tag(c, L_MOD, T_MOD, K_NONE);
+	lex_tag(c, L_DOT, T_DOT, K_NONE);
+	lex_tag(c, L_NOT, T_NOT, K_NONE);
+	lex_tag(c, L_DIV, T_DIV, K_NONE);
+}
+
+// Make room for the tables of the generated lexer
+lexsize(l: *lex_state, n: int): void {
+	l.tab = alloc(l.c, n * sizeof(n)):*int;
+	l.ntab = 0;
+}
+
+// Append the numbers encoded in s to the tables. Each is written in base 127
+// digits, low first, with the high bit set on all but the last, which is
+// offset by one.
+lextable(l: *lex_state, s: *byte): void {
 	var x: int;
+	var m: int;
 	var d: int;
 	var i: int;
 
-	x = 0;
 	i = 0;
 	loop {
-		if (i == c.tlen) {
+		if (!s[i]) {
 			break;
 		}
 
-		d = c.token[i]:int;
+		x = 0;
+		m = 1;
+		loop {
+			d = s[i]:int;
+			i = i + 1;
+			if (d < 128) {
+				x = x + (d - 1) * m;
+				break;
+			}
+			x = x + (d - 128) * m;
+			m = m * 127;
+		}
 
-		if (d >= '0' && d <= '9') {
-			d = d - '0';
+		l.tab[l.ntab] = x;
+		l.ntab = l.ntab + 1;
+	}
+}
+
+// Read more input after the buffered text, keeping the token being matched.
+// Returns the number of bytes read.
+lexfill(l: *lex_state): int {
+	var f: *file;
+	var buf: *byte;
+	var ret: int;
+
+	f = l.f;
+
+	if (l.start != 0) {
+		// Move the token to the front of the buffer
+		memcpy(f.buf, &f.buf[l.start], f.len - l.start);
+		f.len = f.len - l.start;
+		f.pos = f.pos - l.start;
+		l.mark = l.mark - l.start;
+		l.start = 0;
+	} else if (f.len == f.cap) {
+		// The token fills the whole buffer
+		buf = alloc(l.c, f.cap * 2);
+		memcpy(buf, f.buf, f.len);
+		f.buf = buf;
+		f.cap = f.cap * 2;
+	}
+
+	ret = read(f.fd, &f.buf[f.len], f.cap - f.len);
+	if (ret < 0) {
+		exit(3);
+	}
+	f.len = f.len + ret;
+
+	return ret;
+}
+
+// Next input character for the DFA, or -1 at the end of input
+lexfeedc(l: *lex_state): int {
+	var f: *file;
+	var ch: int;
+
+	f = l.f;
+	if (f.pos == f.len) {
+		if (lexfill(l) == 0) {
+			return -1;
+		}
+	}
+
+	ch = f.buf[f.pos]:int;
+	f.pos = f.pos + 1;
+
+	return ch;
+}
+
+// The text read so far is a token with the given tag
+lexmark(l: *lex_state, tag: int): void {
+	l.tag = tag;
+	l.mark = l.f.pos;
+}
+
+// Move the position from the first byte of a token to byte i, counting
+// lines and columns the way feedc does
+lex_pos(c: *compiler, s: *byte, i: int): void {
+	var j: int;
+
+	j = 1;
+	loop {
+		if (j > i) {
+			break;
+		}
+
+		if (s[j] == '\n':byte) {
+			c.lineno = c.lineno + 1;
+			c.colno = 1;
+		} else {
+			c.colno = c.colno + 1;
+		}
+
+		j = j + 1;
+	}
+}
+
+// Move the position from the last byte of a token onto the byte after it
+lex_end(c: *compiler, l: *lex_state): void {
+	var ch: int;
+
+	l.start = l.f.pos;
+	if (l.f.pos != l.f.len) {
+		ch = l.f.buf[l.f.pos]:int;
+	} else {
+		ch = lexfeedc(l);
+		if (ch != -1) {
+			l.f.pos = l.f.pos - 1;
+		}
+	}
+
+	if (ch == '\n') {
+		c.lineno = c.lineno + 1;
+		c.colno = 1;
+	} else {
+		c.colno = c.colno + 1;
+	}
+}
+
+// Copy the text of a token. The hand lexer drops the x of a hex number but
+// keeps the 0, so skip leaves out the byte after the first.
+lex_text(c: *compiler, s: *byte, n: int, skip: int): void {
+	if (n - skip >= c.tmax) {
+		lex_pos(c, s, c.tmax - 1 + skip);
+		die(c, "identifier too long");
+	}
+
+	c.token[0] = s[0];
+	memcpy(&c.token[1], &s[1 + skip], n - 1 - skip);
+	c.tlen = n - skip;
+	c.token[c.tlen] = 0:byte;
+}
+
+// Byte i of the n read from the start of a literal, or -1 past them
+lex_byte(s: *byte, n: int, i: int): int {
+	if (i >= n) {
+		return -1;
+	}
+	return s[i]:int;
+}
+
+// Step to the next byte of a literal, moving the position like feedc
+lex_quotec(c: *compiler, s: *byte, n: int, i: *int): int {
+	var ch: int;
+
+	*i = *i + 1;
+	ch = lex_byte(s, n, *i);
+
+	if (ch == '\n') {
+		c.lineno = c.lineno + 1;
+		c.colno = 0;
+	}
+	c.colno = c.colno + 1;
+
+	return ch;
+}
+
+// Decode the escape after the backslash at byte i. As in feed_escape, the
+// digits of a hex escape are read without moving the position.
+lex_escape(c: *compiler, s: *byte, n: int, i: *int): int {
+	var ch: int;
+
+	ch = lex_quotec(c, s, n, i);
+	if (ch == 't') {
+		ch = '\t';
+	} else if (ch == 'r') {
+		ch = '\r';
+	} else if (ch == 'n') {
+		ch = '\n';
+	} else if (ch == 'x') {
+		ch = hexdig(c, lex_byte(s, n, *i + 1)) * 16;
+		ch = ch + hexdig(c, lex_byte(s, n, *i + 2));
+		*i = *i + 2;
+	} else if (ch != '\\' && ch != '\'' && ch != '"') {
+		die(c, "invalid escape");
+	}
+
+	return ch;
+}
+
+// Append a byte of a literal to the token
+lex_append(c: *compiler, ch: int): void {
+	c.token[c.tlen] = ch:byte;
+	c.tlen = c.tlen + 1;
+	if (c.tlen == c.tmax) {
+		die(c, "identifier too long");
+	}
+	c.token[c.tlen] = 0:byte;
+}
+
+// Decode a string or character literal from the n bytes read from its
+// opening quote. The bytes are walked as feed_str and feed_char read them,
+// so errors are reported at the same place. Leaves the position on the
+// closing quote.
+lex_quoted(c: *compiler, s: *byte, n: int): void {
+	var ch: int;
+	var i: int;
+
+	i = 0;
+	ch = lex_quotec(c, s, n, &i);
+
+	if (s[0] == '\'':byte) {
+		if (ch == 0 || ch == -1 || ch == '\'' || ch == '\n') {
+			die(c, "invalid char");
+		}
+
+		if (ch == '\\') {
+			ch = lex_escape(c, s, n, &i);
+		}
+
+		lex_append(c, ch);
+
+		if (lex_quotec(c, s, n, &i) != '\'') {
+			die(c, "expected '");
+		}
+
+		return;
+	}
+
+	loop {
+		if (ch == '"') {
+			break;
+		}
+
+		if (ch == -1 || ch == 0 || ch == '\n') {
+			die(c, "invalid char in string");
+		}
+
+		if (ch == '\\') {
+			ch = lex_escape(c, s, n, &i);
+		}
+
+		lex_append(c, ch);
+		ch = lex_quotec(c, s, n, &i);
+	}
+}
+
+// Read the next token with the lexer generated from cc3.l. The position is
+// kept on the byte after the last token, as the hand lexer keeps it on its
+// lookahead.
+feed_dfa(c: *compiler): void {
+	var l: *lex_state;
+	var tag: int;
+	var s: *byte;
+	var n: int;
+
+	l = c.lex;
+	c.tlen = 0;
+	c.token[0] = 0:byte;
+
+	loop {
+		l.start = l.f.pos;
+		lexstep(l);
+		l.f.pos = l.mark;
+
+		tag = l.tag;
+		s = &l.f.buf[l.start];
+		n = l.mark - l.start;
+
+		if (tag == L_WHITESPACE) {
+			lex_pos(c, s, n - 1);
+			lex_end(c, l);
+		} else if (tag == L_COMMENT) {
+			c.colno = c.colno + n - 1;
+			lex_end(c, l);
+		} else if (tag == L_invalid) {
+			// Nothing matched. A quote that is never closed was read to the
+			// end of input, so walk it for the error the hand lexer gives.
+			if (s[0] == '"':byte || s[0] == '\'':byte) {
+				lex_quoted(c, s, l.f.len - l.start);
+			}
+
+			if (lexfeedc(l) != -1) {
+				die(c, "invalid char");
+			}
+
+			c.tt = T_EOF;
+			c.kw = K_NONE;
+			return;
+		} else {
+			break;
+		}
+	}
+
+	c.tt = c.lex_tt[tag]:int;
+	c.kw = c.lex_kw[tag]:int;
+
+	if (tag == L_STR || tag == L_CHR) {
+		lex_quoted(c, s, n);
+	} else {
+		if (tag == L_HEX) {
+			lex_text(c, s, n, 1);
+		} else if (c.tt == T_IDENT || c.tt == T_NUM) {
+			lex_text(c, s, n, 0);
+		}
+
+		// Only whitespace and literals hold line ends
+		c.colno = c.colno + n - 1;
+	}
+
+	lex_end(c, l);
+}
+
+// The lexer below is generated from cc3.l by buildlex.sh, do not edit it by
+// hand.
+// BEGIN lexstep
+enum {
+	L_invalid,
+	L_eof,
+	L_COMMENT,
+	L_WHITESPACE,
+	L_RETURN,
+	L_BREAK,
+	L_SIZEOF,
+	L_IF,
+	L_ELSE,
+	L_LOOP,
+	L_CONTINUE,
+	L_GOTO,
+	L_VAR,
+	L_ENUM,
+	L_STRUCT,
+	L_FUNC,
+	L_BYTE,
+	L_INT,
+	L_VOID,
+	L_IDENT,
+	L_STR,
+	L_CHR,
+	L_DEC,
+	L_HEX,
+	L_LPAR,
+	L_RPAR,
+	L_LBRA,
+	L_RBRA,
+	L_COMMA,
+	L_SEMI,
+	L_COLON,
+	L_STAR,
+	L_EQUAL,
+	L_EQ,
+	L_AND,
+	L_ANDTHEN,
+	L_OR,
+	L_ORELSE,
+	L_XOR,
+	L_BANG,
+	L_NE,
+	L_LT,
+	L_LSH,
+	L_LE,
+	L_GT,
+	L_RSH,
+	L_GE,
+	L_LSQ,
+	L_RSQ,
+	L_PLUS,
+	L_MINUS,
+	L_MOD,
+	L_DOT,
+	L_NOT,
+	L_DIV,
+}
+
+lexload(l: *lex_state): void {
+}
+
+lexstep(l: *lex_state): void {
+	var ch: int;
+	lexmark(l, L_invalid);
+:_0;
+	ch = lexfeedc(l);
+	if (ch >= 9 && ch <= 10) { goto _1; }
+	if (ch == 13) { goto _1; }
+	if (ch == 32) { goto _1; }
+	if (ch == 33) { goto _2; }
+	if (ch == 34) { goto _4; }
+	if (ch == 37) { goto _7; }
+	if (ch == 38) { goto _8; }
+	if (ch == 39) { goto _10; }
+	if (ch == 40) { goto _13; }
+	if (ch == 41) { goto _14; }
+	if (ch == 42) { goto _15; }
+	if (ch == 43) { goto _16; }
+	if (ch == 44) { goto _17; }
+	if (ch == 45) { goto _18; }
+	if (ch == 46) { goto _19; }
+	if (ch == 47) { goto _20; }
+	if (ch == 48) { goto _22; }
+	if (ch >= 49 && ch <= 57) { goto _23; }
+	if (ch == 58) { goto _25; }
+	if (ch == 59) { goto _26; }
+	if (ch == 60) { goto _27; }
+	if (ch == 61) { goto _30; }
+	if (ch == 62) { goto _32; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 91) { goto _36; }
+	if (ch == 93) { goto _37; }
+	if (ch == 94) { goto _38; }
+	if (ch == 95) { goto _35; }
+	if (ch == 97) { goto _35; }
+	if (ch == 98) { goto _39; }
+	if (ch == 99) { goto _47; }
+	if (ch == 100) { goto _35; }
+	if (ch == 101) { goto _55; }
+	if (ch == 102) { goto _62; }
+	if (ch == 103) { goto _66; }
+	if (ch == 104) { goto _35; }
+	if (ch == 105) { goto _70; }
+	if (ch >= 106 && ch <= 107) { goto _35; }
+	if (ch == 108) { goto _74; }
+	if (ch >= 109 && ch <= 113) { goto _35; }
+	if (ch == 114) { goto _78; }
+	if (ch == 115) { goto _84; }
+	if (ch >= 116 && ch <= 117) { goto _35; }
+	if (ch == 118) { goto _95; }
+	if (ch >= 119 && ch <= 122) { goto _35; }
+	if (ch == 123) { goto _101; }
+	if (ch == 124) { goto _102; }
+	if (ch == 125) { goto _104; }
+	if (ch == 126) { goto _105; }
+	return;
+:_1;
+	lexmark(l, L_WHITESPACE);
+	ch = lexfeedc(l);
+	if (ch >= 9 && ch <= 10) { goto _1; }
+	if (ch == 13) { goto _1; }
+	if (ch == 32) { goto _1; }
+	return;
+:_2;
+	lexmark(l, L_BANG);
+	ch = lexfeedc(l);
+	if (ch == 61) { goto _3; }
+	return;
+:_3;
+	lexmark(l, L_NE);
+	ch = lexfeedc(l);
+	return;
+:_4;
+	ch = lexfeedc(l);
+	if (ch >= 0 && ch <= 33) { goto _4; }
+	if (ch == 34) { goto _5; }
+	if (ch >= 35 && ch <= 91) { goto _4; }
+	if (ch == 92) { goto _6; }
+	if (ch >= 93 && ch <= 255) { goto _4; }
+	return;
+:_5;
+	lexmark(l, L_STR);
+	ch = lexfeedc(l);
+	return;
+:_6;
+	ch = lexfeedc(l);
+	if (ch >= 0 && ch <= 255) { goto _4; }
+	return;
+:_7;
+	lexmark(l, L_MOD);
+	ch = lexfeedc(l);
+	return;
+:_8;
+	lexmark(l, L_AND);
+	ch = lexfeedc(l);
+	if (ch == 38) { goto _9; }
+	return;
+:_9;
+	lexmark(l, L_ANDTHEN);
+	ch = lexfeedc(l);
+	return;
+:_10;
+	ch = lexfeedc(l);
+	if (ch >= 0 && ch <= 38) { goto _10; }
+	if (ch == 39) { goto _11; }
+	if (ch >= 40 && ch <= 91) { goto _10; }
+	if (ch == 92) { goto _12; }
+	if (ch >= 93 && ch <= 255) { goto _10; }
+	return;
+:_11;
+	lexmark(l, L_CHR);
+	ch = lexfeedc(l);
+	return;
+:_12;
+	ch = lexfeedc(l);
+	if (ch >= 0 && ch <= 255) { goto _10; }
+	return;
+:_13;
+	lexmark(l, L_LPAR);
+	ch = lexfeedc(l);
+	return;
+:_14;
+	lexmark(l, L_RPAR);
+	ch = lexfeedc(l);
+	return;
+:_15;
+	lexmark(l, L_STAR);
+	ch = lexfeedc(l);
+	return;
+:_16;
+	lexmark(l, L_PLUS);
+	ch = lexfeedc(l);
+	return;
+:_17;
+	lexmark(l, L_COMMA);
+	ch = lexfeedc(l);
+	return;
+:_18;
+	lexmark(l, L_MINUS);
+	ch = lexfeedc(l);
+	return;
+:_19;
+	lexmark(l, L_DOT);
+	ch = lexfeedc(l);
+	return;
+:_20;
+	lexmark(l, L_DIV);
+	ch = lexfeedc(l);
+	if (ch == 47) { goto _21; }
+	return;
+:_21;
+	lexmark(l, L_COMMENT);
+	ch = lexfeedc(l);
+	if (ch >= 0 && ch <= 9) { goto _21; }
+	if (ch >= 11 && ch <= 255) { goto _21; }
+	return;
+:_22;
+	lexmark(l, L_DEC);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _23; }
+	if (ch == 120) { goto _24; }
+	return;
+:_23;
+	lexmark(l, L_DEC);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _23; }
+	return;
+:_24;
+	lexmark(l, L_HEX);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _24; }
+	if (ch >= 65 && ch <= 70) { goto _24; }
+	if (ch >= 97 && ch <= 102) { goto _24; }
+	return;
+:_25;
+	lexmark(l, L_COLON);
+	ch = lexfeedc(l);
+	return;
+:_26;
+	lexmark(l, L_SEMI);
+	ch = lexfeedc(l);
+	return;
+:_27;
+	lexmark(l, L_LT);
+	ch = lexfeedc(l);
+	if (ch == 60) { goto _28; }
+	if (ch == 61) { goto _29; }
+	return;
+:_28;
+	lexmark(l, L_LSH);
+	ch = lexfeedc(l);
+	return;
+:_29;
+	lexmark(l, L_LE);
+	ch = lexfeedc(l);
+	return;
+:_30;
+	lexmark(l, L_EQUAL);
+	ch = lexfeedc(l);
+	if (ch == 61) { goto _31; }
+	return;
+:_31;
+	lexmark(l, L_EQ);
+	ch = lexfeedc(l);
+	return;
+:_32;
+	lexmark(l, L_GT);
+	ch = lexfeedc(l);
+	if (ch == 61) { goto _33; }
+	if (ch == 62) { goto _34; }
+	return;
+:_33;
+	lexmark(l, L_GE);
+	ch = lexfeedc(l);
+	return;
+:_34;
+	lexmark(l, L_RSH);
+	ch = lexfeedc(l);
+	return;
+:_35;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 122) { goto _35; }
+	return;
+:_36;
+	lexmark(l, L_LSQ);
+	ch = lexfeedc(l);
+	return;
+:_37;
+	lexmark(l, L_RSQ);
+	ch = lexfeedc(l);
+	return;
+:_38;
+	lexmark(l, L_XOR);
+	ch = lexfeedc(l);
+	return;
+:_39;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 113) { goto _35; }
+	if (ch == 114) { goto _40; }
+	if (ch >= 115 && ch <= 120) { goto _35; }
+	if (ch == 121) { goto _44; }
+	if (ch == 122) { goto _35; }
+	return;
+:_40;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 100) { goto _35; }
+	if (ch == 101) { goto _41; }
+	if (ch >= 102 && ch <= 122) { goto _35; }
+	return;
+:_41;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch == 97) { goto _42; }
+	if (ch >= 98 && ch <= 122) { goto _35; }
+	return;
+:_42;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 106) { goto _35; }
+	if (ch == 107) { goto _43; }
+	if (ch >= 108 && ch <= 122) { goto _35; }
+	return;
+:_43;
+	lexmark(l, L_BREAK);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 122) { goto _35; }
+	return;
+:_44;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 115) { goto _35; }
+	if (ch == 116) { goto _45; }
+	if (ch >= 117 && ch <= 122) { goto _35; }
+	return;
+:_45;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 100) { goto _35; }
+	if (ch == 101) { goto _46; }
+	if (ch >= 102 && ch <= 122) { goto _35; }
+	return;
+:_46;
+	lexmark(l, L_BYTE);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 122) { goto _35; }
+	return;
+:_47;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 110) { goto _35; }
+	if (ch == 111) { goto _48; }
+	if (ch >= 112 && ch <= 122) { goto _35; }
+	return;
+:_48;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 109) { goto _35; }
+	if (ch == 110) { goto _49; }
+	if (ch >= 111 && ch <= 122) { goto _35; }
+	return;
+:_49;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 115) { goto _35; }
+	if (ch == 116) { goto _50; }
+	if (ch >= 117 && ch <= 122) { goto _35; }
+	return;
+:_50;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 104) { goto _35; }
+	if (ch == 105) { goto _51; }
+	if (ch >= 106 && ch <= 122) { goto _35; }
+	return;
+:_51;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 109) { goto _35; }
+	if (ch == 110) { goto _52; }
+	if (ch >= 111 && ch <= 122) { goto _35; }
+	return;
+:_52;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 116) { goto _35; }
+	if (ch == 117) { goto _53; }
+	if (ch >= 118 && ch <= 122) { goto _35; }
+	return;
+:_53;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 100) { goto _35; }
+	if (ch == 101) { goto _54; }
+	if (ch >= 102 && ch <= 122) { goto _35; }
+	return;
+:_54;
+	lexmark(l, L_CONTINUE);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 122) { goto _35; }
+	return;
+:_55;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 107) { goto _35; }
+	if (ch == 108) { goto _56; }
+	if (ch == 109) { goto _35; }
+	if (ch == 110) { goto _59; }
+	if (ch >= 111 && ch <= 122) { goto _35; }
+	return;
+:_56;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 114) { goto _35; }
+	if (ch == 115) { goto _57; }
+	if (ch >= 116 && ch <= 122) { goto _35; }
+	return;
+:_57;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 100) { goto _35; }
+	if (ch == 101) { goto _58; }
+	if (ch >= 102 && ch <= 122) { goto _35; }
+	return;
+:_58;
+	lexmark(l, L_ELSE);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 122) { goto _35; }
+	return;
+:_59;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 116) { goto _35; }
+	if (ch == 117) { goto _60; }
+	if (ch >= 118 && ch <= 122) { goto _35; }
+	return;
+:_60;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 108) { goto _35; }
+	if (ch == 109) { goto _61; }
+	if (ch >= 110 && ch <= 122) { goto _35; }
+	return;
+:_61;
+	lexmark(l, L_ENUM);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 122) { goto _35; }
+	return;
+:_62;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 116) { goto _35; }
+	if (ch == 117) { goto _63; }
+	if (ch >= 118 && ch <= 122) { goto _35; }
+	return;
+:_63;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 109) { goto _35; }
+	if (ch == 110) { goto _64; }
+	if (ch >= 111 && ch <= 122) { goto _35; }
+	return;
+:_64;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 98) { goto _35; }
+	if (ch == 99) { goto _65; }
+	if (ch >= 100 && ch <= 122) { goto _35; }
+	return;
+:_65;
+	lexmark(l, L_FUNC);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 122) { goto _35; }
+	return;
+:_66;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 110) { goto _35; }
+	if (ch == 111) { goto _67; }
+	if (ch >= 112 && ch <= 122) { goto _35; }
+	return;
+:_67;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 115) { goto _35; }
+	if (ch == 116) { goto _68; }
+	if (ch >= 117 && ch <= 122) { goto _35; }
+	return;
+:_68;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 110) { goto _35; }
+	if (ch == 111) { goto _69; }
+	if (ch >= 112 && ch <= 122) { goto _35; }
+	return;
+:_69;
+	lexmark(l, L_GOTO);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 122) { goto _35; }
+	return;
+:_70;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 101) { goto _35; }
+	if (ch == 102) { goto _71; }
+	if (ch >= 103 && ch <= 109) { goto _35; }
+	if (ch == 110) { goto _72; }
+	if (ch >= 111 && ch <= 122) { goto _35; }
+	return;
+:_71;
+	lexmark(l, L_IF);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 122) { goto _35; }
+	return;
+:_72;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 115) { goto _35; }
+	if (ch == 116) { goto _73; }
+	if (ch >= 117 && ch <= 122) { goto _35; }
+	return;
+:_73;
+	lexmark(l, L_INT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 122) { goto _35; }
+	return;
+:_74;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 110) { goto _35; }
+	if (ch == 111) { goto _75; }
+	if (ch >= 112 && ch <= 122) { goto _35; }
+	return;
+:_75;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 110) { goto _35; }
+	if (ch == 111) { goto _76; }
+	if (ch >= 112 && ch <= 122) { goto _35; }
+	return;
+:_76;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 111) { goto _35; }
+	if (ch == 112) { goto _77; }
+	if (ch >= 113 && ch <= 122) { goto _35; }
+	return;
+:_77;
+	lexmark(l, L_LOOP);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 122) { goto _35; }
+	return;
+:_78;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 100) { goto _35; }
+	if (ch == 101) { goto _79; }
+	if (ch >= 102 && ch <= 122) { goto _35; }
+	return;
+:_79;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 115) { goto _35; }
+	if (ch == 116) { goto _80; }
+	if (ch >= 117 && ch <= 122) { goto _35; }
+	return;
+:_80;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 116) { goto _35; }
+	if (ch == 117) { goto _81; }
+	if (ch >= 118 && ch <= 122) { goto _35; }
+	return;
+:_81;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 113) { goto _35; }
+	if (ch == 114) { goto _82; }
+	if (ch >= 115 && ch <= 122) { goto _35; }
+	return;
+:_82;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 109) { goto _35; }
+	if (ch == 110) { goto _83; }
+	if (ch >= 111 && ch <= 122) { goto _35; }
+	return;
+:_83;
+	lexmark(l, L_RETURN);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 122) { goto _35; }
+	return;
+:_84;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 104) { goto _35; }
+	if (ch == 105) { goto _85; }
+	if (ch >= 106 && ch <= 115) { goto _35; }
+	if (ch == 116) { goto _90; }
+	if (ch >= 117 && ch <= 122) { goto _35; }
+	return;
+:_85;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 121) { goto _35; }
+	if (ch == 122) { goto _86; }
+	return;
+:_86;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 100) { goto _35; }
+	if (ch == 101) { goto _87; }
+	if (ch >= 102 && ch <= 122) { goto _35; }
+	return;
+:_87;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 110) { goto _35; }
+	if (ch == 111) { goto _88; }
+	if (ch >= 112 && ch <= 122) { goto _35; }
+	return;
+:_88;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 101) { goto _35; }
+	if (ch == 102) { goto _89; }
+	if (ch >= 103 && ch <= 122) { goto _35; }
+	return;
+:_89;
+	lexmark(l, L_SIZEOF);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 122) { goto _35; }
+	return;
+:_90;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 113) { goto _35; }
+	if (ch == 114) { goto _91; }
+	if (ch >= 115 && ch <= 122) { goto _35; }
+	return;
+:_91;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 116) { goto _35; }
+	if (ch == 117) { goto _92; }
+	if (ch >= 118 && ch <= 122) { goto _35; }
+	return;
+:_92;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 98) { goto _35; }
+	if (ch == 99) { goto _93; }
+	if (ch >= 100 && ch <= 122) { goto _35; }
+	return;
+:_93;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 115) { goto _35; }
+	if (ch == 116) { goto _94; }
+	if (ch >= 117 && ch <= 122) { goto _35; }
+	return;
+:_94;
+	lexmark(l, L_STRUCT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 122) { goto _35; }
+	return;
+:_95;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch == 97) { goto _96; }
+	if (ch >= 98 && ch <= 110) { goto _35; }
+	if (ch == 111) { goto _98; }
+	if (ch >= 112 && ch <= 122) { goto _35; }
+	return;
+:_96;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 113) { goto _35; }
+	if (ch == 114) { goto _97; }
+	if (ch >= 115 && ch <= 122) { goto _35; }
+	return;
+:_97;
+	lexmark(l, L_VAR);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 122) { goto _35; }
+	return;
+:_98;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 104) { goto _35; }
+	if (ch == 105) { goto _99; }
+	if (ch >= 106 && ch <= 122) { goto _35; }
+	return;
+:_99;
+	lexmark(l, L_IDENT);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 99) { goto _35; }
+	if (ch == 100) { goto _100; }
+	if (ch >= 101 && ch <= 122) { goto _35; }
+	return;
+:_100;
+	lexmark(l, L_VOID);
+	ch = lexfeedc(l);
+	if (ch >= 48 && ch <= 57) { goto _35; }
+	if (ch >= 65 && ch <= 90) { goto _35; }
+	if (ch == 95) { goto _35; }
+	if (ch >= 97 && ch <= 122) { goto _35; }
+	return;
+:_101;
+	lexmark(l, L_LBRA);
+	ch = lexfeedc(l);
+	return;
+:_102;
+	lexmark(l, L_OR);
+	ch = lexfeedc(l);
+	if (ch == 124) { goto _103; }
+	return;
+:_103;
+	lexmark(l, L_ORELSE);
+	ch = lexfeedc(l);
+	return;
+:_104;
+	lexmark(l, L_RBRA);
+	ch = lexfeedc(l);
+	return;
+:_105;
+	lexmark(l, L_NOT);
+	ch = lexfeedc(l);
+	return;
+}
+// END lexstep
+
+mknode(c: *compiler, kind: int, a: *node, b: *node): *node {
+	var ret: *node;
+	ret = alloc(c, sizeof(*ret)):*node;
+	c.stat_nodes = c.stat_nodes + 1;
+	ret.kind = kind;
+	ret.a = a;
+	ret.b = b;
+	ret.lineno = c.lineno;
+	ret.colno = c.colno;
+	ret.n = 0;
+	ret.s = 0:*byte;
+	ret.t = 0:*type;
+	ret.d = 0:*decl;
+	return ret;
+}
+
+mknode0(c: *compiler, kind: int): *node {
+	return mknode(c, kind, 0:*node, 0:*node);
+}
+
+mknode1(c: *compiler, kind: int, a: *node): *node {
+	return mknode(c, kind, a, 0:*node);
+}
+
+// Hash len bytes of s
+hash_bytes(s: *byte, len: int): int {
+	var h: int;
+	var i: int;
+
+	h = 5381;
+	i = 0;
+	loop {
+		if (i == len) {
+			return h;
+		}
+
+		h = h * 33 + s[i]:int;
+		i = i + 1;
+	}
+}
+
+// Double the size of the string table
+istr_grow(c: *compiler): void {
+	var table: **istr;
+	var cap: int;
+	var p: *istr;
+	var next: *istr;
+	var link: **istr;
+	var i: int;
+
+	cap = c.istr_cap * 2;
+	if (cap == 0) {
+		cap = 1024;
+	}
+
+	table = alloc(c, cap * sizeof(p)):**istr;
+
+	i = 0;
+	loop {
+		if (i == cap) {
+			break;
+		}
+		table[i] = 0:*istr;
+		i = i + 1;
+	}
+
+	i = 0;
+	loop {
+		if (i == c.istr_cap) {
+			break;
+		}
+
+		p = c.istr_table[i];
+		loop {
+			if (!p) {
+				break;
+			}
+
+			next = p.next;
+			link = &table[p.hash & (cap - 1)];
+			p.next = *link;
+			*link = p;
+			p = next;
+		}
+
+		i = i + 1;
+	}
+
+	c.istr_table = table;
+	c.istr_cap = cap;
+}
+
+// Find the single copy of len bytes of s, so strings compare by pointer
+intern_istr(c: *compiler, s: *byte, len: int): *istr {
+	var p: *istr;
+	var link: **istr;
+	var h: int;
+	var i: int;
+
+	h = hash_bytes(s, len);
+	link = &c.istr_table[h & (c.istr_cap - 1)];
+	loop {
+		p = *link;
+		if (!p) {
+			break;
+		}
+
+		if (p.hash == h && p.len == len) {
+			i = 0;
+			loop {
+				if (i == len || p.s[i] != s[i]) {
+					break;
+				}
+				i = i + 1;
+			}
+
+			if (i == len) {
+				return p;
+			}
+		}
+
+		link = &p.next;
+	}
+
+	p = alloc(c, sizeof(*p)):*istr;
+	p.next = 0:*istr;
+	p.hash = h;
+	p.len = len;
+	p.s = alloc(c, len + 1);
+	p.lit = 0:*label;
+	p.lit_at = 0;
+	p.lit_next = 0:*istr;
+
+	i = 0;
+	loop {
+		if (i == len) {
+			break;
+		}
+		p.s[i] = s[i];
+		i = i + 1;
+	}
+	p.s[len] = 0:byte;
+
+	*link = p;
+
+	c.istr_count = c.istr_count + 1;
+	if (c.istr_count > c.istr_cap) {
+		istr_grow(c);
+	}
+
+	return p;
+}
+
+intern_bytes(c: *compiler, s: *byte, len: int): *byte {
+	var p: *istr;
+
+	p = intern_istr(c, s, len);
+
+	return p.s;
+}
+
+// Intern the current token
+intern(c: *compiler): *byte {
+	return intern_bytes(c, c.token, c.tlen);
+}
+
+intern_str(c: *compiler, s: *byte): *byte {
+	return intern_bytes(c, s, strlen(s));
+}
+
+// ident := IDENT
+parse_ident(c: *compiler): *node {
+	var n: *node;
+
+	if (c.tt != T_IDENT) {
+		return 0:*node;
+	}
+
+	n = mknode0(c, N_IDENT);
+	n.s = intern(c);
+	feed(c);
+
+	return n;
+}
+
+parse_hex(c: *compiler): *node {
+	var n: *node;
+	var x: int;
+	var d: int;
+	var i: int;
+
+	x = 0;
+	i = 0;
+	loop {
+		if (i == c.tlen) {
+			break;
+		}
+
+		d = c.token[i]:int;
+
+		if (d >= '0' && d <= '9') {
+			d = d - '0';
 		} else if (d >= 'a' && d <= 'f') {
 			d = (d - 'a') + 10;
 		} else {
@@ -1034,7 +3019,7 @@ parse_post_expr(c: *compiler): *node {
 	var n: *node;
 	var b: *node;
 
-	if (c.tt == T_IDENT && !strcmp(c.token, "sizeof")) {
+	if (c.kw == K_SIZEOF) {
 		feed(c);
 
 		if (c.tt != T_LPAR) {
@@ -1494,7 +3479,7 @@ parse_if_stmt(c: *compiler): *node {
 	var a: *node;
 	var b: *node;
 
-	if (c.tt != T_IDENT || strcmp(c.token, "if")) {
+	if (c.kw != K_IF) {
 		return 0:*node;
 	}
 	feed(c);
@@ -1522,7 +3507,7 @@ parse_if_stmt(c: *compiler): *node {
 
 		e.a = mknode(c, N_COND, a, b);
 
-		if (c.tt != T_IDENT || strcmp(c.token, "else")) {
+		if (c.kw != K_ELSE) {
 			return n;
 		}
 		feed(c);
@@ -1542,7 +3527,7 @@ parse_if_stmt(c: *compiler): *node {
 			return n;
 		}
 
-		if (c.tt != T_IDENT || strcmp(c.token, "if")) {
+		if (c.kw != K_IF) {
 			die(c, "expected if");
 		}
 		feed(c);
@@ -1556,7 +3541,7 @@ parse_if_stmt(c: *compiler): *node {
 parse_loop_stmt(c: *compiler): *node {
 	var a: *node;
 
-	if (c.tt != T_IDENT || strcmp(c.token, "loop")) {
+	if (c.kw != K_LOOP) {
 		return 0:*node;
 	}
 	feed(c);
@@ -1578,7 +3563,7 @@ parse_loop_stmt(c: *compiler): *node {
 
 // break_stmt := 'break'
 parse_break_stmt(c: *compiler): *node {
-	if (c.tt != T_IDENT || strcmp(c.token, "break")) {
+	if (c.kw != K_BREAK) {
 		return 0:*node;
 	}
 	feed(c);
@@ -1588,7 +3573,7 @@ parse_break_stmt(c: *compiler): *node {
 
 // continue_stmt := 'continue'
 parse_continue_stmt(c: *compiler): *node {
-	if (c.tt != T_IDENT || strcmp(c.token, "continue")) {
+	if (c.kw != K_CONTINUE) {
 		return 0:*node;
 	}
 	feed(c);
@@ -1601,7 +3586,7 @@ parse_continue_stmt(c: *compiler): *node {
 parse_return_stmt(c: *compiler): *node {
 	var a: *node;
 
-	if (c.tt != T_IDENT || strcmp(c.token, "return")) {
+	if (c.kw != K_RETURN) {
 		return 0:*node;
 	}
 	feed(c);
@@ -1639,7 +3624,7 @@ parse_var_decl(c: *compiler): *node {
 parse_var_stmt(c: *compiler): *node {
 	var a: *node;
 
-	if (c.tt != T_IDENT || strcmp(c.token, "var")) {
+	if (c.kw != K_VAR) {
 		return 0:*node;
 	}
 	feed(c);
@@ -1673,7 +3658,7 @@ parse_label_stmt(c: *compiler): *node {
 parse_goto_stmt(c: *compiler): *node {
 	var a: *node;
 
-	if (c.tt != T_IDENT || strcmp(c.token, "goto")) {
+	if (c.kw != K_GOTO) {
 		return 0:*node;
 	}
 	feed(c);
@@ -1842,11 +3827,7 @@ parse_enum_list(c: *compiler): *node {
 parse_enum_decl(c: *compiler): *node {
 	var b: *node;
 
-	if (c.tt != T_IDENT) {
-		return 0:*node;
-	}
-
-	if (strcmp(c.token, "enum")) {
+	if (c.kw != K_ENUM) {
 		return 0:*node;
 	}
 	feed(c);
@@ -1894,7 +3875,7 @@ parse_type(c: *compiler): *node {
 		return n;
 	}
 
-	if (c.tt == T_IDENT && !strcmp(c.token, "func")) {
+	if (c.kw == K_FUNC) {
 		feed(c);
 
 		n = parse_func_type(c);
@@ -1968,11 +3949,7 @@ parse_struct_decl(c: *compiler): *node {
 	var a: *node;
 	var b: *node;
 
-	if (c.tt != T_IDENT) {
-		return 0:*node;
-	}
-
-	if (strcmp(c.token, "struct")) {
+	if (c.kw != K_STRUCT) {
 		return 0:*node;
 	}
 	feed(c);
@@ -2241,6 +4218,27 @@ compile(c: *compiler, p: *node): void {
 		d = next_decl(c, d);
 	}
 
+	// Check every function, even those that are never called
+	d = first_decl(c);
+	loop {
+		if (!d) {
+			break;
+		}
+
+		if (d.func_defined && d.func_def) {
+			func_frame(c, d);
+			type_stmt(c, d, d.func_def.b, 0);
+		}
+
+		d = next_decl(c, d);
+	}
+
+	// Only compile the functions _start can reach
+	d = find(c, intern_str(c, "_start"), 0:*byte, 0);
+	if (d) {
+		reach_func(c, d);
+	}
+
 	// Compile functions
 	d = first_decl(c);
 	loop {
@@ -2248,7 +4246,7 @@ compile(c: *compiler, p: *node): void {
 			break;
 		}
 
-		if (d.func_defined) {
+		if (d.func_defined && d.func_reached) {
 			compile_func(c, d);
 		}
 
@@ -2256,6 +4254,121 @@ compile(c: *compiler, p: *node): void {
 	}
 }
 
+// Mark a function and everything it refers to as reachable
+reach_func(c: *compiler, d: *decl): void {
+	if (d.func_reached) {
+		return;
+	}
+
+	d.func_reached = 1;
+
+	if (!d.func_def) {
+		return;
+	}
+
+	prune_stmts(c, d.func_def.b);
+	reach_node(c, d, d.func_def.b);
+}
+
+// Visit the functions named in the body of d. Names are resolved the same
+// way as when typing, so locals and enums hide functions.
+reach_node(c: *compiler, d: *decl, n: *node): void {
+	var v: *decl;
+
+	if (!n) {
+		return;
+	}
+
+	if (n.kind == N_IDENT) {
+		v = find(c, n.s, 0:*byte, 0);
+		if (v && v.enum_defined) {
+			return;
+		}
+
+		v = find(c, d.name, n.s, 0);
+		if (v && v.var_defined) {
+			return;
+		}
+
+		v = find(c, n.s, 0:*byte, 0);
+		if (v && v.func_defined) {
+			reach_func(c, v);
+		}
+
+		return;
+	}
+
+	reach_node(c, d, n.a);
+	reach_node(c, d, n.b);
+}
+
+// Drop the statements following a return, break, continue or goto in the
+// same list, up to the next one containing a label. Declarations are kept
+// since locals are hoisted.
+prune_stmts(c: *compiler, n: *node): void {
+	var kind: int;
+	var p: *node;
+
+	if (!n) {
+		return;
+	}
+
+	kind = n.kind;
+	if (kind == N_CONDLIST) {
+		loop {
+			if (!n) {
+				return;
+			}
+
+			prune_stmts(c, n.a.b);
+
+			n = n.b;
+		}
+	} else if (kind == N_LOOP) {
+		prune_stmts(c, n.a);
+	} else if (kind == N_STMTLIST) {
+		loop {
+			if (!n) {
+				return;
+			}
+
+			prune_stmts(c, n.a);
+
+			kind = n.a.kind;
+			if (kind == N_RETURN || kind == N_BREAK || kind == N_CONTINUE || kind == N_GOTO) {
+				p = n;
+				loop {
+					if (!p.b || has_label(c, p.b.a)) {
+						break;
+					}
+
+					if (p.b.a.kind == N_VARDECL) {
+						p = p.b;
+					} else {
+						p.b = p.b.b;
+					}
+				}
+				n = p;
+			}
+
+			n = n.b;
+		}
+	}
+}
+
+// Check if a statement contains a label
+has_label(c: *compiler, n: *node): int {
+	if (!n) {
+		return 0;
+	}
+
+	if (n.kind == N_LABEL) {
+		return 1;
+	}
+
+	return has_label(c, n.a) || has_label(c, n.b);
+}
+
 defextern(c: *compiler, n: *node): *decl {
 	var d: *decl;
 	var name: *byte;
@@ -2401,18 +4514,58 @@ layout_struct(c: *compiler, d: *decl): void {
 }
 
 compile_func(c: *compiler, d: *decl): void {
+	var offset: int;
+
+	if (!d.func_def) {
+		return;
+	}
+
+	offset = func_frame(c, d);
+
+	// Keep the name in the read-only data for debugging
+	emit_strlit(c, d.name);
+
+	// Compile the function body
+	fixup_label(c, d.func_label);
+
+	if (c.opt_ir) {
+		ir_func(c, d, offset);
+		return;
+	}
+
+	emit_preamble(c, d, offset, 0);
+	compile_stmt(c, d, d.func_def.b, 0:*label, 0:*label);
+	if (c.opt_regs) {
+		emit_mov_ri(c, R_RAX, 0);
+		emit_leave(c);
+	} else {
+		emit_num(c, 0);
+		emit_ret(c);
+	}
+}
+
+// Define the arguments and locals of a function, returning the size of its
+// locals. This happens once, before the function is typed.
+func_frame(c: *compiler, d: *decl): int {
 	var name: *byte;
 	var v: *decl;
 	var t: *type;
 	var offset: int;
 	var n: *node;
+	var i: int;
 
-	if (!d.func_def) {
-		return;
+	if (d.func_framed) {
+		return d.func_frame;
+	}
+
+	// The kernel enters _start with its arguments on the stack
+	d.func_nregs = 0;
+	if (strcmp(d.name, "_start")) {
+		d.func_nregs = arg_regs(c, count_args(c, d.func_type.arg));
 	}
 
 	n = d.func_def.a.b.a;
-	offset = 16;
+	i = 0;
 	loop {
 		if (!n) {
 			break;
@@ -2428,23 +4581,200 @@ compile_func(c: *compiler, d: *decl): void {
 
 		v.var_defined = 1;
 		v.var_type = t;
-		v.var_offset = offset;
+		v.var_offset = arg_offset(c, d.func_nregs, i);
 		v.var_def = n.a;
 
-		offset = offset + 8;
+		i = i + 1;
+		n = n.b;
+	}
+
+	// Hoist locals below the arguments the preamble spills
+	offset = 8 * d.func_nregs;
+	offset = hoist_locals(c, d, d.func_def.b, offset);
+
+	// Only the slots of locals that might be read before they are assigned
+	// need to be zeroed
+	init_locals(c, d);
+	d.func_zero = alloc(c, (offset - 8 * d.func_nregs + 7) / 8 + 1);
+	zero_locals(c, d, d.func_def.b);
+
+	d.func_framed = 1;
+	d.func_frame = offset;
+
+	return offset;
+}
+
+// Number of the first n arguments passed in registers
+arg_regs(c: *compiler, n: int): int {
+	if (!c.opt_regcall) {
+		return 0;
+	}
+
+	if (n > 6) {
+		return 6;
+	}
+
+	return n;
+}
+
+// Frame offset of argument i when the first nregs come in registers. Stack
+// arguments are above the return address and register arguments are spilled
+// below the saved frame pointer.
+arg_offset(c: *compiler, nregs: int, i: int): int {
+	if (i < nregs) {
+		return -8 * (i + 1);
+	}
+
+	return 16 + 8 * (i - nregs);
+}
+
+// Register holding argument i
+arg_reg(c: *compiler, i: int): int {
+	if (i == 0) {
+		return R_RDI;
+	} else if (i == 1) {
+		return R_RSI;
+	} else if (i == 2) {
+		return R_RDX;
+	} else if (i == 3) {
+		return R_RCX;
+	} else if (i == 4) {
+		return R_R8;
+	} else {
+		return R_R9;
+	}
+}
+
+// Find the local a name refers to in d, if it is one
+local_decl(c: *compiler, d: *decl, n: *node): *decl {
+	var v: *decl;
+
+	if (n.kind != N_IDENT) {
+		return 0:*decl;
+	}
+
+	v = find(c, n.s, 0:*byte, 0);
+	if (v && v.enum_defined) {
+		return 0:*decl;
+	}
+
+	v = find(c, d.name, n.s, 0);
+	if (!v || !v.var_defined || v.var_offset >= -8 * d.func_nregs) {
+		return 0:*decl;
+	}
+
+	return v;
+}
+
+// Mark every local mentioned in an expression as used
+use_locals(c: *compiler, d: *decl, n: *node): void {
+	var v: *decl;
+
+	if (!n) {
+		return;
+	}
+
+	if (n.kind == N_IDENT) {
+		v = local_decl(c, d, n);
+		if (v) {
+			v.var_used = 1;
+		}
+		return;
+	}
+
+	use_locals(c, d, n.a);
+	use_locals(c, d, n.b);
+}
+
+// Find the locals that the assignments at the very start of a function
+// store to before anything could read them
+init_locals(c: *compiler, d: *decl): void {
+	var n: *node;
+	var s: *node;
+	var v: *decl;
+
+	n = d.func_def.b;
+	loop {
+		if (!n) {
+			break;
+		}
+
+		s = n.a;
+		if (s.kind == N_ASSIGN) {
+			use_locals(c, d, s.b);
+			v = local_decl(c, d, s.a);
+			if (v && !v.var_used && type_isprim(c, v.var_type)) {
+				v.var_init = 1;
+			} else {
+				use_locals(c, d, s.a);
+			}
+		} else if (s.kind != N_VARDECL) {
+			break;
+		}
+
 		n = n.b;
 	}
+}
+
+// Mark the frame slots holding locals that still need to start out zero
+zero_locals(c: *compiler, d: *decl, n: *node): void {
+	var kind: int;
+	var v: *decl;
+	var lo: int;
+	var hi: int;
+
+	if (!n) {
+		return;
+	}
+
+	kind = n.kind;
+	if (kind == N_CONDLIST) {
+		loop {
+			if (!n) {
+				return;
+			}
 
-	// Hoist locals
-	offset = hoist_locals(c, d, d.func_def.b, 0);
+			zero_locals(c, d, n.a.b);
 
-	// Compile the function body
-	emit_str(c, d.name);
-	fixup_label(c, d.func_label);
-	emit_preamble(c, offset);
-	compile_stmt(c, d, d.func_def.b, 0:*label, 0:*label);
-	emit_num(c, 0);
-	emit_ret(c);
+			n = n.b;
+		}
+	} else if (kind == N_STMTLIST) {
+		loop {
+			if (!n) {
+				return;
+			}
+
+			zero_locals(c, d, n.a);
+
+			n = n.b;
+		}
+	} else if (kind == N_LOOP) {
+		zero_locals(c, d, n.a);
+		return;
+	} else if (kind != N_VARDECL) {
+		return;
+	}
+
+	v = find(c, d.name, n.a.s, 0);
+	if (v.var_init || type_sizeof(c, v.var_type) == 0) {
+		return;
+	}
+
+	// Slots are numbered down from the spilled arguments
+	lo = (-(v.var_offset + type_sizeof(c, v.var_type)) - 8 * d.func_nregs) / 8;
+	hi = (-v.var_offset - 1 - 8 * d.func_nregs) / 8;
+	loop {
+		if (lo > hi) {
+			break;
+		}
+
+		d.func_zero[lo] = 1:byte;
+		lo = lo + 1;
+	}
+
+	if (hi + 1 > d.func_nzero) {
+		d.func_nzero = hi + 1;
+	}
 }
 
 hoist_locals(c: *compiler, d: *decl, n: *node, offset: int): int {
@@ -2559,10 +4889,8 @@ count_args(c: *compiler, t: *type): int {
 	return nargs;
 }
 
-// Translate an expression
-compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
-	var no: *label;
-	var out: *label;
+// Check an expression and annotate it with types
+type_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 	var v: *decl;
 	var kind: int;
 
@@ -2575,24 +4903,18 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "str is not an lexpr");
 		}
 
-		emit_str(c, n.s);
-
 		n.t = mktype1(c, TY_PTR, mktype0(c, TY_BYTE));
 	} else if (kind == N_NUM) {
 		if (!rhs) {
 			die(c, "num is not an lexpr");
 		}
 
-		emit_num(c, n.n);
-
 		n.t = mktype0(c, TY_INT);
 	} else if (kind == N_CHAR) {
 		if (!rhs) {
 			die(c, "char is not an lexpr");
 		}
 
-		emit_num(c, n.n);
-
 		n.t = mktype0(c, TY_INT);
 	} else if (kind == N_EXPRLIST) {
 		if (!rhs) {
@@ -2600,10 +4922,10 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 		}
 
 		if (n.b) {
-			compile_expr(c, d, n.b, 1);
+			type_expr(c, d, n.b, 1);
 		}
 
-		compile_expr(c, d, n.a, 1);
+		type_expr(c, d, n.a, 1);
 
 		if (n.b) {
 			n.t = mktype2(c, TY_ARG, n.a.t, n.b.t);
@@ -2616,10 +4938,10 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 		}
 
 		if (n.b) {
-			compile_expr(c, d, n.b, 1);
+			type_expr(c, d, n.b, 1);
 		}
 
-		compile_expr(c, d, n.a, 1);
+		type_expr(c, d, n.a, 1);
 
 		if (n.a.t.kind != TY_FUNC) {
 			die(c, "calling not a function");
@@ -2631,11 +4953,9 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			unify(c, n.a.t.arg, 0: *type);
 		}
 
-		emit_call(c, count_args(c, n.a.t.arg));
-
 		n.t = n.a.t.val;
 	} else if (kind == N_DOT) {
-		compile_expr(c, d, n.a, 0);
+		type_expr(c, d, n.a, 0);
 
 		if (n.a.t.kind == TY_PTR) {
 			if (n.a.t.val.kind != TY_STRUCT) {
@@ -2643,8 +4963,6 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			}
 
 			v = find(c, n.a.t.val.st.name, n.b.s, 0);
-
-			emit_load(c, n.a.t);
 		} else {
 			if (n.a.t.kind != TY_STRUCT) {
 				die(c, "dot not a struct");
@@ -2657,35 +4975,26 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "no such member");
 		}
 
-		emit_num(c, v.member_offset);
-		emit_add(c);
-
+		n.d = v;
 		n.t = v.member_type;
-
-		if (rhs) {
-			emit_load(c, n.t);
-		}
 	} else if (kind == N_IDENT) {
 		v = find(c, n.s, 0:*byte, 0);
 		if (v && v.enum_defined) {
-			emit_num(c, v.enum_value);
+			n.d = v;
 			n.t = mktype0(c, TY_INT);
 			return;
 		}
 
 		v = find(c, d.name, n.s, 0);
 		if (v && v.var_defined) {
-			emit_lea(c, v.var_offset);
+			n.d = v;
 			n.t = v.var_type;
-			if (rhs) {
-				emit_load(c, n.t);
-			}
 			return;
 		}
 
 		v = find(c, n.s, 0:*byte, 0);
 		if (v && v.func_defined) {
-			emit_ptr(c, v.func_label);
+			n.d = v;
 			n.t = v.func_type;
 			return;
 		}
@@ -2696,32 +5005,18 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "assign is not an lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 0);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 0);
 
 		unify(c, n.a.t, n.b.t);
 
 		n.t = n.a.t;
-
-		emit_store(c, n.t);
 	} else if (kind == N_SIZEOF) {
 		if (!rhs) {
 			die(c, "sizeof is not an lexpr");
 		}
 
-		out = mklabel(c);
-
-		emit_jmp(c, out);
-
-		compile_expr(c, d, n.a, 0);
-
-		fixup_label(c, out);
-
-		if (n.a.t.kind == TY_BYTE) {
-			emit_num(c, 1);
-		} else {
-			emit_num(c, type_sizeof(c, n.a.t));
-		}
+		type_expr(c, d, n.a, 0);
 
 		n.t = mktype0(c, TY_INT);
 	} else if (kind == N_REF) {
@@ -2729,24 +5024,20 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "ref is not an lexpr");
 		}
 
-		compile_expr(c, d, n.a, 0);
+		type_expr(c, d, n.a, 0);
 
 		n.t = mktype1(c, TY_PTR, n.a.t);
 	} else if (kind == N_DEREF) {
-		compile_expr(c, d, n.a, 1);
+		type_expr(c, d, n.a, 1);
 
 		if (n.a.t.kind != TY_PTR) {
 			die(c, "deref not a pointer");
 		}
 
 		n.t = n.a.t.val;
-
-		if (rhs) {
-			emit_load(c, n.t);
-		}
 	} else if (kind == N_INDEX) {
-		compile_expr(c, d, n.a, 1);
-		compile_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
+		type_expr(c, d, n.b, 1);
 
 		if (n.a.t.kind != TY_PTR) {
 			die(c, "not a pointer");
@@ -2757,27 +5048,13 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 		}
 
 		n.t = n.a.t.val;
-
-		if (n.t.kind == TY_BYTE) {
-			emit_num(c, 1);
-		} else {
-			emit_num(c, type_sizeof(c, n.t));
-		}
-
-		emit_mul(c);
-		emit_add(c);
-
-		if (rhs) {
-			emit_load(c, n.t);
-		}
 	} else if (kind == N_LT) {
 		if (!rhs) {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 1);
-		emit_lt(c);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
 
 		unify(c, n.a.t, n.b.t);
 
@@ -2791,9 +5068,8 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 1);
-		emit_gt(c);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
 
 		unify(c, n.a.t, n.b.t);
 
@@ -2807,9 +5083,8 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 1);
-		emit_le(c);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
 
 		unify(c, n.a.t, n.b.t);
 
@@ -2823,9 +5098,8 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 1);
-		emit_ge(c);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
 
 		unify(c, n.a.t, n.b.t);
 
@@ -2839,9 +5113,8 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 1);
-		emit_eq(c);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
 
 		unify(c, n.a.t, n.b.t);
 
@@ -2855,9 +5128,8 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 1);
-		emit_ne(c);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
 
 		unify(c, n.a.t, n.b.t);
 
@@ -2871,79 +5143,20 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		no = mklabel(c);
-		out = mklabel(c);
-
-		compile_expr(c, d, n.a, 1);
-
-		emit_jz(c, no);
-		emit_num(c, 0);
-		emit_jmp(c, out);
-		fixup_label(c, no);
-		emit_num(c, 1);
-		fixup_label(c, out);
-
-		if (!type_isprim(c, n.a.t)) {
-			die(c, "not an prim");
-		}
-
-		n.t = mktype0(c, TY_INT);
-	} else if (kind == N_BOR) {
-		if (!rhs) {
-			die(c, "not lexpr");
-		}
-
-		no = mklabel(c);
-		out = mklabel(c);
-
-		compile_expr(c, d, n.a, 1);
-		emit_jz(c, no);
-		emit_num(c, 1);
-		emit_jmp(c, out);
-
-		fixup_label(c, no);
-		no = mklabel(c);
-
-		compile_expr(c, d, n.b, 1);
-		emit_jz(c, no);
-		emit_num(c, 1);
-		emit_jmp(c, out);
-
-		fixup_label(c, no);
-		emit_num(c, 0);
-
-		fixup_label(c, out);
+		type_expr(c, d, n.a, 1);
 
 		if (!type_isprim(c, n.a.t)) {
 			die(c, "not an prim");
 		}
 
-		if (!type_isprim(c, n.b.t)) {
-			die(c, "not an prim");
-		}
-
 		n.t = mktype0(c, TY_INT);
-	} else if (kind == N_BAND) {
+	} else if (kind == N_BOR || kind == N_BAND) {
 		if (!rhs) {
 			die(c, "not lexpr");
 		}
 
-		no = mklabel(c);
-		out = mklabel(c);
-
-		compile_expr(c, d, n.a, 1);
-		emit_jz(c, no);
-
-		compile_expr(c, d, n.b, 1);
-		emit_jz(c, no);
-
-		emit_num(c, 1);
-		emit_jmp(c, out);
-
-		fixup_label(c, no);
-		emit_num(c, 0);
-
-		fixup_label(c, out);
+		type_expr(c, d, n.a, 1);
+		type_expr(c, d, n.b, 1);
 
 		if (!type_isprim(c, n.a.t)) {
 			die(c, "not an prim");
@@ -2959,7 +5172,7 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.a, 1);
+		type_expr(c, d, n.a, 1);
 
 		if (!type_isint(c, n.a.t)) {
 			die(c, "pos: not an int");
@@ -2971,8 +5184,7 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.a, 1);
-		emit_neg(c);
+		type_expr(c, d, n.a, 1);
 
 		if (!type_isint(c, n.a.t)) {
 			die(c, "neg: not an int");
@@ -2984,8 +5196,7 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.a, 1);
-		emit_not(c);
+		type_expr(c, d, n.a, 1);
 
 		if (!type_isint(c, n.a.t)) {
 			die(c, "not: not an int");
@@ -2997,9 +5208,8 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 1);
-		emit_add(c);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
 
 		unify(c, n.a.t, n.b.t);
 
@@ -3013,9 +5223,8 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 1);
-		emit_sub(c);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
 
 		unify(c, n.a.t, n.b.t);
 
@@ -3029,9 +5238,8 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 1);
-		emit_mul(c);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
 
 		unify(c, n.a.t, n.b.t);
 
@@ -3045,9 +5253,8 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 1);
-		emit_div(c);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
 
 		unify(c, n.a.t, n.b.t);
 
@@ -3061,9 +5268,8 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 1);
-		emit_mod(c);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
 
 		unify(c, n.a.t, n.b.t);
 
@@ -3077,9 +5283,8 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 1);
-		emit_lsh(c);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
 
 		unify(c, n.a.t, n.b.t);
 
@@ -3093,9 +5298,8 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 1);
-		emit_rsh(c);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
 
 		unify(c, n.a.t, n.b.t);
 
@@ -3109,9 +5313,8 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 1);
-		emit_and(c);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
 
 		unify(c, n.a.t, n.b.t);
 
@@ -3125,9 +5328,8 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 1);
-		emit_or(c);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
 
 		unify(c, n.a.t, n.b.t);
 
@@ -3141,9 +5343,8 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.b, 1);
-		compile_expr(c, d, n.a, 1);
-		emit_xor(c);
+		type_expr(c, d, n.b, 1);
+		type_expr(c, d, n.a, 1);
 
 		unify(c, n.a.t, n.b.t);
 
@@ -3157,7 +5358,7 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 			die(c, "not lexpr");
 		}
 
-		compile_expr(c, d, n.a, 1);
+		type_expr(c, d, n.a, 1);
 		if (!type_isprim(c, n.a.t)) {
 			die(c, "not a primitive");
 		}
@@ -3166,159 +5367,3988 @@ compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
 	} else {
 		die(c, "not an expression");
 	}
+
+	if (c.opt_fold) {
+		fold_expr(c, n);
+	}
 }
 
-// Compile a statement
-compile_stmt(c: *compiler, d: *decl, n: *node, top: *label, out: *label): void {
-	var no: *label;
-	var ifout: *label;
-	var v: *decl;
+// Replace an operation on constants with its value
+fold_expr(c: *compiler, n: *node): void {
 	var kind: int;
+	var x: int;
+	var y: int;
+	var z: int;
 
-	if (!n) {
+	kind = n.kind;
+	if (kind == N_NUM || kind == N_CHAR) {
 		return;
-	}
+	} else if (kind == N_SIZEOF) {
+		rconst(c, n, &z);
+	} else if (kind == N_POS || kind == N_NEG || kind == N_NOT || kind == N_BNOT) {
+		if (!rconst(c, n.a, &x)) {
+			return;
+		}
 
-	c.lineno = n.lineno;
-	c.colno = 0;
+		if (kind == N_POS) {
+			z = x;
+		} else if (kind == N_NEG) {
+			z = -x;
+		} else if (kind == N_NOT) {
+			z = ~x;
+		} else {
+			z = !x;
+		}
+	} else if (ralu(c, kind) >= 0 || kind == N_MUL || kind == N_DIV || kind == N_MOD || kind == N_LSH || kind == N_RSH || kind == N_BOR || kind == N_BAND) {
+		if (!rconst(c, n.a, &x) || !rconst(c, n.b, &y)) {
+			return;
+		}
 
-	kind = n.kind;
-	if (kind == N_CONDLIST) {
-		ifout = mklabel(c);
-		no = 0: *label;
-		loop {
-			if (no) {
-				fixup_label(c, no);
+		if (kind == N_BOR) {
+			z = x || y;
+		} else if (kind == N_BAND) {
+			z = x && y;
+		} else if (kind == N_LT) {
+			z = x < y;
+		} else if (kind == N_GT) {
+			z = x > y;
+		} else if (kind == N_LE) {
+			z = x <= y;
+		} else if (kind == N_GE) {
+			z = x >= y;
+		} else if (kind == N_EQ) {
+			z = x == y;
+		} else if (kind == N_NE) {
+			z = x != y;
+		} else if (kind == N_ADD) {
+			z = x + y;
+		} else if (kind == N_SUB) {
+			z = x - y;
+		} else if (kind == N_MUL) {
+			z = x * y;
+		} else if (kind == N_DIV || kind == N_MOD) {
+			// Leave division by zero to fault at run time
+			if (y == 0) {
+				return;
 			}
 
-			if (!n) {
-				break;
+			if (kind == N_DIV) {
+				z = x / y;
+			} else {
+				z = x % y;
 			}
+		} else if (kind == N_LSH) {
+			z = x << (y & 63);
+		} else if (kind == N_RSH) {
+			z = x >> (y & 63);
+		} else if (kind == N_AND) {
+			z = x & y;
+		} else if (kind == N_OR) {
+			z = x | y;
+		} else {
+			z = x ^ y;
+		}
+	} else {
+		return;
+	}
 
-			no = mklabel(c);
+	// Constants are emitted as sign extended immediates
+	if (z != sext32(z)) {
+		return;
+	}
 
-			if (n.a.a) {
-				compile_expr(c, d, n.a.a, 1);
-				emit_jz(c, no);
-			}
+	n.kind = N_NUM;
+	n.n = z;
+	n.a = 0:*node;
+	n.b = 0:*node;
+}
 
-			compile_stmt(c, d, n.a.b, top, out);
-			emit_jmp(c, ifout);
+// Emit stack machine code for a checked expression
+gen_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
+	var no: *label;
+	var out: *label;
+	var v: *decl;
+	var kind: int;
+	var x: int;
+	var y: int;
 
-			n = n.b;
+	kind = n.kind;
+	if (kind == N_STR) {
+		emit_str(c, n.s);
+	} else if (kind == N_NUM || kind == N_CHAR) {
+		emit_num(c, n.n);
+	} else if (kind == N_EXPRLIST) {
+		if (n.b) {
+			gen_expr(c, d, n.b, 1);
 		}
-		fixup_label(c, ifout);
-	} else if (kind == N_STMTLIST) {
-		loop {
-			if (!n) {
-				break;
-			}
-			compile_stmt(c, d, n.a, top, out);
-			n = n.b;
+
+		gen_expr(c, d, n.a, 1);
+	} else if (kind == N_CALL) {
+		if (n.b) {
+			gen_expr(c, d, n.b, 1);
 		}
-	} else if (kind == N_LOOP) {
-		top = mklabel(c);
-		out = mklabel(c);
-		fixup_label(c, top);
-		compile_stmt(c, d, n.a, top, out);
-		emit_jmp(c, top);
-		fixup_label(c, out);
-	} else if (kind == N_BREAK) {
-		if (!out) {
-			die(c, "break outside loop");
+
+		// Call named functions directly
+		if (n.a.kind == N_IDENT && !n.a.d.var_defined) {
+			emit_call_label(c, n.a.d.func_label, count_args(c, n.a.t.arg));
+		} else {
+			gen_expr(c, d, n.a, 1);
+			emit_call(c, count_args(c, n.a.t.arg));
 		}
-		emit_jmp(c, out);
-	} else if (kind == N_CONTINUE) {
-		if (!top) {
-			die(c, "continue outside loop");
+	} else if (kind == N_DOT) {
+		gen_expr(c, d, n.a, 0);
+
+		if (n.a.t.kind == TY_PTR) {
+			emit_load(c, n.a.t);
 		}
-		emit_jmp(c, top);
-	} else if (kind == N_RETURN) {
-		if (n.a) {
-			if (d.func_type.val.kind == TY_VOID) {
-				die(c, "returning a value in a void function");
-			}
-			compile_expr(c, d, n.a, 1);
-			unify(c, n.a.t, d.func_type.val);
+
+		if (c.opt_fold) {
+			emit_op_imm(c, N_ADD, n.d.member_offset);
 		} else {
-			if (d.func_type.val.kind != TY_VOID) {
-				die(c, "returning void in a non void function");
-			}
-			emit_num(c, 0);
+			emit_num(c, n.d.member_offset);
+			emit_add(c);
 		}
-		emit_ret(c);
-	} else if (kind == N_LABEL) {
-		v = find(c, d.name, n.a.s, 0);
-		fixup_label(c, v.goto_label);
-	} else if (kind == N_GOTO) {
-		v = find(c, d.name, n.a.s, 0);
-		if (!v || !v.goto_defined) {
-			die(c, "label not defined");
+
+		if (rhs) {
+			emit_load(c, n.t);
 		}
-		emit_jmp(c, v.goto_label);
-	} else if (kind != N_VARDECL) {
-		compile_expr(c, d, n, 1);
-		emit_pop(c, 1);
-	}
-}
+	} else if (kind == N_IDENT) {
+		v = n.d;
+		if (v.enum_defined) {
+			emit_num(c, v.enum_value);
+		} else if (v.var_defined) {
+			emit_lea(c, v.var_offset);
+			if (rhs) {
+				emit_load(c, n.t);
+			}
+		} else {
+			emit_ptr(c, v.func_label);
+		}
+	} else if (kind == N_ASSIGN) {
+		gen_expr(c, d, n.b, 1);
+		gen_expr(c, d, n.a, 0);
 
-find(c: *compiler, name: *byte, member_name: *byte, make: int): *decl {
-	var p: *decl;
-	var d: *decl;
-	var link: **decl;
-	var dir: int;
+		emit_store(c, n.t);
+	} else if (kind == N_SIZEOF) {
+		out = mklabel(c);
 
-	p = 0: *decl;
-	link = &c.decls;
-	loop {
-		d = *link;
-		if (!d) {
-			break;
-		}
+		emit_jmp(c, out);
 
-		dir = strcmp(name, d.name);
+		gen_expr(c, d, n.a, 0);
 
-		if (dir == 0) {
-			if (!member_name && !d.member_name) {
-				dir = 0;
-			} else if (!member_name) {
-				dir = -1;
-			} else if (!d.member_name) {
-				dir = 1;
-			} else {
-				dir = strcmp(member_name, d.member_name);
-			}
+		fixup_label(c, out);
+
+		if (n.a.t.kind == TY_BYTE) {
+			emit_num(c, 1);
+		} else {
+			emit_num(c, type_sizeof(c, n.a.t));
+		}
+	} else if (kind == N_REF) {
+		gen_expr(c, d, n.a, 0);
+	} else if (kind == N_DEREF) {
+		gen_expr(c, d, n.a, 1);
+
+		if (rhs) {
+			emit_load(c, n.t);
 		}
+	} else if (kind == N_INDEX) {
+		gen_expr(c, d, n.a, 1);
 
-		if (dir < 0) {
-			p = d;
-			link = &d.l;
-		} else if (dir > 0) {
-			p = d;
-			link = &d.r;
+		if (n.t.kind == TY_BYTE) {
+			x = 1;
 		} else {
-			return d;
+			x = type_sizeof(c, n.t);
 		}
-	}
 
+		if (c.opt_fold && rconst(c, n.b, &y) && y >= 0 && y < 0x100000) {
+			emit_op_imm(c, N_ADD, x * y);
+		} else if (c.opt_fold) {
+			gen_expr(c, d, n.b, 1);
+			emit_op_imm(c, N_MUL, x);
+			emit_add(c);
+		} else {
+			gen_expr(c, d, n.b, 1);
+			emit_num(c, x);
+			emit_mul(c);
+			emit_add(c);
+		}
 
-	if (!make) {
-		return 0:*decl;
-	}
+		if (rhs) {
+			emit_load(c, n.t);
+		}
+	} else if (kind == N_BNOT) {
+		no = mklabel(c);
+		out = mklabel(c);
 
-	d = alloc(c, sizeof(*d)): *decl;
+		gen_expr(c, d, n.a, 1);
+
+		emit_jz(c, no);
+		emit_num(c, 0);
+		emit_jmp(c, out);
+		fixup_label(c, no);
+		emit_num(c, 1);
+		fixup_label(c, out);
+	} else if (kind == N_BOR) {
+		no = mklabel(c);
+		out = mklabel(c);
+
+		gen_expr(c, d, n.a, 1);
+		emit_jz(c, no);
+		emit_num(c, 1);
+		emit_jmp(c, out);
+
+		fixup_label(c, no);
+		no = mklabel(c);
+
+		gen_expr(c, d, n.b, 1);
+		emit_jz(c, no);
+		emit_num(c, 1);
+		emit_jmp(c, out);
+
+		fixup_label(c, no);
+		emit_num(c, 0);
+
+		fixup_label(c, out);
+	} else if (kind == N_BAND) {
+		no = mklabel(c);
+		out = mklabel(c);
+
+		gen_expr(c, d, n.a, 1);
+		emit_jz(c, no);
+
+		gen_expr(c, d, n.b, 1);
+		emit_jz(c, no);
+
+		emit_num(c, 1);
+		emit_jmp(c, out);
+
+		fixup_label(c, no);
+		emit_num(c, 0);
+
+		fixup_label(c, out);
+	} else if (kind == N_POS || kind == N_CAST) {
+		gen_expr(c, d, n.a, 1);
+	} else if (kind == N_NEG) {
+		gen_expr(c, d, n.a, 1);
+		emit_neg(c);
+	} else if (kind == N_NOT) {
+		gen_expr(c, d, n.a, 1);
+		emit_not(c);
+	} else if (c.opt_fold && rconst(c, n.b, &x)) {
+		gen_expr(c, d, n.a, 1);
+		emit_op_imm(c, kind, x);
+	} else {
+		gen_expr(c, d, n.b, 1);
+		gen_expr(c, d, n.a, 1);
+
+		if (kind == N_LT) {
+			emit_lt(c);
+		} else if (kind == N_GT) {
+			emit_gt(c);
+		} else if (kind == N_LE) {
+			emit_le(c);
+		} else if (kind == N_GE) {
+			emit_ge(c);
+		} else if (kind == N_EQ) {
+			emit_eq(c);
+		} else if (kind == N_NE) {
+			emit_ne(c);
+		} else if (kind == N_ADD) {
+			emit_add(c);
+		} else if (kind == N_SUB) {
+			emit_sub(c);
+		} else if (kind == N_MUL) {
+			emit_mul(c);
+		} else if (kind == N_DIV) {
+			emit_div(c);
+		} else if (kind == N_MOD) {
+			emit_mod(c);
+		} else if (kind == N_LSH) {
+			emit_lsh(c);
+		} else if (kind == N_RSH) {
+			emit_rsh(c);
+		} else if (kind == N_AND) {
+			emit_and(c);
+		} else if (kind == N_OR) {
+			emit_or(c);
+		} else if (kind == N_XOR) {
+			emit_xor(c);
+		} else {
+			die(c, "not an expression");
+		}
+	}
+}
+
+// Translate an expression
+compile_expr(c: *compiler, d: *decl, n: *node, rhs: int): void {
+	type_expr(c, d, n, rhs);
+	gen_expr(c, d, n, rhs);
+}
+
+// Registers handed out to expression temporaries: rbx, rsi, rdi and r8-r15
+// except r12. rax, rcx and rdx are left as scratch for calls, division and
+// shifts.
+rpool(c: *compiler): int {
+	return 0xefc8;
+}
+
+// Pick a free register, or -1 if they are all in use
+ralloc(c: *compiler, free: int): int {
+	var r: int;
+
+	r = 0;
+	loop {
+		if (r == 16) {
+			return -1;
+		}
+
+		if ((free >> r) & 1) {
+			return r;
+		}
+
+		r = r + 1;
+	}
+}
+
+// Sign extend an immediate the same way push imm32 does
+sext32(x: int): int {
+	x = x & ((1 << 32) - 1);
+	if (x >> 31) {
+		x = x | (-1 << 32);
+	}
+	return x;
+}
+
+// Check for a constant that can be used as an immediate
+rconst(c: *compiler, n: *node, x: *int): int {
+	var kind: int;
+
+	kind = n.kind;
+	if (kind == N_NUM || kind == N_CHAR) {
+		*x = sext32(n.n);
+		return 1;
+	} else if (kind == N_IDENT && n.d.enum_defined) {
+		*x = sext32(n.d.enum_value);
+		return 1;
+	} else if (kind == N_SIZEOF) {
+		if (n.a.t.kind == TY_BYTE) {
+			*x = 1;
+		} else {
+			*x = type_sizeof(c, n.a.t);
+		}
+		return 1;
+	}
+
+	return 0;
+}
+
+// Check for a local variable
+rvar(c: *compiler, n: *node): *decl {
+	if (n.kind != N_IDENT || n.d.enum_defined || !n.d.var_defined) {
+		return 0:*decl;
+	}
+
+	return n.d;
+}
+
+// Check for a local that can be used directly as a memory operand
+rlocal(c: *compiler, n: *node): *decl {
+	if (n.t.kind == TY_BYTE || !type_isprim(c, n.t)) {
+		return 0:*decl;
+	}
+
+	return rvar(c, n);
+}
+
+// Check if evaluating an expression might have side effects
+reffects(c: *compiler, n: *node): int {
+	var kind: int;
+
+	kind = n.kind;
+	if (kind == N_CALL || kind == N_ASSIGN) {
+		return 1;
+	} else if (kind == N_STR || kind == N_NUM || kind == N_CHAR || kind == N_IDENT || kind == N_SIZEOF) {
+		return 0;
+	} else if (kind == N_DOT || kind == N_REF || kind == N_DEREF || kind == N_POS || kind == N_CAST) {
+		return reffects(c, n.a);
+	} else if (kind == N_NEG || kind == N_NOT || kind == N_BNOT) {
+		return reffects(c, n.a);
+	}
+
+	return reffects(c, n.a) || reffects(c, n.b);
+}
+
+rmerge(x: int, y: int): int {
+	if (x == y) {
+		return x + 1;
+	} else if (x > y) {
+		return x;
+	} else {
+		return y;
+	}
+}
+
+// Sethi-Ullman number: how many registers an expression needs
+rneed(c: *compiler, n: *node): int {
+	var kind: int;
+	var x: int;
+	var y: int;
+
+	kind = n.kind;
+	if (kind == N_CALL) {
+		// Calls spill everything live, so get them out of the way first
+		return 16;
+	} else if (kind == N_STR || kind == N_NUM || kind == N_CHAR || kind == N_IDENT || kind == N_SIZEOF) {
+		return 1;
+	} else if (kind == N_DOT || kind == N_REF || kind == N_DEREF || kind == N_POS || kind == N_CAST) {
+		return rneed(c, n.a);
+	} else if (kind == N_NEG || kind == N_NOT || kind == N_BNOT) {
+		return rneed(c, n.a);
+	} else if (kind == N_BAND || kind == N_BOR) {
+		x = rneed(c, n.a);
+		y = rneed(c, n.b);
+		if (y > x) {
+			return y;
+		}
+		return x;
+	} else if (kind == N_ASSIGN) {
+		if (rvar(c, n.a)) {
+			return rneed(c, n.b);
+		}
+	} else if (rconst(c, n.b, &x) || (rlocal(c, n.b) && !reffects(c, n.a))) {
+		return rneed(c, n.a);
+	}
+
+	return rmerge(rneed(c, n.a), rneed(c, n.b));
+}
+
+// Map a comparison to its condition code
+rcc(c: *compiler, kind: int): int {
+	if (kind == N_LT) {
+		return CC_L;
+	} else if (kind == N_GT) {
+		return CC_G;
+	} else if (kind == N_LE) {
+		return CC_LE;
+	} else if (kind == N_GE) {
+		return CC_GE;
+	} else if (kind == N_EQ) {
+		return CC_E;
+	} else if (kind == N_NE) {
+		return CC_NE;
+	}
+
+	return -1;
+}
+
+// Map an operator to its alu instruction
+ralu(c: *compiler, kind: int): int {
+	if (kind == N_ADD) {
+		return ALU_ADD;
+	} else if (kind == N_SUB) {
+		return ALU_SUB;
+	} else if (kind == N_AND) {
+		return ALU_AND;
+	} else if (kind == N_OR) {
+		return ALU_OR;
+	} else if (kind == N_XOR) {
+		return ALU_XOR;
+	} else if (rcc(c, kind) >= 0) {
+		return ALU_CMP;
+	}
+
+	return -1;
+}
+
+// r = r op s
+rop(c: *compiler, kind: int, r: int, s: int): void {
+	var op: int;
+
+	op = ralu(c, kind);
+	if (op >= 0) {
+		emit_alu_rr(c, op, r, s);
+		if (op == ALU_CMP) {
+			emit_setcc_r(c, rcc(c, kind), r);
+		}
+	} else if (kind == N_MUL) {
+		emit_imul_rr(c, r, s);
+	} else if (kind == N_DIV || kind == N_MOD) {
+		emit_mov_rr(c, R_RAX, r);
+		emit_cqo(c);
+		emit_idiv_r(c, s);
+		if (kind == N_DIV) {
+			emit_mov_rr(c, r, R_RAX);
+		} else {
+			emit_mov_rr(c, r, R_RDX);
+		}
+	} else if (kind == N_LSH) {
+		emit_mov_rr(c, R_RCX, s);
+		emit_shl_r(c, r);
+	} else if (kind == N_RSH) {
+		emit_mov_rr(c, R_RCX, s);
+		emit_shr_r(c, r);
+	} else {
+		die(c, "not an expression");
+	}
+}
+
+// Check for a power of two and return its log, or -1
+rlog2(x: int): int {
+	var k: int;
+
+	if (x <= 0) {
+		return -1;
+	}
+
+	k = 0;
+	loop {
+		if ((1 << k) == x) {
+			return k;
+		} else if ((1 << k) > x) {
+			return -1;
+		}
+
+		k = k + 1;
+	}
+}
+
+// Check if r op x leaves r unchanged
+rnop(c: *compiler, kind: int, x: int): int {
+	if (x == 0) {
+		return kind == N_ADD || kind == N_SUB || kind == N_OR || kind == N_XOR || kind == N_LSH || kind == N_RSH;
+	} else if (x == 1) {
+		return kind == N_MUL || kind == N_DIV;
+	}
+
+	return 0;
+}
+
+// r = r / (1 << k) or r = r % (1 << k), rounding towards zero like idiv
+rdiv_pow2(c: *compiler, kind: int, r: int, k: int): void {
+	// Negative dividends are biased by (1 << k) - 1
+	emit_mov_rr(c, R_RCX, r);
+	emit_sar_ri(c, R_RCX, 63);
+	emit_shr_ri(c, R_RCX, 64 - k);
+
+	if (kind == N_DIV) {
+		emit_alu_rr(c, ALU_ADD, r, R_RCX);
+		emit_sar_ri(c, r, k);
+	} else {
+		emit_alu_rr(c, ALU_ADD, R_RCX, r);
+		emit_alu_ri(c, ALU_AND, R_RCX, -(1 << k));
+		emit_alu_rr(c, ALU_SUB, r, R_RCX);
+	}
+}
+
+// r = r op x
+rop_imm(c: *compiler, kind: int, r: int, x: int): void {
+	var op: int;
+	var k: int;
+
+	op = ralu(c, kind);
+	k = rlog2(x);
+	if (c.opt_fold && rnop(c, kind, x)) {
+		return;
+	} else if (op >= 0) {
+		emit_alu_ri(c, op, r, x);
+		if (op == ALU_CMP) {
+			emit_setcc_r(c, rcc(c, kind), r);
+		}
+	} else if (c.opt_fold && kind == N_MUL && k >= 0) {
+		emit_shl_ri(c, r, k);
+	} else if (c.opt_fold && (kind == N_DIV || kind == N_MOD) && k > 0 && k < 31) {
+		rdiv_pow2(c, kind, r, k);
+	} else if (kind == N_MUL) {
+		emit_imul_ri(c, r, r, x);
+	} else if (kind == N_LSH) {
+		emit_shl_ri(c, r, x & 63);
+	} else if (kind == N_RSH) {
+		emit_shr_ri(c, r, x & 63);
+	} else {
+		emit_mov_ri(c, R_RCX, x);
+		rop(c, kind, r, R_RCX);
+	}
+}
+
+// r = r op [rbp + offset]
+rop_mem(c: *compiler, kind: int, r: int, offset: int): void {
+	var op: int;
+
+	op = ralu(c, kind);
+	if (op >= 0) {
+		emit_alu_rm(c, op, r, R_RBP, offset);
+		if (op == ALU_CMP) {
+			emit_setcc_r(c, rcc(c, kind), r);
+		}
+	} else if (kind == N_MUL) {
+		emit_imul_rm(c, r, R_RBP, offset);
+	} else {
+		emit_mov_rm(c, R_RCX, R_RBP, offset);
+		rop(c, kind, r, R_RCX);
+	}
+}
+
+// Evaluate a into r and b into some other register, which is returned.
+// Operands with side effects are evaluated in the same order as the stack
+// backend, otherwise the one needing more registers goes first.
+rgen_pair(c: *compiler, d: *decl, a: *node, b: *node, r: int, free: int, bfirst: int): int {
+	var s: int;
+	var na: int;
+	var nb: int;
+
+	if (!reffects(c, a) || !reffects(c, b)) {
+		na = rneed(c, a);
+		nb = rneed(c, b);
+		if (na > nb) {
+			bfirst = 0;
+		} else if (nb > na) {
+			bfirst = 1;
+		}
+	}
+
+	if (bfirst) {
+		s = ralloc(c, free);
+		if (s < 0) {
+			rgen(c, d, b, r, free);
+			emit_push_r(c, r);
+			rgen(c, d, a, r, free);
+			emit_pop_r(c, R_RCX);
+			return R_RCX;
+		}
+
+		free = free & ~(1 << s);
+		rgen(c, d, b, s, free);
+		rgen(c, d, a, r, free);
+		return s;
+	}
+
+	rgen(c, d, a, r, free);
+	s = ralloc(c, free);
+	if (s < 0) {
+		emit_push_r(c, r);
+		rgen(c, d, b, r, free);
+		emit_mov_rr(c, R_RCX, r);
+		emit_pop_r(c, r);
+		return R_RCX;
+	}
+
+	rgen(c, d, b, s, free & ~(1 << s));
+	return s;
+}
+
+// Push call arguments right to left, skipping those in the late mask
+rgen_args(c: *compiler, d: *decl, n: *node, r: int, i: int, late: int): void {
+	var v: *decl;
+	var x: int;
+
+	if (n.b) {
+		rgen_args(c, d, n.b, r, i + 1, late);
+	}
+
+	if ((late >> i) & 1) {
+		return;
+	}
+
+	v = rlocal(c, n.a);
+	if (rconst(c, n.a, &x)) {
+		emit_num(c, x);
+	} else if (v) {
+		emit_push_m(c, R_RBP, v.var_offset);
+	} else {
+		rgen(c, d, n.a, r, rpool(c) & ~(1 << r));
+		emit_push_r(c, r);
+	}
+}
+
+// Mask of the register arguments that can be loaded straight into their
+// registers after the rest are pushed: constants, and locals that nothing
+// evaluated after them could modify
+rlate(c: *compiler, n: *node, nregs: int, effects: int): int {
+	var late: int;
+	var x: int;
+	var i: int;
+
+	late = 0;
+	i = 0;
+	loop {
+		if (!n || i == nregs) {
+			break;
+		}
+
+		if (rconst(c, n.a, &x) || (!effects && rlocal(c, n.a))) {
+			late = late | (1 << i);
+		}
+
+		effects = effects || reffects(c, n.a);
+		i = i + 1;
+		n = n.b;
+	}
+
+	return late;
+}
+
+// Move the register arguments into place
+rgen_regs(c: *compiler, n: *node, nregs: int, late: int): void {
+	var v: *decl;
+	var x: int;
+	var i: int;
+
+	i = 0;
+	loop {
+		if (i == nregs) {
+			break;
+		}
+
+		v = rlocal(c, n.a);
+		if (!((late >> i) & 1)) {
+			emit_pop_r(c, arg_reg(c, i));
+		} else if (rconst(c, n.a, &x)) {
+			emit_mov_ri(c, arg_reg(c, i), x);
+		} else {
+			emit_mov_rm(c, arg_reg(c, i), R_RBP, v.var_offset);
+		}
+
+		i = i + 1;
+		n = n.b;
+	}
+}
+
+// Save or restore the registers in a mask around a call
+rsave(c: *compiler, mask: int, restore: int): void {
+	var r: int;
+
+	r = 0;
+	loop {
+		if (r == 16) {
+			break;
+		}
+
+		if (restore) {
+			if ((mask >> (15 - r)) & 1) {
+				emit_pop_r(c, 15 - r);
+			}
+		} else {
+			if ((mask >> r) & 1) {
+				emit_push_r(c, r);
+			}
+		}
+
+		r = r + 1;
+	}
+}
+
+// Evaluate the address of an lexpr as [base + disp] and return disp
+rgen_addr(c: *compiler, d: *decl, n: *node, r: int, free: int, base: *int): int {
+	var kind: int;
+	var size: int;
+	var x: int;
+	var s: int;
+
+	kind = n.kind;
+	if (kind == N_IDENT && n.d.var_defined && !n.d.enum_defined) {
+		*base = R_RBP;
+		return n.d.var_offset;
+	} else if (kind == N_DOT) {
+		if (n.a.t.kind == TY_PTR) {
+			rgen(c, d, n.a, r, free);
+			*base = r;
+			return n.d.member_offset;
+		}
+
+		return rgen_addr(c, d, n.a, r, free, base) + n.d.member_offset;
+	} else if (kind == N_INDEX) {
+		if (n.t.kind == TY_BYTE) {
+			size = 1;
+		} else {
+			size = type_sizeof(c, n.t);
+		}
+
+		*base = r;
+
+		if (rconst(c, n.b, &x) && x >= 0 && x < 0x100000) {
+			rgen(c, d, n.a, r, free);
+			return x * size;
+		}
+
+		s = rgen_pair(c, d, n.a, n.b, r, free, 0);
+
+		if (size == 8) {
+			emit_shl_ri(c, s, 3);
+		} else if (size != 1) {
+			emit_imul_ri(c, s, s, size);
+		}
+
+		emit_alu_rr(c, ALU_ADD, r, s);
+
+		return 0;
+	}
+
+	// Otherwise the address is the value of a pointer
+	if (kind == N_DEREF) {
+		n = n.a;
+	}
+
+	rgen(c, d, n, r, free);
+	*base = r;
+	return 0;
+}
+
+// Evaluate an expression into r using only the registers in free
+rgen(c: *compiler, d: *decl, n: *node, r: int, free: int): void {
+	var out: *label;
+	var v: *decl;
+	var kind: int;
+	var base: int;
+	var disp: int;
+	var busy: int;
+	var nregs: int;
+	var late: int;
+	var s: int;
+	var x: int;
+
+	kind = n.kind;
+	if (rconst(c, n, &x)) {
+		emit_mov_ri(c, r, x);
+	} else if (kind == N_STR) {
+		emit_lea_rl(c, r, emit_strlit(c, n.s));
+	} else if (kind == N_IDENT) {
+		v = n.d;
+		if (v.var_defined) {
+			emit_load_rm(c, n.t, r, R_RBP, v.var_offset);
+		} else {
+			emit_lea_rl(c, r, v.func_label);
+		}
+	} else if (kind == N_CALL) {
+		busy = rpool(c) & ~free & ~(1 << r);
+
+		rsave(c, busy, 0);
+
+		x = count_args(c, n.a.t.arg);
+		nregs = arg_regs(c, x);
+		late = 0;
+		if (n.b) {
+			late = rlate(c, n.b, nregs, reffects(c, n.a));
+			rgen_args(c, d, n.b, r, 0, late);
+		}
+
+		x = x - nregs;
+		if (n.a.kind == N_IDENT && !n.a.d.var_defined) {
+			rgen_regs(c, n.b, nregs, late);
+			emit_call_l(c, n.a.d.func_label);
+		} else if (c.opt_regcall) {
+			// r may be an argument register
+			rgen(c, d, n.a, r, rpool(c) & ~(1 << r));
+			emit_mov_rr(c, R_RAX, r);
+			rgen_regs(c, n.b, nregs, late);
+			emit_call_r(c, R_RAX);
+		} else {
+			rgen(c, d, n.a, r, rpool(c) & ~(1 << r));
+			emit_call_r(c, r);
+		}
+
+		if (x) {
+			emit_pop(c, x);
+		}
+
+		emit_mov_rr(c, r, R_RAX);
+
+		rsave(c, busy, 1);
+	} else if (kind == N_DOT || kind == N_DEREF || kind == N_INDEX) {
+		disp = rgen_addr(c, d, n, r, free, &base);
+		emit_load_rm(c, n.t, r, base, disp);
+	} else if (kind == N_REF) {
+		disp = rgen_addr(c, d, n.a, r, free, &base);
+		if (base != r || disp != 0) {
+			emit_lea_rm(c, r, base, disp);
+		}
+	} else if (kind == N_ASSIGN) {
+		v = rvar(c, n.a);
+		if (v) {
+			rgen(c, d, n.b, r, free);
+			emit_store_rm(c, n.t, r, R_RBP, v.var_offset);
+			return;
+		}
+
+		// Compute the address first if it is the bigger side
+		if (!reffects(c, n.a) || !reffects(c, n.b)) {
+			s = ralloc(c, free);
+			if (s >= 0 && rneed(c, n.a) > rneed(c, n.b)) {
+				free = free & ~(1 << s);
+				disp = rgen_addr(c, d, n.a, s, free, &base);
+				rgen(c, d, n.b, r, free);
+				emit_store_rm(c, n.t, r, base, disp);
+				return;
+			}
+		}
+
+		rgen(c, d, n.b, r, free);
+
+		s = ralloc(c, free);
+		if (s < 0) {
+			emit_push_r(c, r);
+			disp = rgen_addr(c, d, n.a, r, free, &base);
+			emit_pop_r(c, R_RCX);
+			emit_store_rm(c, n.t, R_RCX, base, disp);
+			emit_mov_rr(c, r, R_RCX);
+			return;
+		}
+
+		disp = rgen_addr(c, d, n.a, s, free & ~(1 << s), &base);
+		emit_store_rm(c, n.t, r, base, disp);
+	} else if (kind == N_BNOT) {
+		rgen(c, d, n.a, r, free);
+		emit_test_rr(c, r);
+		emit_setcc_r(c, CC_E, r);
+	} else if (kind == N_BAND || kind == N_BOR) {
+		out = mklabel(c);
+
+		rgen(c, d, n.a, r, free);
+		emit_test_rr(c, r);
+		if (kind == N_BAND) {
+			emit_jcc(c, CC_E, out);
+		} else {
+			emit_jcc(c, CC_NE, out);
+		}
+
+		rgen(c, d, n.b, r, free);
+		emit_test_rr(c, r);
+
+		fixup_label(c, out);
+		emit_setcc_r(c, CC_NE, r);
+	} else if (kind == N_POS || kind == N_CAST) {
+		rgen(c, d, n.a, r, free);
+	} else if (kind == N_NEG) {
+		rgen(c, d, n.a, r, free);
+		emit_neg_r(c, r);
+	} else if (kind == N_NOT) {
+		rgen(c, d, n.a, r, free);
+		emit_not_r(c, r);
+	} else {
+		if (rconst(c, n.b, &x)) {
+			rgen(c, d, n.a, r, free);
+			rop_imm(c, kind, r, x);
+			return;
+		}
+
+		v = rlocal(c, n.b);
+		if (v && !reffects(c, n.a)) {
+			rgen(c, d, n.a, r, free);
+			rop_mem(c, kind, r, v.var_offset);
+			return;
+		}
+
+		s = rgen_pair(c, d, n.a, n.b, r, free, 1);
+		rop(c, kind, r, s);
+	}
+}
+
+// Translate an expression into a register with the register backend
+rcompile(c: *compiler, d: *decl, n: *node): int {
+	var r: int;
+
+	type_expr(c, d, n, 1);
+
+	r = ralloc(c, rpool(c));
+	rgen(c, d, n, r, rpool(c) & ~(1 << r));
+
+	return r;
+}
+
+// Evaluate a condition into the flags and return the condition code for true
+gen_test(c: *compiler, d: *decl, n: *node): int {
+	var v: *decl;
+	var cc: int;
+	var r: int;
+	var s: int;
+	var x: int;
+
+	cc = rcc(c, n.kind);
+
+	if (c.opt_regs) {
+		r = ralloc(c, rpool(c));
+
+		if (cc < 0) {
+			rgen(c, d, n, r, rpool(c) & ~(1 << r));
+			emit_test_rr(c, r);
+			return CC_NE;
+		}
+
+		if (rconst(c, n.b, &x)) {
+			rgen(c, d, n.a, r, rpool(c) & ~(1 << r));
+			emit_alu_ri(c, ALU_CMP, r, x);
+			return cc;
+		}
+
+		v = rlocal(c, n.b);
+		if (v && !reffects(c, n.a)) {
+			rgen(c, d, n.a, r, rpool(c) & ~(1 << r));
+			emit_alu_rm(c, ALU_CMP, r, R_RBP, v.var_offset);
+			return cc;
+		}
+
+		s = rgen_pair(c, d, n.a, n.b, r, rpool(c) & ~(1 << r), 1);
+		emit_alu_rr(c, ALU_CMP, r, s);
+		return cc;
+	}
+
+	if (cc < 0) {
+		gen_expr(c, d, n, 1);
+		// pop rax
+		emit_spop(c, R_RAX);
+		emit_test_rr(c, R_RAX);
+		return CC_NE;
+	}
+
+	if (rconst(c, n.b, &x)) {
+		gen_expr(c, d, n.a, 1);
+		// pop rax
+		emit_spop(c, R_RAX);
+		emit_alu_ri(c, ALU_CMP, R_RAX, x);
+		return cc;
+	}
+
+	gen_expr(c, d, n.b, 1);
+	gen_expr(c, d, n.a, 1);
+	// pop rax
+	emit_spop(c, R_RAX);
+	// pop rcx
+	emit_spop(c, R_RCX);
+	emit_alu_rr(c, ALU_CMP, R_RAX, R_RCX);
+	return cc;
+}
+
+// Jump to l when a checked condition is true, or when it is false if sense is 0
+gen_branch(c: *compiler, d: *decl, n: *node, l: *label, sense: int): void {
+	var skip: *label;
+	var kind: int;
+	var cc: int;
+
+	kind = n.kind;
+	if (kind == N_BNOT) {
+		gen_branch(c, d, n.a, l, !sense);
+	} else if ((kind == N_BAND && !sense) || (kind == N_BOR && sense)) {
+		gen_branch(c, d, n.a, l, sense);
+		gen_branch(c, d, n.b, l, sense);
+	} else if (kind == N_BAND || kind == N_BOR) {
+		skip = mklabel(c);
+		gen_branch(c, d, n.a, skip, !sense);
+		gen_branch(c, d, n.b, l, sense);
+		fixup_label(c, skip);
+	} else {
+		cc = gen_test(c, d, n);
+		if (!sense) {
+			cc = cc ^ 1;
+		}
+		emit_jcc(c, cc, l);
+	}
+}
+
+// Find where a block consisting of just a break, continue or goto jumps to
+stmt_target(c: *compiler, d: *decl, n: *node, top: *label, out: *label): *label {
+	var v: *decl;
+
+	if (!n || n.b) {
+		return 0:*label;
+	}
+
+	if (n.a.kind == N_BREAK) {
+		return out;
+	} else if (n.a.kind == N_CONTINUE) {
+		return top;
+	} else if (n.a.kind == N_GOTO) {
+		v = find(c, d.name, n.a.a.s, 0);
+		if (v && v.goto_defined) {
+			return v.goto_label;
+		}
+	}
+
+	return 0:*label;
+}
+
+// Compile a statement
+// Type a statement without generating code, with the same checks that
+// compile_stmt makes
+type_stmt(c: *compiler, d: *decl, n: *node, inloop: int): void {
+	var v: *decl;
+	var kind: int;
+
+	if (!n) {
+		return;
+	}
+
+	c.lineno = n.lineno;
+	c.colno = 0;
+
+	kind = n.kind;
+	if (kind == N_CONDLIST) {
+		loop {
+			if (!n) {
+				break;
+			}
+
+			if (n.a.a) {
+				type_expr(c, d, n.a.a, 1);
+			}
+
+			type_stmt(c, d, n.a.b, inloop);
+
+			n = n.b;
+		}
+	} else if (kind == N_STMTLIST) {
+		loop {
+			if (!n) {
+				break;
+			}
+			type_stmt(c, d, n.a, inloop);
+			n = n.b;
+		}
+	} else if (kind == N_LOOP) {
+		type_stmt(c, d, n.a, 1);
+	} else if (kind == N_BREAK) {
+		if (!inloop) {
+			die(c, "break outside loop");
+		}
+	} else if (kind == N_CONTINUE) {
+		if (!inloop) {
+			die(c, "continue outside loop");
+		}
+	} else if (kind == N_RETURN) {
+		if (n.a) {
+			if (d.func_type.val.kind == TY_VOID) {
+				die(c, "returning a value in a void function");
+			}
+			type_expr(c, d, n.a, 1);
+			unify(c, n.a.t, d.func_type.val);
+		} else if (d.func_type.val.kind != TY_VOID) {
+			die(c, "returning void in a non void function");
+		}
+	} else if (kind == N_GOTO) {
+		v = find(c, d.name, n.a.s, 0);
+		if (!v || !v.goto_defined) {
+			die(c, "label not defined");
+		}
+	} else if (kind != N_LABEL && kind != N_VARDECL) {
+		type_expr(c, d, n, 1);
+	}
+}
+
+compile_stmt(c: *compiler, d: *decl, n: *node, top: *label, out: *label): void {
+	var no: *label;
+	var ifout: *label;
+	var l: *label;
+	var v: *decl;
+	var kind: int;
+	var r: int;
+
+	if (!n) {
+		return;
+	}
+
+	c.lineno = n.lineno;
+	c.colno = 0;
+
+	kind = n.kind;
+	if (kind == N_CONDLIST) {
+		ifout = mklabel(c);
+		no = 0: *label;
+		loop {
+			if (no) {
+				fixup_label(c, no);
+			}
+
+			if (!n) {
+				break;
+			}
+
+			no = mklabel(c);
+
+			if (n.a.a && c.opt_branch) {
+				type_expr(c, d, n.a.a, 1);
+
+				// if (x) { break; } is a single conditional jump
+				l = stmt_target(c, d, n.a.b, top, out);
+				if (l) {
+					gen_branch(c, d, n.a.a, l, 1);
+					no = 0:*label;
+					n = n.b;
+					continue;
+				}
+
+				gen_branch(c, d, n.a.a, no, 0);
+			} else if (n.a.a) {
+				if (c.opt_regs) {
+					r = rcompile(c, d, n.a.a);
+					emit_test_rr(c, r);
+					emit_jcc(c, CC_E, no);
+				} else {
+					compile_expr(c, d, n.a.a, 1);
+					emit_jz(c, no);
+				}
+			}
+
+			compile_stmt(c, d, n.a.b, top, out);
+			emit_jmp(c, ifout);
+
+			n = n.b;
+		}
+		fixup_label(c, ifout);
+	} else if (kind == N_STMTLIST) {
+		loop {
+			if (!n) {
+				break;
+			}
+			compile_stmt(c, d, n.a, top, out);
+			n = n.b;
+		}
+	} else if (kind == N_LOOP) {
+		top = mklabel(c);
+		out = mklabel(c);
+		fixup_label(c, top);
+		compile_stmt(c, d, n.a, top, out);
+		emit_jmp(c, top);
+		fixup_label(c, out);
+	} else if (kind == N_BREAK) {
+		if (!out) {
+			die(c, "break outside loop");
+		}
+		emit_jmp(c, out);
+	} else if (kind == N_CONTINUE) {
+		if (!top) {
+			die(c, "continue outside loop");
+		}
+		emit_jmp(c, top);
+	} else if (kind == N_RETURN) {
+		if (n.a) {
+			if (d.func_type.val.kind == TY_VOID) {
+				die(c, "returning a value in a void function");
+			}
+			if (c.opt_regs) {
+				r = rcompile(c, d, n.a);
+				emit_mov_rr(c, R_RAX, r);
+			} else {
+				compile_expr(c, d, n.a, 1);
+			}
+			unify(c, n.a.t, d.func_type.val);
+		} else {
+			if (d.func_type.val.kind != TY_VOID) {
+				die(c, "returning void in a non void function");
+			}
+			if (c.opt_regs) {
+				emit_mov_ri(c, R_RAX, 0);
+			} else {
+				emit_num(c, 0);
+			}
+		}
+		if (c.opt_regs) {
+			emit_leave(c);
+		} else {
+			emit_ret(c);
+		}
+	} else if (kind == N_LABEL) {
+		v = find(c, d.name, n.a.s, 0);
+		fixup_label(c, v.goto_label);
+	} else if (kind == N_GOTO) {
+		v = find(c, d.name, n.a.s, 0);
+		if (!v || !v.goto_defined) {
+			die(c, "label not defined");
+		}
+		emit_jmp(c, v.goto_label);
+	} else if (kind != N_VARDECL) {
+		if (c.opt_regs) {
+			rcompile(c, d, n);
+		} else {
+			compile_expr(c, d, n, 1);
+			emit_pop(c, 1);
+		}
+	}
+}
+
+// Create a basic block, placed in the layout once it is started
+ir_newblock(c: *compiler): *irblock {
+	var b: *irblock;
+
+	b = alloc(c, sizeof(*b)):*irblock;
+
+	b.next = 0:*irblock;
+	b.first = 0:*irop;
+	b.last = 0:*irop;
+	b.term = IR_NOP;
+	b.cond = 0;
+	b.to = 0:*irblock;
+	b.alt = 0:*irblock;
+	b.label = mklabel(c);
+	b.mark = 0;
+	b.seq = 0;
+
+	return b;
+}
+
+// Make b the current block, falling through to it from the previous one
+ir_start(c: *compiler, b: *irblock): void {
+	if (c.ir_cur && !c.ir_cur.term) {
+		c.ir_cur.term = IR_JMP;
+		c.ir_cur.to = b;
+	}
+
+	if (c.ir_end) {
+		c.ir_end.next = b;
+	} else {
+		c.ir_entry = b;
+	}
+
+	c.ir_end = b;
+	c.ir_cur = b;
+
+	// Blocks are numbered in order, so the body of a loop is a range
+	b.seq = c.ir_seq;
+	c.ir_seq = c.ir_seq + 1;
+}
+
+ir_temp(c: *compiler): int {
+	c.ir_ntemps = c.ir_ntemps + 1;
+	return c.ir_ntemps;
+}
+
+// Create an instruction outside of any block
+ir_mkop(c: *compiler, op: int, k: int, dst: int, a: int, b: int, n: int): *irop {
+	var o: *irop;
+
+	o = alloc(c, sizeof(*o)):*irop;
+
+	o.next = 0:*irop;
+	o.op = op;
+	o.k = k;
+	o.dst = dst;
+	o.a = a;
+	o.b = b;
+	o.n = n;
+	o.t = 0:*type;
+	o.l = 0:*label;
+	o.s = 0:*byte;
+	o.args = 0:*irarg;
+	o.live = 0;
+	o.fused = 0;
+	o.hoist = 0;
+
+	return o;
+}
+
+// Add an instruction to the end of block b
+ir_append(c: *compiler, b: *irblock, o: *irop): void {
+	if (b.last) {
+		b.last.next = o;
+	} else {
+		b.first = o;
+	}
+	b.last = o;
+}
+
+// Append an instruction to the current block
+ir_emit(c: *compiler, op: int, k: int, dst: int, a: int, b: int, n: int): *irop {
+	var o: *irop;
+
+	// Code after a jump is unreachable, give it a block of its own
+	if (c.ir_cur.term) {
+		ir_start(c, ir_newblock(c));
+	}
+
+	o = ir_mkop(c, op, k, dst, a, b, n);
+	ir_append(c, c.ir_cur, o);
+
+	return o;
+}
+
+ir_imm(c: *compiler, x: int): int {
+	var t: int;
+	t = ir_temp(c);
+	ir_emit(c, IR_IMM, 0, t, 0, 0, x);
+	return t;
+}
+
+ir_bin(c: *compiler, k: int, a: int, b: int): int {
+	var t: int;
+	t = ir_temp(c);
+	ir_emit(c, IR_BIN, k, t, a, b, 0);
+	return t;
+}
+
+ir_bini(c: *compiler, k: int, a: int, x: int): int {
+	var t: int;
+	t = ir_temp(c);
+	ir_emit(c, IR_BINI, k, t, a, 0, x);
+	return t;
+}
+
+ir_jmp(c: *compiler, b: *irblock): void {
+	if (!c.ir_cur.term) {
+		c.ir_cur.term = IR_JMP;
+		c.ir_cur.to = b;
+	}
+}
+
+ir_br(c: *compiler, cond: int, yes: *irblock, no: *irblock): void {
+	if (!c.ir_cur.term) {
+		c.ir_cur.term = IR_BR;
+		c.ir_cur.cond = cond;
+		c.ir_cur.to = yes;
+		c.ir_cur.alt = no;
+	}
+}
+
+ir_ret(c: *compiler, a: int): void {
+	if (!c.ir_cur.term) {
+		c.ir_cur.term = IR_RET;
+		c.ir_cur.cond = a;
+	}
+}
+
+// Lower the arguments of a call, returning them in push order
+ir_args(c: *compiler, d: *decl, n: *node): *irarg {
+	var args: *irarg;
+	var arg: *irarg;
+	var p: *irarg;
+
+	args = 0:*irarg;
+	if (n.b) {
+		args = ir_args(c, d, n.b);
+	}
+
+	arg = alloc(c, sizeof(*arg)):*irarg;
+	arg.next = 0:*irarg;
+	arg.t = ir_expr(c, d, n.a);
+
+	if (!args) {
+		return arg;
+	}
+
+	p = args;
+	loop {
+		if (!p.next) {
+			break;
+		}
+		p = p.next;
+	}
+	p.next = arg;
+
+	return args;
+}
+
+// Lower the address of an lexpr to [base + *off], where base 0 is the frame
+ir_addr(c: *compiler, d: *decl, n: *node, off: *int): int {
+	var kind: int;
+	var size: int;
+	var base: int;
+	var x: int;
+	var a: int;
+	var b: int;
+
+	kind = n.kind;
+	if (kind == N_IDENT && n.d.var_defined && !n.d.enum_defined) {
+		*off = n.d.var_offset + c.ir_bias;
+		return 0;
+	} else if (kind == N_DOT) {
+		if (n.a.t.kind == TY_PTR) {
+			*off = n.d.member_offset;
+			return ir_expr(c, d, n.a);
+		}
+
+		base = ir_addr(c, d, n.a, off);
+		*off = *off + n.d.member_offset;
+		return base;
+	} else if (kind == N_INDEX) {
+		if (n.t.kind == TY_BYTE) {
+			size = 1;
+		} else {
+			size = type_sizeof(c, n.t);
+		}
+
+		if (rconst(c, n.b, &x) && x >= 0 && x < 0x100000) {
+			*off = x * size;
+			return ir_expr(c, d, n.a);
+		}
+
+		a = ir_expr(c, d, n.a);
+		b = ir_expr(c, d, n.b);
+
+		if (size != 1) {
+			b = ir_bini(c, N_MUL, b, size);
+		}
+
+		*off = 0;
+		return ir_bin(c, N_ADD, a, b);
+	}
+
+	// Otherwise the address is the value of a pointer
+	if (kind == N_DEREF) {
+		n = n.a;
+	}
+
+	*off = 0;
+	return ir_expr(c, d, n);
+}
+
+// Lower a condition to a branch to yes or no
+ir_cond(c: *compiler, d: *decl, n: *node, yes: *irblock, no: *irblock): void {
+	var mid: *irblock;
+	var kind: int;
+
+	kind = n.kind;
+	if (kind == N_BAND) {
+		mid = ir_newblock(c);
+		ir_cond(c, d, n.a, mid, no);
+		ir_start(c, mid);
+		ir_cond(c, d, n.b, yes, no);
+	} else if (kind == N_BOR) {
+		mid = ir_newblock(c);
+		ir_cond(c, d, n.a, yes, mid);
+		ir_start(c, mid);
+		ir_cond(c, d, n.b, yes, no);
+	} else if (kind == N_BNOT) {
+		ir_cond(c, d, n.a, no, yes);
+	} else {
+		ir_br(c, ir_expr(c, d, n), yes, no);
+	}
+}
+
+// Size of a function body for the inliner, or -1 if it cannot be inlined.
+// Labels belong to one lowering of the body, so bodies with them are kept.
+inline_cost(c: *compiler, n: *node): int {
+	var a: int;
+	var b: int;
+
+	if (!n) {
+		return 0;
+	}
+
+	if (n.kind == N_LABEL || n.kind == N_GOTO) {
+		return -1;
+	}
+
+	a = inline_cost(c, n.a);
+	b = inline_cost(c, n.b);
+	if (a < 0 || b < 0) {
+		return -1;
+	}
+
+	return a + b + 1;
+}
+
+// Count the return statements in a body
+inline_nret(c: *compiler, n: *node): int {
+	if (!n) {
+		return 0;
+	}
+
+	if (n.kind == N_RETURN) {
+		return 1;
+	}
+
+	return inline_nret(c, n.a) + inline_nret(c, n.b);
+}
+
+// Decide whether a call to f should be replaced by its body: small bodies
+// that are not already being inlined, so recursion stops
+ir_inlinable(c: *compiler, f: *decl): int {
+	if (!f.func_def || f.func_inlining || c.ir_depth == 4) {
+		return 0;
+	}
+
+	if (!f.func_cost) {
+		f.func_cost = inline_cost(c, f.func_def.b) + 1;
+		f.func_nret = inline_nret(c, f.func_def.b);
+	}
+
+	return f.func_cost > 0 && f.func_cost <= 16;
+}
+
+// Lower the body of f in place of the call n. The arguments and locals of f
+// get a region of the caller's frame, and returns jump past the body.
+ir_inline(c: *compiler, d: *decl, n: *node, f: *decl): int {
+	var args: *irarg;
+	var arg: *irarg;
+	var t: *type;
+	var o: *irop;
+	var s: *node;
+	var ret: *node;
+	var bias: int;
+	var retb: *irblock;
+	var rett: int;
+	var nargs: int;
+	var size: int;
+	var i: int;
+	var j: int;
+	var x: int;
+	var z: int;
+
+	args = 0:*irarg;
+	if (n.b) {
+		args = ir_args(c, d, n.b);
+	}
+
+	size = (func_frame(c, f) + 7) & ~7;
+	nargs = count_args(c, f.func_type.arg);
+
+	// Lay out the callee's frame below ours, with its arguments at the
+	// usual offsets from the bias. Bodies inlined one after another reuse
+	// the same space.
+	i = nargs - f.func_nregs;
+	size = size + 16 + 8 * i;
+	bias = -(c.ir_frame + 16 + 8 * i);
+	c.ir_frame = c.ir_frame + size;
+	if (c.ir_frame > c.ir_frame_max) {
+		c.ir_frame_max = c.ir_frame;
+	}
+
+	// The arguments are in push order, last first
+	i = nargs - 1;
+	arg = args;
+	loop {
+		if (!arg) {
+			break;
+		}
+
+		t = f.func_type.arg;
+		j = 0;
+		loop {
+			if (j == i) {
+				break;
+			}
+			t = t.arg;
+			j = j + 1;
+		}
+
+		o = ir_emit(c, IR_STORE, 0, 0, 0, arg.t, bias + arg_offset(c, f.func_nregs, i));
+		o.t = t.val;
+
+		arg = arg.next;
+		i = i - 1;
+	}
+
+	// The region is shared, so zero the locals that need it on every entry
+	z = 0;
+	i = 0;
+	loop {
+		if (i == f.func_nzero) {
+			break;
+		}
+
+		if (f.func_zero[i]) {
+			if (!z) {
+				z = ir_imm(c, 0);
+			}
+			o = ir_emit(c, IR_STORE, 0, 0, 0, z, bias - 8 * (f.func_nregs + i + 1));
+			o.t = mktype0(c, TY_INT);
+		}
+
+		i = i + 1;
+	}
+
+	x = c.ir_bias;
+	retb = c.ir_retb;
+	rett = c.ir_rett;
+
+	c.ir_bias = bias;
+	c.ir_depth = c.ir_depth + 1;
+	f.func_inlining = 1;
+
+	// A body ending in its only return produces the value directly
+	s = f.func_def.b;
+	ret = 0:*node;
+	if (f.func_nret == 1 && s && s.kind == N_STMTLIST) {
+		loop {
+			if (!s.b) {
+				break;
+			}
+			s = s.b;
+		}
+		if (s.a.kind == N_RETURN && s.a.a) {
+			ret = s.a;
+		}
+	}
+
+	if (ret) {
+		c.ir_retb = 0:*irblock;
+
+		s = f.func_def.b;
+		loop {
+			if (s.a == ret) {
+				break;
+			}
+			ir_stmt(c, f, s.a, 0:*irblock, 0:*irblock);
+			s = s.b;
+		}
+
+		c.lineno = ret.lineno;
+		type_expr(c, f, ret.a, 1);
+		unify(c, ret.a.t, f.func_type.val);
+		i = ir_expr(c, f, ret.a);
+	} else {
+		c.ir_retb = ir_newblock(c);
+		c.ir_rett = ir_temp(c);
+
+		// Falling off the end returns 0
+		if (f.func_type.val.kind != TY_VOID) {
+			ir_emit(c, IR_IMM, 0, c.ir_rett, 0, 0, 0);
+		}
+
+		ir_stmt(c, f, f.func_def.b, 0:*irblock, 0:*irblock);
+		ir_start(c, c.ir_retb);
+		i = c.ir_rett;
+	}
+
+	f.func_inlining = 0;
+	c.ir_depth = c.ir_depth - 1;
+	c.ir_frame = c.ir_frame - size;
+	c.ir_bias = x;
+	c.ir_retb = retb;
+	c.ir_rett = rett;
+
+	return i;
+}
+
+// Lower a checked expression and return the temporary holding its value
+ir_expr(c: *compiler, d: *decl, n: *node): int {
+	var yes: *irblock;
+	var no: *irblock;
+	var out: *irblock;
+	var args: *irarg;
+	var o: *irop;
+	var kind: int;
+	var base: int;
+	var off: int;
+	var x: int;
+	var a: int;
+	var b: int;
+
+	kind = n.kind;
+	if (rconst(c, n, &x)) {
+		return ir_imm(c, x);
+	} else if (kind == N_STR) {
+		o = ir_emit(c, IR_STR, 0, ir_temp(c), 0, 0, 0);
+		o.s = n.s;
+		return o.dst;
+	} else if (kind == N_IDENT) {
+		if (n.d.var_defined) {
+			o = ir_emit(c, IR_LOAD, 0, ir_temp(c), 0, 0, n.d.var_offset + c.ir_bias);
+			o.t = n.t;
+		} else {
+			o = ir_emit(c, IR_ADDR, 0, ir_temp(c), 0, 0, 0);
+			o.l = n.d.func_label;
+		}
+		return o.dst;
+	} else if (kind == N_CALL) {
+		if (c.opt_inline && n.a.kind == N_IDENT && !n.a.d.var_defined && ir_inlinable(c, n.a.d)) {
+			return ir_inline(c, d, n, n.a.d);
+		}
+
+		args = 0:*irarg;
+		if (n.b) {
+			args = ir_args(c, d, n.b);
+		}
+
+		a = 0;
+		if (n.a.kind != N_IDENT || n.a.d.var_defined) {
+			a = ir_expr(c, d, n.a);
+		}
+
+		o = ir_emit(c, IR_CALL, 0, ir_temp(c), a, 0, count_args(c, n.a.t.arg));
+		o.args = args;
+		if (!a) {
+			o.l = n.a.d.func_label;
+		}
+		return o.dst;
+	} else if (kind == N_DOT || kind == N_DEREF || kind == N_INDEX) {
+		base = ir_addr(c, d, n, &off);
+		o = ir_emit(c, IR_LOAD, 0, ir_temp(c), base, 0, off);
+		o.t = n.t;
+		return o.dst;
+	} else if (kind == N_REF) {
+		base = ir_addr(c, d, n.a, &off);
+		if (!base) {
+			o = ir_emit(c, IR_LEA, 0, ir_temp(c), 0, 0, off);
+			return o.dst;
+		} else if (off) {
+			return ir_bini(c, N_ADD, base, off);
+		}
+		return base;
+	} else if (kind == N_ASSIGN) {
+		b = ir_expr(c, d, n.b);
+		base = ir_addr(c, d, n.a, &off);
+		o = ir_emit(c, IR_STORE, 0, 0, base, b, off);
+		o.t = n.t;
+		return b;
+	} else if (kind == N_BNOT) {
+		return ir_bini(c, N_EQ, ir_expr(c, d, n.a), 0);
+	} else if (kind == N_BAND || kind == N_BOR) {
+		yes = ir_newblock(c);
+		no = ir_newblock(c);
+		out = ir_newblock(c);
+
+		x = ir_temp(c);
+
+		ir_cond(c, d, n, yes, no);
+
+		ir_start(c, yes);
+		ir_emit(c, IR_IMM, 0, x, 0, 0, 1);
+		ir_jmp(c, out);
+
+		ir_start(c, no);
+		ir_emit(c, IR_IMM, 0, x, 0, 0, 0);
+
+		ir_start(c, out);
+		return x;
+	} else if (kind == N_POS || kind == N_CAST) {
+		return ir_expr(c, d, n.a);
+	} else if (kind == N_NEG || kind == N_NOT) {
+		a = ir_expr(c, d, n.a);
+		o = ir_emit(c, IR_UN, kind, ir_temp(c), a, 0, 0);
+		return o.dst;
+	}
+
+	if (rconst(c, n.b, &x)) {
+		return ir_bini(c, kind, ir_expr(c, d, n.a), x);
+	}
+
+	b = ir_expr(c, d, n.b);
+	a = ir_expr(c, d, n.a);
+
+	return ir_bin(c, kind, a, b);
+}
+
+// Record a loop whose body is the blocks numbered lo up to hi. Inner loops
+// end first, so they come before the loops around them.
+ir_addloop(c: *compiler, lo: int, hi: int): void {
+	var l: *irloop;
+	var p: *irloop;
+
+	l = alloc(c, sizeof(*l)):*irloop;
+
+	l.next = 0:*irloop;
+	l.lo = lo;
+	l.hi = hi;
+	l.pre = 0:*irblock;
+	l.calls = 0;
+	l.stores = 0:**irop;
+	l.nstores = 0;
+	l.pins = 0;
+
+	if (!c.ir_loops) {
+		c.ir_loops = l;
+		return;
+	}
+
+	p = c.ir_loops;
+	loop {
+		if (!p.next) {
+			break;
+		}
+		p = p.next;
+	}
+	p.next = l;
+}
+
+// Lower a statement
+ir_stmt(c: *compiler, d: *decl, n: *node, top: *irblock, out: *irblock): void {
+	var no: *irblock;
+	var body: *irblock;
+	var ifout: *irblock;
+	var v: *decl;
+	var kind: int;
+
+	if (!n) {
+		return;
+	}
+
+	c.lineno = n.lineno;
+	c.colno = 0;
+
+	kind = n.kind;
+	if (kind == N_CONDLIST) {
+		ifout = ir_newblock(c);
+		loop {
+			if (!n) {
+				break;
+			}
+
+			no = ir_newblock(c);
+
+			if (n.a.a) {
+				type_expr(c, d, n.a.a, 1);
+				body = ir_newblock(c);
+				ir_cond(c, d, n.a.a, body, no);
+				ir_start(c, body);
+			}
+
+			ir_stmt(c, d, n.a.b, top, out);
+			ir_jmp(c, ifout);
+
+			ir_start(c, no);
+
+			n = n.b;
+		}
+		ir_start(c, ifout);
+	} else if (kind == N_STMTLIST) {
+		loop {
+			if (!n) {
+				break;
+			}
+			ir_stmt(c, d, n.a, top, out);
+			n = n.b;
+		}
+	} else if (kind == N_LOOP) {
+		top = ir_newblock(c);
+		out = ir_newblock(c);
+		ir_start(c, top);
+		ir_stmt(c, d, n.a, top, out);
+		ir_jmp(c, top);
+		ir_start(c, out);
+		ir_addloop(c, top.seq, out.seq);
+	} else if (kind == N_BREAK) {
+		if (!out) {
+			die(c, "break outside loop");
+		}
+		ir_jmp(c, out);
+	} else if (kind == N_CONTINUE) {
+		if (!top) {
+			die(c, "continue outside loop");
+		}
+		ir_jmp(c, top);
+	} else if (kind == N_RETURN) {
+		if (n.a) {
+			if (d.func_type.val.kind == TY_VOID) {
+				die(c, "returning a value in a void function");
+			}
+			type_expr(c, d, n.a, 1);
+			unify(c, n.a.t, d.func_type.val);
+			if (c.ir_retb) {
+				// Return from an inlined body to the caller
+				ir_emit(c, IR_MOV, 0, c.ir_rett, ir_expr(c, d, n.a), 0, 0);
+				ir_jmp(c, c.ir_retb);
+			} else {
+				ir_ret(c, ir_expr(c, d, n.a));
+			}
+		} else {
+			if (d.func_type.val.kind != TY_VOID) {
+				die(c, "returning void in a non void function");
+			}
+			if (c.ir_retb) {
+				ir_jmp(c, c.ir_retb);
+			} else {
+				ir_ret(c, 0);
+			}
+		}
+	} else if (kind == N_LABEL) {
+		v = find(c, d.name, n.a.s, 0);
+		if (!v.goto_block) {
+			v.goto_block = ir_newblock(c);
+		}
+		ir_start(c, v.goto_block);
+	} else if (kind == N_GOTO) {
+		v = find(c, d.name, n.a.s, 0);
+		if (!v || !v.goto_defined) {
+			die(c, "label not defined");
+		}
+		if (!v.goto_block) {
+			v.goto_block = ir_newblock(c);
+		}
+		ir_jmp(c, v.goto_block);
+	} else if (kind != N_VARDECL) {
+		type_expr(c, d, n, 1);
+		ir_expr(c, d, n);
+	}
+}
+
+// Skip over blocks that do nothing but jump
+ir_thread(c: *compiler, b: *irblock): *irblock {
+	var i: int;
+
+	i = 0;
+	loop {
+		if (b.first || b.term != IR_JMP || b.to == b || i == 16) {
+			return b;
+		}
+
+		b = b.to;
+		i = i + 1;
+	}
+}
+
+// Mark the blocks reachable from b
+ir_mark(c: *compiler, b: *irblock): void {
+	loop {
+		if (!b || b.mark) {
+			return;
+		}
+
+		b.mark = 1;
+
+		if (b.term == IR_BR) {
+			ir_mark(c, b.alt);
+		}
+
+		if (b.term == IR_JMP || b.term == IR_BR) {
+			b = b.to;
+		} else {
+			b = 0:*irblock;
+		}
+	}
+}
+
+// Clean up the control flow graph
+ir_simplify(c: *compiler): void {
+	var b: *irblock;
+	var p: *irblock;
+
+	// Thread jumps through empty blocks
+	b = c.ir_entry;
+	loop {
+		if (!b) {
+			break;
+		}
+
+		if (b.term == IR_JMP || b.term == IR_BR) {
+			b.to = ir_thread(c, b.to);
+		}
+
+		if (b.term == IR_BR) {
+			b.alt = ir_thread(c, b.alt);
+			if (b.to == b.alt) {
+				b.term = IR_JMP;
+				b.cond = 0;
+			}
+		}
+
+		b = b.next;
+	}
+
+	// Drop unreachable blocks
+	ir_mark(c, c.ir_entry);
+
+	p = c.ir_entry;
+	b = p.next;
+	loop {
+		if (!b) {
+			break;
+		}
+
+		if (b.mark) {
+			p.next = b;
+			p = b;
+		}
+
+		b = b.next;
+	}
+	p.next = 0:*irblock;
+	c.ir_end = p;
+}
+
+// Whether block b is part of loop l
+ir_inloop(l: *irloop, b: *irblock): int {
+	return b.seq >= l.lo && b.seq < l.hi;
+}
+
+// Give a loop a block that runs before every entry, or return 0 if the loop
+// can be entered other than through its first block
+ir_preheader(c: *compiler, l: *irloop): *irblock {
+	var pre: *irblock;
+	var h: *irblock;
+	var p: *irblock;
+	var b: *irblock;
+
+	p = 0:*irblock;
+	h = c.ir_entry;
+	loop {
+		if (!h || ir_inloop(l, h)) {
+			break;
+		}
+		p = h;
+		h = h.next;
+	}
+
+	if (!h || !p) {
+		return 0:*irblock;
+	}
+
+	b = c.ir_entry;
+	loop {
+		if (!b) {
+			break;
+		}
+
+		if (!ir_inloop(l, b)) {
+			if ((b.term == IR_JMP || b.term == IR_BR) && b.to != h && ir_inloop(l, b.to)) {
+				return 0:*irblock;
+			}
+			if (b.term == IR_BR && b.alt != h && ir_inloop(l, b.alt)) {
+				return 0:*irblock;
+			}
+		}
+
+		b = b.next;
+	}
+
+	// Number it just before the loop, so it is inside exactly the loops
+	// around this one
+	pre = ir_newblock(c);
+	pre.term = IR_JMP;
+	pre.to = h;
+	pre.mark = 1;
+	pre.seq = l.lo - 1;
+
+	b = c.ir_entry;
+	loop {
+		if (!b) {
+			break;
+		}
+
+		if (!ir_inloop(l, b)) {
+			if (b.to == h) {
+				b.to = pre;
+			}
+			if (b.alt == h) {
+				b.alt = pre;
+			}
+		}
+
+		b = b.next;
+	}
+
+	pre.next = h;
+	p.next = pre;
+	l.pre = pre;
+
+	return pre;
+}
+
+// Count the definitions and uses of each temporary
+ir_defs(c: *compiler): void {
+	var b: *irblock;
+	var o: *irop;
+	var arg: *irarg;
+	var i: int;
+	var n: int;
+
+	n = (c.ir_ntemps + 1) * sizeof(i);
+	c.ir_ndef = alloc(c, n):*int;
+	c.ir_def = alloc(c, n):**irop;
+	c.ir_defb = alloc(c, n):**irblock;
+	c.ir_uses = alloc(c, n):*int;
+
+	i = 0;
+	loop {
+		if (i > c.ir_ntemps) {
+			break;
+		}
+
+		c.ir_ndef[i] = 0;
+		c.ir_def[i] = 0:*irop;
+		c.ir_defb[i] = 0:*irblock;
+		c.ir_uses[i] = 0;
+
+		i = i + 1;
+	}
+
+	b = c.ir_entry;
+	loop {
+		if (!b) {
+			break;
+		}
+
+		o = b.first;
+		loop {
+			if (!o) {
+				break;
+			}
+
+			c.ir_uses[o.a] = c.ir_uses[o.a] + 1;
+			c.ir_uses[o.b] = c.ir_uses[o.b] + 1;
+
+			arg = o.args;
+			loop {
+				if (!arg) {
+					break;
+				}
+				c.ir_uses[arg.t] = c.ir_uses[arg.t] + 1;
+				arg = arg.next;
+			}
+
+			if (o.dst) {
+				c.ir_ndef[o.dst] = c.ir_ndef[o.dst] + 1;
+				c.ir_def[o.dst] = o;
+				c.ir_defb[o.dst] = b;
+			}
+
+			o = o.next;
+		}
+
+		if (b.term == IR_BR || b.term == IR_RET) {
+			c.ir_uses[b.cond] = c.ir_uses[b.cond] + 1;
+		}
+
+		b = b.next;
+	}
+}
+
+// Find the calls and stores in a loop
+ir_effects(c: *compiler, l: *irloop): void {
+	var b: *irblock;
+	var o: *irop;
+	var n: int;
+
+	n = 0;
+	b = l.pre.next;
+	loop {
+		if (!b || !ir_inloop(l, b)) {
+			break;
+		}
+
+		o = b.first;
+		loop {
+			if (!o) {
+				break;
+			}
+
+			if (o.op == IR_CALL) {
+				l.calls = 1;
+			} else if (o.op == IR_STORE) {
+				n = n + 1;
+			}
+
+			o = o.next;
+		}
+
+		b = b.next;
+	}
+
+	l.stores = alloc(c, n * sizeof(o)):**irop;
+
+	b = l.pre.next;
+	loop {
+		if (!b || !ir_inloop(l, b)) {
+			break;
+		}
+
+		o = b.first;
+		loop {
+			if (!o) {
+				break;
+			}
+
+			if (o.op == IR_STORE) {
+				l.stores[l.nstores] = o;
+				l.nstores = l.nstores + 1;
+			}
+
+			o = o.next;
+		}
+
+		b = b.next;
+	}
+}
+
+// Whether a store in the loop may change the value loaded by o
+ir_clobbered(c: *compiler, l: *irloop, o: *irop): int {
+	var s: *irop;
+	var i: int;
+
+	if (l.calls && (o.a || c.ir_lea)) {
+		return 1;
+	}
+
+	i = 0;
+	loop {
+		if (i == l.nstores) {
+			return 0;
+		}
+
+		s = l.stores[i];
+		if (!s.a && !o.a) {
+			if (s.n > o.n - 8 && s.n < o.n + 8) {
+				return 1;
+			}
+		} else if (s.a && o.a) {
+			if (!ir_same(c, l, s.a, o.a) || (s.n < o.n + ir_width(c, o) && o.n < s.n + ir_width(c, s))) {
+				return 1;
+			}
+		} else if (c.ir_lea) {
+			return 1;
+		}
+
+		i = i + 1;
+	}
+}
+
+// Whether temporary t holds the same value on every iteration of the loop
+ir_outside(c: *compiler, l: *irloop, t: int): int {
+	if (c.ir_ndef[t] != 1) {
+		return 0;
+	}
+
+	return !ir_inloop(l, c.ir_defb[t]) || c.ir_def[t].hoist;
+}
+
+// A name for the value of t, the same for every load of a variable
+ir_key(c: *compiler, t: int): int {
+	var o: *irop;
+
+	o = c.ir_def[t];
+	if (c.ir_ndef[t] == 1 && o.op == IR_LOAD && !o.a) {
+		return o.n * 2 + 1;
+	}
+
+	return t * 2;
+}
+
+// The number of bytes a load or store touches
+ir_width(c: *compiler, o: *irop): int {
+	if (o.t && o.t.kind == TY_BYTE) {
+		return 1;
+	}
+
+	return 8;
+}
+
+// Whether temporaries a and b hold the same address everywhere in the loop,
+// either by being the same value or by loading a variable the loop does not
+// change
+ir_same(c: *compiler, l: *irloop, a: int, b: int): int {
+	var s: *irop;
+	var key: int;
+	var n: int;
+	var i: int;
+
+	if (c.ir_ndef[a] != 1 || c.ir_ndef[b] != 1) {
+		return 0;
+	}
+
+	if (a == b) {
+		return 1;
+	}
+
+	key = ir_key(c, a);
+	if (!(key & 1) || key != ir_key(c, b)) {
+		return 0;
+	}
+
+	if (!ir_inloop(l, c.ir_defb[a]) || !ir_inloop(l, c.ir_defb[b])) {
+		return 0;
+	}
+
+	if (l.calls && c.ir_lea) {
+		return 0;
+	}
+
+	n = c.ir_def[a].n;
+	i = 0;
+	loop {
+		if (i == l.nstores) {
+			return 1;
+		}
+
+		s = l.stores[i];
+		if (s.a) {
+			if (c.ir_lea) {
+				return 0;
+			}
+		} else if (s.n > n - 8 && s.n < n + 8) {
+			return 0;
+		}
+
+		i = i + 1;
+	}
+}
+
+// Whether the loop header touches all the memory o loads before it calls
+// anything, so loading it ahead of the loop can not fault where the loop
+// would not
+ir_safe(c: *compiler, l: *irloop, o: *irop): int {
+	var x: *irop;
+
+	x = l.pre.next.first;
+	loop {
+		if (!x || x.op == IR_CALL) {
+			return 0;
+		}
+
+		if ((x.op == IR_LOAD || x.op == IR_STORE) && x.a && ir_same(c, l, x.a, o.a)) {
+			if (x.n <= o.n && o.n + ir_width(c, o) <= x.n + ir_width(c, x)) {
+				return 1;
+			}
+		}
+
+		x = x.next;
+	}
+}
+
+// Instructions cheap enough to recompute in the loop unless others need them
+ir_cheap(c: *compiler, o: *irop): int {
+	return o.op == IR_IMM || o.op == IR_LEA || o.op == IR_ADDR || o.op == IR_STR;
+}
+
+// Whether o is only worth moving along with an instruction using it. Values
+// moved out of loops that call functions end up in the frame, where loading
+// them costs as much as loading a variable.
+ir_follows(c: *compiler, l: *irloop, o: *irop): int {
+	return ir_cheap(c, o) || (l.calls && o.op == IR_LOAD && !o.a);
+}
+
+// Whether o computes the same value on every iteration of the loop
+ir_invariant(c: *compiler, l: *irloop, o: *irop): int {
+	var op: int;
+
+	if (!o.dst || c.ir_ndef[o.dst] != 1) {
+		return 0;
+	}
+
+	op = o.op;
+	if (ir_cheap(c, o)) {
+		return 1;
+	} else if (op == IR_MOV || op == IR_UN) {
+		return ir_outside(c, l, o.a);
+	} else if (op == IR_BINI) {
+		return o.k != N_DIV && o.k != N_MOD && ir_outside(c, l, o.a);
+	} else if (op == IR_BIN) {
+		return o.k != N_DIV && o.k != N_MOD && ir_outside(c, l, o.a) && ir_outside(c, l, o.b);
+	} else if (op == IR_LOAD) {
+		if (o.a && (!ir_outside(c, l, o.a) || !ir_safe(c, l, o))) {
+			return 0;
+		}
+		return !ir_clobbered(c, l, o);
+	}
+
+	return 0;
+}
+
+// Move the instructions whose value does not change out of the loop
+ir_licm(c: *compiler, l: *irloop): void {
+	var pre: *irblock;
+	var b: *irblock;
+	var o: *irop;
+	var prev: *irop;
+	var next: *irop;
+	var n: int;
+
+	pre = l.pre;
+
+	// Operands come before their uses, so one pass finds everything
+	n = 0;
+	b = pre.next;
+	loop {
+		if (!b || !ir_inloop(l, b)) {
+			break;
+		}
+
+		o = b.first;
+		loop {
+			if (!o) {
+				break;
+			}
+
+			if (ir_invariant(c, l, o)) {
+				o.hoist = 1;
+				n = n + 1;
+			}
+
+			o = o.next;
+		}
+
+		b = b.next;
+	}
+
+	if (!n) {
+		return;
+	}
+
+	// Some values only move along with an instruction using them
+	b = pre.next;
+	loop {
+		if (!b || !ir_inloop(l, b)) {
+			break;
+		}
+
+		o = b.first;
+		loop {
+			if (!o) {
+				break;
+			}
+
+			if (o.hoist && !ir_follows(c, l, o)) {
+				if (o.a && ir_follows(c, l, c.ir_def[o.a]) && c.ir_def[o.a].hoist) {
+					c.ir_def[o.a].hoist = 2;
+				}
+				if (o.b && ir_follows(c, l, c.ir_def[o.b]) && c.ir_def[o.b].hoist) {
+					c.ir_def[o.b].hoist = 2;
+				}
+			}
+
+			o = o.next;
+		}
+
+		b = b.next;
+	}
+
+	b = pre.next;
+	loop {
+		if (!b || !ir_inloop(l, b)) {
+			break;
+		}
+
+		prev = 0:*irop;
+		o = b.first;
+		loop {
+			if (!o) {
+				break;
+			}
+
+			next = o.next;
+
+			if ((o.hoist == 1 && !ir_follows(c, l, o)) || o.hoist == 2) {
+				if (prev) {
+					prev.next = next;
+				} else {
+					b.first = next;
+				}
+				o.next = 0:*irop;
+				ir_append(c, pre, o);
+			} else {
+				prev = o;
+			}
+
+			o.hoist = 0;
+			o = next;
+		}
+		b.last = prev;
+
+		b = b.next;
+	}
+}
+
+// The single definition of t if it is in block b
+ir_local(c: *compiler, b: *irblock, t: int): *irop {
+	if (c.ir_ndef[t] != 1 || c.ir_defb[t] != b) {
+		return 0:*irop;
+	}
+
+	return c.ir_def[t];
+}
+
+// Whether something between from and to might store to the variable at n
+ir_stored(c: *compiler, from: *irop, to: *irop, n: int): int {
+	var o: *irop;
+
+	o = from.next;
+	loop {
+		if (!o) {
+			return 1;
+		}
+
+		if (o == to) {
+			return 0;
+		}
+
+		if (o.op == IR_STORE && !o.a && o.n > n - 8 && o.n < n + 8) {
+			return 1;
+		}
+
+		o = o.next;
+	}
+}
+
+// Whether the variable at n only changes in the loop by adding constants
+ir_isiv(c: *compiler, l: *irloop, n: int): int {
+	var s: *irop;
+	var v: *irop;
+	var x: *irop;
+	var i: int;
+	var k: int;
+
+	k = 0;
+	i = 0;
+	loop {
+		if (i == l.nstores) {
+			break;
+		}
+
+		s = l.stores[i];
+		if (!s.a && s.n > n - 8 && s.n < n + 8) {
+			if (s.n != n || s.t.kind == TY_BYTE || c.ir_ndef[s.b] != 1) {
+				return 0;
+			}
+
+			v = c.ir_def[s.b];
+			if (v.op != IR_BINI || (v.k != N_ADD && v.k != N_SUB) || c.ir_ndef[v.a] != 1) {
+				return 0;
+			}
+
+			x = c.ir_def[v.a];
+			if (x.op != IR_LOAD || x.a || x.n != n || ir_stored(c, x, s, n)) {
+				return 0;
+			}
+
+			k = k + 1;
+		}
+
+		i = i + 1;
+	}
+
+	return k != 0;
+}
+
+// Step p along with every store to the induction variable at n
+ir_ivstep(c: *compiler, l: *irloop, n: int, p: int, size: int): void {
+	var b: *irblock;
+	var o: *irop;
+	var v: *irop;
+	var x: *irop;
+
+	b = l.pre.next;
+	loop {
+		if (!b || !ir_inloop(l, b)) {
+			break;
+		}
+
+		o = b.first;
+		loop {
+			if (!o) {
+				break;
+			}
+
+			if (o.op == IR_STORE && !o.a && o.n == n) {
+				v = c.ir_def[o.b];
+				x = ir_mkop(c, IR_BINI, v.k, p, p, 0, v.n * size);
+				x.next = o.next;
+				o.next = x;
+				if (b.last == o) {
+					b.last = x;
+				}
+				o = x;
+			}
+
+			o = o.next;
+		}
+
+		b = b.next;
+	}
+}
+
+// Replace base + i * size, where i is an induction variable, with a pointer
+// that steps along with i
+ir_ivsr(c: *compiler, l: *irloop): void {
+	var pre: *irblock;
+	var b: *irblock;
+	var o: *irop;
+	var m: *irop;
+	var x: *irop;
+	var q: *irop;
+	var arg: *irarg;
+	var cache: *int;
+	var ncache: int;
+	var size: int;
+	var p: int;
+	var i: int;
+
+	// The pointer would live in the frame across calls, which costs more than
+	// it saves. Stores through pointers might change a variable whose
+	// address is taken.
+	if (l.calls) {
+		return;
+	}
+
+	i = 0;
+	loop {
+		if (i == l.nstores) {
+			break;
+		}
+		if (c.ir_lea && l.stores[i].a) {
+			return;
+		}
+		i = i + 1;
+	}
+
+	pre = l.pre;
+	cache = alloc(c, 4 * 16 * sizeof(i)):*int;
+	ncache = 0;
+
+	b = pre.next;
+	loop {
+		if (!b || !ir_inloop(l, b)) {
+			break;
+		}
+
+		o = b.first;
+		loop {
+			if (!o) {
+				break;
+			}
+
+			// Find base + i * size, or base + i for bytes
+			x = 0:*irop;
+			size = 1;
+			if (o.op == IR_BIN && o.k == N_ADD && c.ir_ndef[o.dst] == 1 && ir_outside(c, l, o.a)) {
+				m = ir_local(c, b, o.b);
+				x = m;
+				if (m && m.op == IR_BINI && m.k == N_MUL) {
+					size = m.n;
+					x = ir_local(c, b, m.a);
+				}
+			}
+
+			if (x && x.op == IR_LOAD && !x.a && x.t.kind != TY_BYTE && !ir_stored(c, x, o, x.n) && ir_isiv(c, l, x.n)) {
+				// Share the pointer between uses of the same array
+				p = 0;
+				i = 0;
+				loop {
+					if (i == ncache) {
+						break;
+					}
+					if (cache[4 * i] == x.n && cache[4 * i + 1] == size && cache[4 * i + 2] == o.a) {
+						p = cache[4 * i + 3];
+						break;
+					}
+					i = i + 1;
+				}
+
+				if (!p && ncache < 16) {
+					q = ir_mkop(c, IR_LOAD, 0, ir_temp(c), 0, 0, x.n);
+					q.t = x.t;
+					ir_append(c, pre, q);
+					p = q.dst;
+
+					if (size != 1) {
+						q = ir_mkop(c, IR_BINI, N_MUL, ir_temp(c), p, 0, size);
+						ir_append(c, pre, q);
+						p = q.dst;
+					}
+
+					q = ir_mkop(c, IR_BIN, N_ADD, ir_temp(c), o.a, p, 0);
+					ir_append(c, pre, q);
+					p = q.dst;
+
+					ir_ivstep(c, l, x.n, p, size);
+
+					cache[4 * ncache] = x.n;
+					cache[4 * ncache + 1] = size;
+					cache[4 * ncache + 2] = o.a;
+					cache[4 * ncache + 3] = p;
+					ncache = ncache + 1;
+				}
+
+				if (p) {
+					o.op = IR_MOV;
+					o.k = 0;
+					o.a = p;
+					o.b = 0;
+
+					// Use the pointer directly until the variable changes
+					q = o.next;
+					loop {
+						if (!q || (q.op == IR_STORE && !q.a && q.n > x.n - 8 && q.n < x.n + 8)) {
+							break;
+						}
+
+						if (q.a == o.dst) {
+							q.a = p;
+						}
+						if (q.b == o.dst) {
+							q.b = p;
+						}
+
+						arg = q.args;
+						loop {
+							if (!arg) {
+								break;
+							}
+							if (arg.t == o.dst) {
+								arg.t = p;
+							}
+							arg = arg.next;
+						}
+
+						q = q.next;
+					}
+				}
+			}
+
+			o = o.next;
+		}
+
+		b = b.next;
+	}
+}
+
+// Instructions that can be dropped if nothing uses their value
+ir_pure(c: *compiler, o: *irop): int {
+	if (o.op == IR_BIN || o.op == IR_BINI) {
+		return o.k != N_DIV && o.k != N_MOD;
+	}
+
+	return ir_cheap(c, o) || o.op == IR_LOAD || o.op == IR_MOV || o.op == IR_UN;
+}
+
+// Drop instructions whose values are never used
+ir_dce(c: *compiler): void {
+	var b: *irblock;
+	var o: *irop;
+	var prev: *irop;
+	var n: int;
+
+	loop {
+		ir_defs(c);
+
+		n = 0;
+		b = c.ir_entry;
+		loop {
+			if (!b) {
+				break;
+			}
+
+			prev = 0:*irop;
+			o = b.first;
+			loop {
+				if (!o) {
+					break;
+				}
+
+				if (o.dst && !c.ir_uses[o.dst] && ir_pure(c, o)) {
+					if (prev) {
+						prev.next = o.next;
+					} else {
+						b.first = o.next;
+					}
+					n = n + 1;
+				} else {
+					prev = o;
+				}
+
+				o = o.next;
+			}
+			b.last = prev;
+
+			b = b.next;
+		}
+
+		if (!n) {
+			break;
+		}
+	}
+}
+
+// Hoist loop invariant code and strength reduce induction variables,
+// innermost loops first
+ir_loops(c: *compiler): void {
+	var l: *irloop;
+	var b: *irblock;
+	var o: *irop;
+
+	// Stores through pointers might reach variables whose address is taken
+	c.ir_lea = 0;
+	b = c.ir_entry;
+	loop {
+		if (!b) {
+			break;
+		}
+
+		o = b.first;
+		loop {
+			if (!o) {
+				break;
+			}
+			if (o.op == IR_LEA) {
+				c.ir_lea = 1;
+			}
+			o = o.next;
+		}
+
+		b = b.next;
+	}
+
+	l = c.ir_loops;
+	loop {
+		if (!l) {
+			break;
+		}
+
+		if (ir_preheader(c, l)) {
+			ir_effects(c, l);
+			ir_defs(c);
+			ir_licm(c, l);
+			ir_defs(c);
+			ir_ivsr(c, l);
+		}
+
+		l = l.next;
+	}
+
+	ir_dce(c);
+}
+
+// The registers given to values that live through loops around block b
+ir_pinmask(c: *compiler, b: *irblock): int {
+	var l: *irloop;
+	var mask: int;
+
+	mask = 0;
+	l = c.ir_loops;
+	loop {
+		if (!l) {
+			break;
+		}
+
+		if (b.seq >= l.lo - 1 && b.seq < l.hi) {
+			mask = mask | l.pins;
+		}
+
+		l = l.next;
+	}
+
+	return mask;
+}
+
+// Keep values computed before a loop in registers for the whole loop, as
+// long as the loop makes no calls that would need them saved
+ir_pins(c: *compiler): void {
+	var l: *irloop;
+	var m: *irloop;
+	var b: *irblock;
+	var o: *irop;
+	var arg: *irarg;
+	var esc: *int;
+	var id: int;
+	var mask: int;
+	var best: int;
+	var n: int;
+	var r: int;
+	var t: int;
+
+	esc = alloc(c, (c.ir_ntemps + 1) * sizeof(t)):*int;
+	t = 0;
+	loop {
+		if (t > c.ir_ntemps) {
+			break;
+		}
+		esc[t] = 0;
+		t = t + 1;
+	}
+
+	id = 0;
+	l = c.ir_loops;
+	loop {
+		if (!l) {
+			break;
+		}
+
+		id = id + 1;
+
+		if (l.pre && !l.calls) {
+			// Values that are used outside the loop stay in the frame
+			b = c.ir_entry;
+			loop {
+				if (!b) {
+					break;
+				}
+
+				if (b != l.pre && !ir_inloop(l, b)) {
+					o = b.first;
+					loop {
+						if (!o) {
+							break;
+						}
+
+						esc[o.dst] = id;
+						esc[o.a] = id;
+						esc[o.b] = id;
+
+						arg = o.args;
+						loop {
+							if (!arg) {
+								break;
+							}
+							esc[arg.t] = id;
+							arg = arg.next;
+						}
+
+						o = o.next;
+					}
+
+					esc[b.cond] = id;
+				}
+
+				b = b.next;
+			}
+
+			// Leave most registers to the blocks inside
+			mask = 0;
+			m = c.ir_loops;
+			loop {
+				if (!m) {
+					break;
+				}
+				if (m.lo - 1 < l.hi && l.lo - 1 < m.hi) {
+					mask = mask | m.pins;
+				}
+				m = m.next;
+			}
+
+			n = 0;
+			r = 0;
+			loop {
+				if (r == 16) {
+					break;
+				}
+				n = n + ((mask >> r) & 1);
+				r = r + 1;
+			}
+
+			loop {
+				if (n == 4) {
+					break;
+				}
+
+				best = 0;
+				o = l.pre.first;
+				loop {
+					if (!o) {
+						break;
+					}
+
+					// Arguments are read before the pinned registers are free
+					t = o.dst;
+					if (t && o.op != IR_ARG && c.ir_slot[t] && !c.ir_pin[t] && esc[t] != id) {
+						if (!best || c.ir_uses[t] > c.ir_uses[best]) {
+							best = t;
+						}
+					}
+
+					o = o.next;
+				}
+
+				if (!best) {
+					break;
+				}
+
+				r = ralloc(c, rpool(c) & ~mask);
+				c.ir_pin[best] = 1;
+				c.ir_reg[best] = r;
+				c.ir_slot[best] = 0;
+				l.pins = l.pins | (1 << r);
+				mask = mask | (1 << r);
+				n = n + 1;
+			}
+		}
+
+		l = l.next;
+	}
+}
+
+// The slots of the first nregs arguments that o goes through the frame for
+ir_argmask(c: *compiler, o: *irop, nregs: int): int {
+	var mask: int;
+	var lo: int;
+	var i: int;
+
+	if (o.a || (o.op != IR_LOAD && o.op != IR_STORE && o.op != IR_LEA)) {
+		return 0;
+	}
+
+	mask = 0;
+	i = 0;
+	loop {
+		if (i == nregs) {
+			break;
+		}
+
+		lo = -8 * (i + 1);
+		if (o.n < lo + 8 && lo < o.n + ir_width(c, o)) {
+			mask = mask | (1 << i);
+		}
+
+		i = i + 1;
+	}
+
+	return mask;
+}
+
+// Read the register arguments that are never assigned or have their address
+// taken into temporaries on entry, and use those in place of their slots.
+// They then only go to the frame if the allocator puts them there.
+ir_params(c: *compiler, d: *decl): void {
+	var b: *irblock;
+	var o: *irop;
+	var prev: *irop;
+	var arg: *irarg;
+	var temps: *int;
+	var map: *int;
+	var nregs: int;
+	var keep: int;
+	var m: int;
+	var i: int;
+
+	// Clearing a large frame overwrites the argument registers
+	nregs = d.func_nregs;
+	if (!nregs || d.func_nzero > 16) {
+		return;
+	}
+
+	keep = 0;
+	m = 0;
+	b = c.ir_entry;
+	loop {
+		if (!b) {
+			break;
+		}
+
+		o = b.first;
+		loop {
+			if (!o) {
+				break;
+			}
+
+			if (o.op == IR_LOAD && !(o.n & 7) && ir_width(c, o) == 8) {
+				keep = keep | ir_argmask(c, o, nregs);
+			} else {
+				m = m | ir_argmask(c, o, nregs);
+			}
+
+			o = o.next;
+		}
+
+		b = b.next;
+	}
+
+	keep = keep & ~m;
+	if (!keep) {
+		return;
+	}
+
+	// Read them in order before anything else touches the registers
+	temps = alloc(c, nregs * sizeof(i)):*int;
+	b = c.ir_entry;
+	i = nregs - 1;
+	loop {
+		if (i < 0) {
+			break;
+		}
+
+		temps[i] = 0;
+		if ((keep >> i) & 1) {
+			temps[i] = ir_temp(c);
+			o = ir_mkop(c, IR_ARG, 0, temps[i], 0, 0, i);
+			o.next = b.first;
+			b.first = o;
+			if (!b.last) {
+				b.last = o;
+			}
+		}
+
+		i = i - 1;
+	}
+
+	map = alloc(c, (c.ir_ntemps + 1) * sizeof(i)):*int;
+	i = 0;
+	loop {
+		if (i > c.ir_ntemps) {
+			break;
+		}
+		map[i] = i;
+		i = i + 1;
+	}
+
+	// Drop the loads, remembering which temporary replaces each
+	b = c.ir_entry;
+	loop {
+		if (!b) {
+			break;
+		}
+
+		prev = 0:*irop;
+		o = b.first;
+		loop {
+			if (!o) {
+				break;
+			}
+
+			if (o.op == IR_LOAD && (ir_argmask(c, o, nregs) & keep)) {
+				map[o.dst] = temps[-o.n / 8 - 1];
+				if (prev) {
+					prev.next = o.next;
+				} else {
+					b.first = o.next;
+				}
+			} else {
+				prev = o;
+			}
+
+			o = o.next;
+		}
+		b.last = prev;
+
+		b = b.next;
+	}
+
+	b = c.ir_entry;
+	loop {
+		if (!b) {
+			break;
+		}
+
+		o = b.first;
+		loop {
+			if (!o) {
+				break;
+			}
+
+			o.a = map[o.a];
+			o.b = map[o.b];
+
+			arg = o.args;
+			loop {
+				if (!arg) {
+					break;
+				}
+				arg.t = map[arg.t];
+				arg = arg.next;
+			}
+
+			o = o.next;
+		}
+
+		b.cond = map[b.cond];
+
+		b = b.next;
+	}
+}
+
+// The register arguments the preamble can leave unspilled, since nothing
+// reads or writes their slots
+ir_kept(c: *compiler, d: *decl): int {
+	var b: *irblock;
+	var o: *irop;
+	var mask: int;
+
+	mask = (1 << d.func_nregs) - 1;
+
+	b = c.ir_entry;
+	loop {
+		if (!b) {
+			break;
+		}
+
+		o = b.first;
+		loop {
+			if (!o) {
+				break;
+			}
+
+			mask = mask & ~ir_argmask(c, o, d.func_nregs);
+			if (o.op == IR_ARG && c.ir_reg[o.dst] < 0) {
+				mask = mask & ~(1 << o.n);
+			}
+
+			o = o.next;
+		}
+
+		b = b.next;
+	}
+
+	return mask;
+}
+
+// Record a use of temporary t by o in block b
+ir_use(c: *compiler, b: *irblock, o: *irop, t: int): void {
+	if (!t) {
+		return;
+	}
+
+	c.ir_uses[t] = c.ir_uses[t] + 1;
+	c.ir_last[t] = o;
+
+	// Values that flow between blocks live in the frame
+	if (c.ir_defb[t] != b) {
+		c.ir_slot[t] = 1;
+	}
+}
+
+// Free the register of a temporary whose last use is o
+ir_free(c: *compiler, o: *irop, t: int, free: int): int {
+	if (t && c.ir_last[t] == o && c.ir_reg[t] >= 0 && !c.ir_pin[t]) {
+		free = free | (1 << c.ir_reg[t]);
+	}
+
+	return free;
+}
+
+// Assign registers or frame slots to the temporaries and return the frame size
+ir_alloc(c: *compiler, offset: int): int {
+	var b: *irblock;
+	var o: *irop;
+	var arg: *irarg;
+	var free: int;
+	var prefer: int;
+	var args: int;
+	var r: int;
+	var i: int;
+	var n: int;
+
+	n = (c.ir_ntemps + 1) * sizeof(i);
+	c.ir_reg = alloc(c, n):*int;
+	c.ir_slot = alloc(c, n):*int;
+	c.ir_uses = alloc(c, n):*int;
+	c.ir_defb = alloc(c, n):**irblock;
+	c.ir_last = alloc(c, n):**irop;
+	c.ir_pin = alloc(c, n):*int;
+
+	i = 0;
+	loop {
+		if (i > c.ir_ntemps) {
+			break;
+		}
+
+		c.ir_reg[i] = -1;
+		c.ir_slot[i] = 0;
+		c.ir_uses[i] = 0;
+		c.ir_defb[i] = 0:*irblock;
+		c.ir_last[i] = 0:*irop;
+		c.ir_pin[i] = 0;
+
+		i = i + 1;
+	}
+
+	// Find definitions, uses and temporaries that cross blocks
+	b = c.ir_entry;
+	loop {
+		if (!b) {
+			break;
+		}
+
+		o = b.first;
+		loop {
+			if (!o) {
+				break;
+			}
+
+			ir_use(c, b, o, o.a);
+			ir_use(c, b, o, o.b);
+
+			arg = o.args;
+			loop {
+				if (!arg) {
+					break;
+				}
+				ir_use(c, b, o, arg.t);
+				arg = arg.next;
+			}
+
+			if (o.dst) {
+				if (c.ir_defb[o.dst]) {
+					c.ir_slot[o.dst] = 1;
+				}
+				c.ir_defb[o.dst] = b;
+			}
+
+			o = o.next;
+		}
+
+		if (b.term == IR_BR || b.term == IR_RET) {
+			ir_use(c, b, 0:*irop, b.cond);
+		}
+
+		b = b.next;
+	}
+
+	// Compare and branch without materializing the flag
+	b = c.ir_entry;
+	loop {
+		if (!b) {
+			break;
+		}
+
+		o = b.last;
+		if (b.term == IR_BR && o && (o.op == IR_BIN || o.op == IR_BINI)) {
+			if (rcc(c, o.k) >= 0 && o.dst == b.cond && c.ir_uses[o.dst] == 1 && !c.ir_slot[o.dst]) {
+				o.fused = 1;
+			}
+		}
+
+		b = b.next;
+	}
+
+	if (c.opt_loop) {
+		ir_pins(c);
+	}
+
+	// Arguments that flow between blocks stay where the preamble spills them,
+	// and the registers of the others are only free once they are read
+	args = 0;
+	o = c.ir_entry.first;
+	loop {
+		if (!o || o.op != IR_ARG) {
+			break;
+		}
+
+		if (c.ir_slot[o.dst]) {
+			c.ir_slot[o.dst] = -8 * (o.n + 1);
+		}
+		args = args | (1 << arg_reg(c, o.n));
+
+		o = o.next;
+	}
+
+	// Give frame slots to values that flow between blocks
+	i = 1;
+	loop {
+		if (i > c.ir_ntemps) {
+			break;
+		}
+
+		if (c.ir_slot[i] == 1) {
+			offset = offset + 8;
+			c.ir_slot[i] = -offset;
+		}
+
+		i = i + 1;
+	}
+
+	// Hand out registers within each block
+	b = c.ir_entry;
+	loop {
+		if (!b) {
+			break;
+		}
+
+		free = rpool(c) & ~ir_pinmask(c, b);
+
+		o = b.first;
+		loop {
+			if (!o) {
+				break;
+			}
+
+			prefer = -1;
+			if (o.a && c.ir_last[o.a] == o && c.ir_reg[o.a] >= 0 && !c.ir_pin[o.a]) {
+				prefer = c.ir_reg[o.a];
+			}
+
+			free = ir_free(c, o, o.a, free);
+
+			arg = o.args;
+			loop {
+				if (!arg) {
+					break;
+				}
+				free = ir_free(c, o, arg.t, free);
+				arg = arg.next;
+			}
+
+			if (o.op == IR_CALL) {
+				o.live = rpool(c) & ~free;
+			}
+
+			if (o.op == IR_ARG && !c.ir_slot[o.dst]) {
+				r = arg_reg(c, o.n);
+				if (!((free >> r) & 1)) {
+					r = ralloc(c, free & ~args);
+				}
+
+				if (r >= 0) {
+					c.ir_reg[o.dst] = r;
+					free = free & ~(1 << r);
+				} else {
+					c.ir_slot[o.dst] = -8 * (o.n + 1);
+				}
+			} else if (o.dst && !c.ir_slot[o.dst] && !o.fused && !c.ir_pin[o.dst]) {
+				if (prefer >= 0 && o.op != IR_CALL) {
+					r = prefer;
+				} else {
+					r = ralloc(c, free);
+				}
+
+				if (r >= 0) {
+					c.ir_reg[o.dst] = r;
+					free = free & ~(1 << r);
+				} else {
+					offset = offset + 8;
+					c.ir_slot[o.dst] = -offset;
+				}
+			}
+
+			free = ir_free(c, o, o.b, free);
+
+			if (o.dst && !c.ir_uses[o.dst]) {
+				free = ir_free(c, 0:*irop, o.dst, free);
+			}
+
+			o = o.next;
+		}
+
+		b = b.next;
+	}
+
+	return offset;
+}
+
+// Get a temporary into a register, loading it into scratch if it is in the frame
+ir_get(c: *compiler, t: int, scratch: int): int {
+	if (c.ir_reg[t] >= 0) {
+		return c.ir_reg[t];
+	}
+
+	emit_mov_rm(c, scratch, R_RBP, c.ir_slot[t]);
+	return scratch;
+}
+
+// The register to compute a temporary in
+ir_dst(c: *compiler, t: int, scratch: int): int {
+	if (c.ir_reg[t] >= 0) {
+		return c.ir_reg[t];
+	}
+
+	return scratch;
+}
+
+// Write back a temporary that lives in the frame
+ir_put(c: *compiler, t: int, r: int): void {
+	if (c.ir_reg[t] < 0) {
+		emit_mov_mr(c, R_RBP, c.ir_slot[t], r);
+	}
+}
+
+// Move the first n arguments of a call, listed last first, into their
+// registers. Values in registers are moved first, in an order that reads each
+// register before it is overwritten, with r12 breaking cycles. Values in the
+// frame are loaded last.
+ir_gen_args(c: *compiler, arg: *irarg, n: int): void {
+	var src: *int;
+	var temp: *int;
+	var i: int;
+	var j: int;
+	var r: int;
+	var left: int;
+	var busy: int;
+
+	if (n == 0) {
+		return;
+	}
+
+	src = alloc(c, n * sizeof(i)):*int;
+	temp = alloc(c, n * sizeof(i)):*int;
+
+	// The arguments are in push order, last first
+	left = 0;
+	i = n - 1;
+	loop {
+		if (!arg) {
+			break;
+		}
+		temp[i] = arg.t;
+		src[i] = c.ir_reg[arg.t];
+		if (src[i] >= 0) {
+			left = left + 1;
+		}
+		arg = arg.next;
+		i = i - 1;
+	}
+
+	loop {
+		if (left == 0) {
+			break;
+		}
+
+		// Registers still to be read
+		busy = 0;
+		i = 0;
+		loop {
+			if (i == n) {
+				break;
+			}
+			if (src[i] >= 0 && src[i] != arg_reg(c, i)) {
+				busy = busy | (1 << src[i]);
+			}
+			i = i + 1;
+		}
+
+		j = 0;
+		loop {
+			if (j == n || (src[j] >= 0 && !((busy >> arg_reg(c, j)) & 1))) {
+				break;
+			}
+			j = j + 1;
+		}
+
+		if (j < n) {
+			emit_mov_rr(c, arg_reg(c, j), src[j]);
+			src[j] = -1;
+			temp[j] = 0;
+			left = left - 1;
+			continue;
+		}
+
+		// Every move waits on another, so park a source in r12
+		i = 0;
+		loop {
+			if (src[i] >= 0) {
+				break;
+			}
+			i = i + 1;
+		}
+
+		r = src[i];
+		emit_mov_rr(c, R_R12, r);
+		j = 0;
+		loop {
+			if (j == n) {
+				break;
+			}
+			if (src[j] == r) {
+				src[j] = R_R12;
+			}
+			j = j + 1;
+		}
+	}
+
+	i = 0;
+	loop {
+		if (i == n) {
+			break;
+		}
+		if (temp[i]) {
+			emit_mov_rm(c, arg_reg(c, i), R_RBP, c.ir_slot[temp[i]]);
+		}
+		i = i + 1;
+	}
+}
+
+// Translate an instruction to machine code
+ir_gen_op(c: *compiler, o: *irop): void {
+	var arg: *irarg;
+	var op: int;
+	var i: int;
+	var base: int;
+	var a: int;
+	var b: int;
+	var r: int;
+
+	op = o.op;
+	if (op == IR_STORE) {
+		base = R_RBP;
+		if (o.a) {
+			base = ir_get(c, o.a, R_RCX);
+		}
+		b = ir_get(c, o.b, R_RAX);
+		emit_store_rm(c, o.t, b, base, o.n);
+		return;
+	} else if (op == IR_CALL) {
+		rsave(c, o.live, 0);
+
+		// Push the arguments that go on the stack, last first
+		i = o.n - arg_regs(c, o.n);
+		arg = o.args;
+		loop {
+			if (i == 0) {
+				break;
+			}
+
+			if (c.ir_reg[arg.t] >= 0) {
+				emit_push_r(c, c.ir_reg[arg.t]);
+			} else {
+				emit_push_m(c, R_RBP, c.ir_slot[arg.t]);
+			}
+
+			arg = arg.next;
+			i = i - 1;
+		}
+
+		if (o.a) {
+			// rax is not an argument register
+			a = ir_get(c, o.a, R_RAX);
+			emit_mov_rr(c, R_RAX, a);
+		}
+
+		ir_gen_args(c, arg, arg_regs(c, o.n));
+
+		if (o.a) {
+			emit_call_r(c, R_RAX);
+		} else {
+			emit_call_l(c, o.l);
+		}
+
+		if (o.n - arg_regs(c, o.n)) {
+			emit_pop(c, o.n - arg_regs(c, o.n));
+		}
+
+		r = ir_dst(c, o.dst, R_RAX);
+		emit_mov_rr(c, r, R_RAX);
+		ir_put(c, o.dst, r);
+
+		rsave(c, o.live, 1);
+		return;
+	} else if (op == IR_ARG) {
+		// Arguments in the frame were spilled by the preamble
+		if (c.ir_reg[o.dst] >= 0) {
+			emit_mov_rr(c, c.ir_reg[o.dst], arg_reg(c, o.n));
+		}
+		return;
+	}
+
+	if (o.fused) {
+		// The branch uses the flags directly
+		a = ir_get(c, o.a, R_RAX);
+		if (op == IR_BIN) {
+			emit_alu_rr(c, ALU_CMP, a, ir_get(c, o.b, R_RCX));
+		} else {
+			emit_alu_ri(c, ALU_CMP, a, o.n);
+		}
+		return;
+	}
+
+	if (op == IR_IMM) {
+		r = ir_dst(c, o.dst, R_RAX);
+		emit_mov_ri(c, r, o.n);
+	} else if (op == IR_LEA) {
+		r = ir_dst(c, o.dst, R_RAX);
+		emit_lea_rm(c, r, R_RBP, o.n);
+	} else if (op == IR_ADDR) {
+		r = ir_dst(c, o.dst, R_RAX);
+		emit_lea_rl(c, r, o.l);
+	} else if (op == IR_STR) {
+		r = ir_dst(c, o.dst, R_RAX);
+		emit_lea_rl(c, r, emit_strlit(c, o.s));
+	} else if (op == IR_LOAD) {
+		base = R_RBP;
+		if (o.a) {
+			base = ir_get(c, o.a, R_RCX);
+		}
+		r = ir_dst(c, o.dst, R_RAX);
+		emit_load_rm(c, o.t, r, base, o.n);
+	} else if (op == IR_MOV) {
+		a = ir_get(c, o.a, R_RAX);
+		r = ir_dst(c, o.dst, R_RAX);
+		emit_mov_rr(c, r, a);
+	} else if (op == IR_UN) {
+		a = ir_get(c, o.a, R_RAX);
+		r = ir_dst(c, o.dst, R_RAX);
+		emit_mov_rr(c, r, a);
+		if (o.k == N_NEG) {
+			emit_neg_r(c, r);
+		} else {
+			emit_not_r(c, r);
+		}
+	} else if (op == IR_BIN) {
+		a = ir_get(c, o.a, R_RAX);
+		b = ir_get(c, o.b, R_RCX);
+		r = ir_dst(c, o.dst, R_RAX);
+		emit_mov_rr(c, r, a);
+		rop(c, o.k, r, b);
+	} else if (op == IR_BINI) {
+		a = ir_get(c, o.a, R_RAX);
+		r = ir_dst(c, o.dst, R_RAX);
+		emit_mov_rr(c, r, a);
+		rop_imm(c, o.k, r, o.n);
+	} else {
+		die(c, "invalid ir");
+	}
+
+	ir_put(c, o.dst, r);
+}
+
+// Translate the end of a block to machine code
+ir_gen_term(c: *compiler, b: *irblock): void {
+	var cc: int;
+
+	if (b.term == IR_JMP) {
+		if (b.to != b.next) {
+			emit_jmp(c, b.to.label);
+		}
+	} else if (b.term == IR_BR) {
+		if (b.last && b.last.fused) {
+			cc = rcc(c, b.last.k);
+		} else {
+			emit_test_rr(c, ir_get(c, b.cond, R_RAX));
+			cc = CC_NE;
+		}
+
+		if (b.to == b.next) {
+			emit_jcc(c, cc ^ 1, b.alt.label);
+		} else {
+			emit_jcc(c, cc, b.to.label);
+			if (b.alt != b.next) {
+				emit_jmp(c, b.alt.label);
+			}
+		}
+	} else if (b.term == IR_RET) {
+		if (b.cond) {
+			emit_mov_rr(c, R_RAX, ir_get(c, b.cond, R_RAX));
+		} else {
+			emit_mov_ri(c, R_RAX, 0);
+		}
+		emit_leave(c);
+	} else {
+		die(c, "invalid ir");
+	}
+}
+
+// Compile a function through the IR
+ir_func(c: *compiler, d: *decl, offset: int): void {
+	var b: *irblock;
+	var o: *irop;
+
+	c.ir_entry = 0:*irblock;
+	c.ir_end = 0:*irblock;
+	c.ir_cur = 0:*irblock;
+	c.ir_ntemps = 0;
+	c.ir_frame = offset;
+	c.ir_frame_max = offset;
+	c.ir_bias = 0;
+	c.ir_depth = 0;
+	c.ir_retb = 0:*irblock;
+	c.ir_rett = 0;
+	c.ir_seq = 0;
+	c.ir_loops = 0:*irloop;
+
+	ir_start(c, ir_newblock(c));
+	ir_stmt(c, d, d.func_def.b, 0:*irblock, 0:*irblock);
+	ir_ret(c, 0);
+
+	ir_simplify(c);
+	ir_params(c, d);
+
+	if (c.opt_loop) {
+		ir_loops(c);
+	}
+
+	// Inlined bodies extend the frame
+	offset = ir_alloc(c, c.ir_frame_max);
+
+	emit_preamble(c, d, offset, ir_kept(c, d));
+
+	b = c.ir_entry;
+	loop {
+		if (!b) {
+			break;
+		}
+
+		fixup_label(c, b.label);
+
+		o = b.first;
+		loop {
+			if (!o) {
+				break;
+			}
+			ir_gen_op(c, o);
+			o = o.next;
+		}
+
+		ir_gen_term(c, b);
+
+		b = b.next;
+	}
+}
+
+// Hash an interned name and member name
+decl_hash(name: *byte, member_name: *byte): int {
+	var h: int;
+
+	h = (name:int * 31 + member_name:int) * 0x45d9f3b;
+
+	return h ^ (h >> 32);
+}
+
+// Double the size of the declaration hash table
+decl_grow(c: *compiler): void {
+	var table: **decl;
+	var cap: int;
+	var d: *decl;
+	var next: *decl;
+	var link: **decl;
+	var i: int;
+
+	cap = c.decl_cap * 2;
+	if (cap == 0) {
+		cap = 256;
+	}
+
+	table = alloc(c, cap * sizeof(d)):**decl;
+
+	i = 0;
+	loop {
+		if (i == cap) {
+			break;
+		}
+		table[i] = 0:*decl;
+		i = i + 1;
+	}
+
+	i = 0;
+	loop {
+		if (i == c.decl_cap) {
+			break;
+		}
+
+		d = c.decl_table[i];
+		loop {
+			if (!d) {
+				break;
+			}
+
+			next = d.hnext;
+			link = &table[d.hash & (cap - 1)];
+			d.hnext = *link;
+			*link = d;
+			d = next;
+		}
+
+		i = i + 1;
+	}
+
+	c.decl_table = table;
+	c.decl_cap = cap;
+}
+
+find(c: *compiler, name: *byte, member_name: *byte, make: int): *decl {
+	var d: *decl;
+	var link: **decl;
+	var h: int;
+
+	h = decl_hash(name, member_name);
+	link = &c.decl_table[h & (c.decl_cap - 1)];
+	loop {
+		d = *link;
+		if (!d) {
+			break;
+		}
+
+		if (d.name == name && d.member_name == member_name) {
+			return d;
+		}
+
+		link = &d.hnext;
+	}
+
+	if (!make) {
+		return 0:*decl;
+	}
+
+	d = alloc(c, sizeof(*d)): *decl;
 
 	d.name = name;
 	d.member_name = member_name;
 
-	d.p = p;
-	d.l = 0:*decl;
-	d.r = 0:*decl;
+	d.hash = h;
+	d.hnext = 0:*decl;
+	d.next = 0:*decl;
 
 	d.func_defined = 0;
 	d.func_type = 0:*type;
 	d.func_label = mklabel(c);
 	d.func_def = 0:*node;
+	d.func_framed = 0;
+	d.func_frame = 0;
+	d.func_nregs = 0;
+	d.func_zero = 0:*byte;
+	d.func_nzero = 0;
+	d.func_reached = 0;
+	d.func_cost = 0;
+	d.func_nret = 0;
+	d.func_inlining = 0;
 
 	d.struct_defined = 0;
 	d.struct_size = 0;
@@ -3338,61 +9368,94 @@ find(c: *compiler, name: *byte, member_name: *byte, make: int): *decl {
 	d.var_type = 0:*type;
 	d.var_offset = 0;
 	d.var_def = 0:*node;
+	d.var_init = 0;
+	d.var_used = 0;
 
 	d.goto_defined = 0;
 	d.goto_label = mklabel(c);
+	d.goto_block = 0:*irblock;
 
 	*link = d;
 
+	// Keep a list of the global names to visit in order
+	if (!member_name) {
+		d.next = c.decls;
+		c.decls = d;
+	}
+
+	c.decl_count = c.decl_count + 1;
+	if (c.decl_count > c.decl_cap) {
+		decl_grow(c);
+	}
+
 	return d;
 }
 
-// Find the first declaration
-first_decl(c: *compiler): *decl {
-	var d: *decl;
+// Merge sort a list of declarations by name
+sort_decls(c: *compiler, d: *decl): *decl {
+	var a: *decl;
+	var b: *decl;
+	var head: *decl;
+	var link: **decl;
 
-	d = c.decls;
-	if (!d) {
-		return 0:*decl;
+	if (!d || !d.next) {
+		return d;
 	}
 
+	// Split the list in half
+	a = d;
+	b = d.next;
 	loop {
-		if (!d.l) {
-			return d;
+		if (!b || !b.next) {
+			break;
 		}
-
-		d = d.l;
+		a = a.next;
+		b = b.next.next;
 	}
-}
 
-next_decl(c: *compiler, d: *decl): *decl {
-	if (!d) {
-		return 0:*decl;
-	}
+	b = a.next;
+	a.next = 0:*decl;
 
-	if (d.r) {
-		d = d.r;
+	a = sort_decls(c, d);
+	b = sort_decls(c, b);
 
-		loop {
-			if (!d.l) {
-				return d;
-			}
+	// Merge the halves
+	link = &head;
+	loop {
+		if (!a) {
+			*link = b;
+			break;
+		} else if (!b) {
+			*link = a;
+			break;
+		}
 
-			d = d.l;
+		if (strcmp(a.name, b.name) <= 0) {
+			*link = a;
+			link = &a.next;
+			a = a.next;
+		} else {
+			*link = b;
+			link = &b.next;
+			b = b.next;
 		}
 	}
 
-	loop {
-		if (!d.p) {
-			return 0:*decl;
-		}
+	return head;
+}
 
-		if (d.p.l == d) {
-			return d.p;
-		}
+// Find the first global declaration, visiting them in order of name
+first_decl(c: *compiler): *decl {
+	c.decls = sort_decls(c, c.decls);
+	return c.decls;
+}
 
-		d = d.p;
+next_decl(c: *compiler, d: *decl): *decl {
+	if (!d) {
+		return 0:*decl;
 	}
+
+	return d.next;
 }
 
 mktype(c: *compiler, kind: int, a: *type, b: *type, st: *decl): *type {
@@ -3499,6 +9562,10 @@ mklabel(c: *compiler): *label {
 	var l: *label;
 
 	l = alloc(c, sizeof(*l)):*label;
+	c.stat_labels = c.stat_labels + 1;
+
+	l.next = c.labels;
+	c.labels = l;
 
 	l.fix = 0:*fixup;
 	l.at = 0;
@@ -3539,6 +9606,10 @@ reserve(c: *compiler, n: int): void {
 
 // Add a single byte to the output
 emit(c: *compiler, x: int): void {
+	if (c.peep) {
+		peep_flush(c);
+	}
+
 	reserve(c, 1);
 	c.text_end.buf[c.text_end.fill] = x:byte;
 	c.text_end.fill = c.text_end.fill + 1;
@@ -3555,11 +9626,19 @@ fixup(c: *compiler, here: *byte, delta: int): void {
 
 // Add an new fixup for the current position
 addfixup(c: *compiler, l: *label): void {
+	addbranch(c, l, FIX_REL32, 0);
+}
+
+// Add a fixup for the current position. Every fixup is remembered so jumps
+// can be shortened once the whole text is known.
+addbranch(c: *compiler, l: *label, kind: int, cc: int): void {
 	var f: *fixup;
 	var here: *byte;
 
 	reserve(c, 4);
 
+	c.stat_fixups = c.stat_fixups + 1;
+
 	here = &c.text_end.buf[c.text_end.fill];
 
 	emit(c, 0);
@@ -3567,28 +9646,55 @@ addfixup(c: *compiler, l: *label): void {
 	emit(c, 0);
 	emit(c, 0);
 
+	f = alloc(c, sizeof(*f)): *fixup;
+	f.next = 0:*fixup;
+	f.ptr = here;
+	f.at = c.at;
+	f.l = l;
+	f.kind = kind;
+	f.cc = cc;
+	f.op = 0;
+	f.rel8 = 0;
+	f.all = 0:*fixup;
+
+	if (kind == FIX_JMP) {
+		f.op = c.at - 5;
+		c.nbranch = c.nbranch + 1;
+	} else if (kind == FIX_JCC) {
+		f.op = c.at - 6;
+		c.nbranch = c.nbranch + 1;
+	}
+
+	if (c.fixups_end) {
+		c.fixups_end.all = f;
+	} else {
+		c.fixups = f;
+	}
+	c.fixups_end = f;
+
 	if (l.fixed) {
 		fixup(c, here, l.at - c.at);
 	} else {
-		f = alloc(c, sizeof(*f)): *fixup;
-
 		f.next = l.fix;
-		f.ptr = here;
-		f.at = c.at;
-
 		l.fix = f;
 	}
 }
 
 // Fix references to a label to the current position
 fixup_label(c: *compiler, l: *label): void {
+	peep_flush(c);
+	place_label(c, l, c.at);
+}
+
+// Fix references to a label to the position at
+place_label(c: *compiler, l: *label, at: int): void {
 	var f: *fixup;
 
 	if (l.fixed) {
 		die(c, "already fixed");
 	}
 
-	l.at = c.at;
+	l.at = at;
 	l.fixed = 1;
 
 	f = l.fix;
@@ -3601,6 +9707,59 @@ fixup_label(c: *compiler, l: *label): void {
 	}
 }
 
+// Emit a push held back by the peephole
+peep_flush(c: *compiler): void {
+	var kind: int;
+
+	kind = c.peep;
+	c.peep = PEEP_NONE;
+
+	if (kind == PEEP_REG) {
+		emit_push_r(c, c.peep_reg);
+	} else if (kind == PEEP_IMM) {
+		// push x
+		emit(c, 0x68);
+		emit_imm32(c, c.peep_imm);
+	} else if (kind == PEEP_LEA) {
+		emit_lea_rm(c, R_RAX, R_RBP, c.peep_imm);
+		emit_push_r(c, R_RAX);
+	}
+}
+
+// Push a register for the stack machine. With the peephole enabled the push
+// waits for the next instruction so a pop can turn it into a move.
+emit_spush(c: *compiler, r: int): void {
+	if (c.opt_peep) {
+		peep_flush(c);
+		c.peep = PEEP_REG;
+		c.peep_reg = r;
+		return;
+	}
+
+	emit_push_r(c, r);
+}
+
+// Pop a register for the stack machine
+emit_spop(c: *compiler, r: int): void {
+	var kind: int;
+
+	kind = c.peep;
+	c.peep = PEEP_NONE;
+
+	if (kind == PEEP_REG) {
+		// push s; pop r => mov r, s
+		emit_mov_rr(c, r, c.peep_reg);
+	} else if (kind == PEEP_IMM) {
+		// push x; pop r => mov r, x
+		emit_mov_ri(c, r, sext32(c.peep_imm));
+	} else if (kind == PEEP_LEA) {
+		// lea rax, [rbp + x]; push rax; pop r => lea r, [rbp + x]
+		emit_lea_rm(c, r, R_RBP, c.peep_imm);
+	} else {
+		emit_pop_r(c, r);
+	}
+}
+
 emit_ptr(c: *compiler, l: *label): void {
 	// lea %rax, [l]
 	emit(c, 0x48);
@@ -3608,16 +9767,23 @@ emit_ptr(c: *compiler, l: *label): void {
 	emit(c, 0x05);
 	addfixup(c, l);
 	// push %rax
-	emit(c, 0x50);
+	emit_spush(c, R_RAX);
 }
 
 emit_jmp(c: *compiler, l: *label): void {
 	// jmp l
 	emit(c, 0xe9);
-	addfixup(c, l);
+	addbranch(c, l, FIX_JMP, 0);
 }
 
 emit_num(c: *compiler, x: int): void {
+	if (c.opt_peep) {
+		peep_flush(c);
+		c.peep = PEEP_IMM;
+		c.peep_imm = x;
+		return;
+	}
+
 	// push x
 	emit(c, 0x68);
 	emit(c, x);
@@ -3626,82 +9792,172 @@ emit_num(c: *compiler, x: int): void {
 	emit(c, x >> 24);
 }
 
+// Add a string constant to the read-only data, sharing identical strings.
+// The label is placed after the text is finished.
+emit_strlit(c: *compiler, s: *byte): *label {
+	var p: *istr;
+
+	p = intern_istr(c, s, strlen(s));
+	if (p.lit) {
+		return p.lit;
+	}
+
+	p.lit = mklabel(c);
+	p.lit_at = c.rodata_size;
+	c.rodata_size = c.rodata_size + p.len + 1;
+
+	if (c.rodata_end) {
+		c.rodata_end.lit_next = p;
+	} else {
+		c.rodata = p;
+	}
+	c.rodata_end = p;
+
+	return p.lit;
+}
+
 emit_str(c: *compiler, s: *byte): void {
-	var a: *label;
-	var b: *label;
-	var i: int;
+	// push s
+	emit_ptr(c, emit_strlit(c, s));
+}
+
+emit_pop(c: *compiler, n: int): void {
+	// push x; add rsp, 8 => nothing
+	if (c.peep && n > 0) {
+		c.peep = PEEP_NONE;
+		n = n - 1;
+		if (n == 0) {
+			return;
+		}
+	}
 
-	a = mklabel(c);
-	b = mklabel(c);
+	n = n * 8;
+	// add rsp, 8*n
+	emit(c, 0x48);
+	emit(c, 0x81);
+	emit(c, 0xc4);
+	emit(c, n);
+	emit(c, n >> 8);
+	emit(c, n >> 16);
+	emit(c, n >> 24);
+}
 
-	// jmp b
-	emit_jmp(c, b);
+// Set up the frame, spilling the register arguments not in keep
+emit_preamble(c: *compiler, d: *decl, n: int, keep: int): void {
+	var i: int;
+	var nregs: int;
+	var nzero: int;
+	var run: int;
 
-	// a:
-	fixup_label(c, a);
+	// push rbp
+	emit(c, 0x55);
+	// mov rbp, rsp
+	emit(c, 0x48);
+	emit(c, 0x89);
+	emit(c, 0xe5);
 
+	// Spill register arguments to their slots, only reserving the slots of
+	// the ones kept
+	nregs = d.func_nregs;
+	run = 0;
 	i = 0;
-	// .string s
 	loop {
-		if (!s[i]) {
+		if (i == nregs) {
 			break;
 		}
-		emit(c, s[i]:int);
+
+		if ((keep >> i) & 1) {
+			run = run + 1;
+		} else {
+			if (run) {
+				emit_reserve(c, run);
+				run = 0;
+			}
+			emit_push_r(c, arg_reg(c, i));
+		}
+
 		i = i + 1;
 	}
-	emit(c, 0);
 
-	// nop sled
-	emit(c, 0x90);
-	emit(c, 0x90);
-	emit(c, 0x90);
-	emit(c, 0x90);
-	emit(c, 0x90);
-	emit(c, 0x90);
-	emit(c, 0x90);
-	emit(c, 0x90);
+	// Zero the slots up to the last local that needs it. Large frames use
+	// rep stosq instead of a push per slot.
+	nzero = d.func_nzero;
+	if (run && nzero) {
+		emit_reserve(c, run);
+		run = 0;
+	}
+
+	if (nzero > 16) {
+		emit_reserve(c, nzero);
+		// mov rdi, rsp
+		emit(c, 0x48);
+		emit(c, 0x89);
+		emit(c, 0xe7);
+		// mov ecx, nzero
+		emit(c, 0xb9);
+		emit(c, nzero);
+		emit(c, nzero >> 8);
+		emit(c, nzero >> 16);
+		emit(c, nzero >> 24);
+		// xor eax, eax
+		emit(c, 0x31);
+		emit(c, 0xc0);
+		// rep stosq
+		emit(c, 0xf3);
+		emit(c, 0x48);
+		emit(c, 0xab);
+	} else {
+		i = 0;
+		loop {
+			if (i == nzero) {
+				break;
+			}
+			if (d.func_zero[i]) {
+				emit_num(c, 0);
+			} else {
+				// push rax
+				emit(c, 0x50);
+			}
+			i = i + 1;
+		}
+	}
 
-	// b:
-	fixup_label(c, b);
-	// push a
-	emit_ptr(c, a);
+	// The rest of the frame is only reserved
+	i = (n - 8 * nregs + 7) / 8 - nzero + run;
+	if (i > 0) {
+		emit_reserve(c, i);
+	}
 }
 
-emit_pop(c: *compiler, n: int): void {
+// sub rsp, 8*n
+emit_reserve(c: *compiler, n: int): void {
 	n = n * 8;
-	// add rsp, 8*n
 	emit(c, 0x48);
 	emit(c, 0x81);
-	emit(c, 0xc4);
+	emit(c, 0xec);
 	emit(c, n);
 	emit(c, n >> 8);
 	emit(c, n >> 16);
 	emit(c, n >> 24);
 }
 
-emit_preamble(c: *compiler, n: int): void {
-	var i: int;
-	// push rbp
-	emit(c, 0x55);
-	// mov rbp, rsp
-	emit(c, 0x48);
-	emit(c, 0x89);
-	emit(c, 0xe5);
-	i = 0;
-	loop {
-		if (i >= n) {
-			break;
-		}
-		emit_num(c, 0);
-		i = i + 8;
+emit_store(c: *compiler, t: *type): void {
+	var offset: int;
+
+	// Store directly to a local
+	if (c.peep == PEEP_LEA) {
+		offset = c.peep_imm;
+		c.peep = PEEP_NONE;
+		emit_spop(c, R_RAX);
+		emit_store_rm(c, t, R_RAX, R_RBP, offset);
+		emit_spush(c, R_RAX);
+		return;
 	}
-}
 
-emit_store(c: *compiler, t: *type): void {
 	// pop rdi
-	emit(c, 0x5f);
+	emit_spop(c, R_RDI);
 	// pop rax
-	emit(c, 0x58);
+	emit_spop(c, R_RAX);
 	if (t.kind == TY_BYTE) {
 		// mov [rdi], al
 		emit(c, 0x88);
@@ -3715,12 +9971,27 @@ emit_store(c: *compiler, t: *type): void {
 		die(c, "invalid store");
 	}
 	// push rax
-	emit(c, 0x50);
+	emit_spush(c, R_RAX);
 }
 
 emit_load(c: *compiler, t: *type): void {
+	var kind: int;
+
+	// Load directly from a local or through the pointer in a register
+	kind = c.peep;
+	if (kind == PEEP_LEA || kind == PEEP_REG) {
+		c.peep = PEEP_NONE;
+		if (kind == PEEP_LEA) {
+			emit_load_rm(c, t, R_RAX, R_RBP, c.peep_imm);
+		} else {
+			emit_load_rm(c, t, R_RAX, c.peep_reg, 0);
+		}
+		emit_spush(c, R_RAX);
+		return;
+	}
+
 	// pop rdi
-	emit(c, 0x5f);
+	emit_spop(c, R_RDI);
 	if (t.kind == TY_BYTE) {
 		// xor rax, rax
 		emit(c, 0x48);
@@ -3738,12 +10009,12 @@ emit_load(c: *compiler, t: *type): void {
 		die(c, "invalid load");
 	}
 	// push rax
-	emit(c, 0x50);
+	emit_spush(c, R_RAX);
 }
 
 emit_jz(c: *compiler, l: *label): void {
 	// pop rax
-	emit(c, 0x58);
+	emit_spop(c, R_RAX);
 	// test rax, rax
 	emit(c, 0x48);
 	emit(c, 0x85);
@@ -3751,10 +10022,17 @@ emit_jz(c: *compiler, l: *label): void {
 	// jz no
 	emit(c, 0x0f);
 	emit(c, 0x84);
-	addfixup(c, l);
+	addbranch(c, l, FIX_JCC, CC_E);
 }
 
 emit_lea(c: *compiler, offset: int): void {
+	if (c.opt_peep) {
+		peep_flush(c);
+		c.peep = PEEP_LEA;
+		c.peep_imm = offset;
+		return;
+	}
+
 	// lea rax, [rbp + offset]
 	emit(c, 0x48);
 	emit(c, 0x8d);
@@ -3764,64 +10042,81 @@ emit_lea(c: *compiler, offset: int): void {
 	emit(c, offset >> 16);
 	emit(c, offset >> 24);
 	// push rax
-	emit(c, 0x50);
+	emit_spush(c, R_RAX);
 }
 
 emit_and(c: *compiler): void {
 	// pop rax
-	emit(c, 0x58);
+	emit_spop(c, R_RAX);
 	// pop rdx
-	emit(c, 0x5a);
+	emit_spop(c, R_RDX);
 	// and rdx, rax
 	emit(c, 0x48);
 	emit(c, 0x21);
 	emit(c, 0xd0);
 	// push rax
-	emit(c, 0x50);
+	emit_spush(c, R_RAX);
 }
 
 emit_or(c: *compiler): void {
 	// pop rax
-	emit(c, 0x58);
+	emit_spop(c, R_RAX);
 	// pop rdx
-	emit(c, 0x5a);
+	emit_spop(c, R_RDX);
 	// or rdx, rax
 	emit(c, 0x48);
 	emit(c, 0x09);
 	emit(c, 0xd0);
 	// push rax
-	emit(c, 0x50);
+	emit_spush(c, R_RAX);
 }
 
 emit_xor(c: *compiler): void {
 	// pop rax
-	emit(c, 0x58);
+	emit_spop(c, R_RAX);
 	// pop rdx
-	emit(c, 0x5a);
+	emit_spop(c, R_RDX);
 	// xor rdx, rax
 	emit(c, 0x48);
 	emit(c, 0x31);
 	emit(c, 0xd0);
 	// push rax
-	emit(c, 0x50);
+	emit_spush(c, R_RAX);
 }
 
 emit_add(c: *compiler): void {
 	// pop rax
-	emit(c, 0x58);
+	emit_spop(c, R_RAX);
 	// pop rdx
-	emit(c, 0x5a);
+	emit_spop(c, R_RDX);
 	// add rdx, rax
 	emit(c, 0x48);
 	emit(c, 0x01);
 	emit(c, 0xd0);
 	// push rax
-	emit(c, 0x50);
+	emit_spush(c, R_RAX);
+}
+
+// Apply an operator with a constant right hand side to the top of the stack
+emit_op_imm(c: *compiler, kind: int, x: int): void {
+	if (rnop(c, kind, x)) {
+		return;
+	}
+
+	// pop rax
+	emit_spop(c, R_RAX);
+	rop_imm(c, kind, R_RAX, x);
+	// push rax
+	emit_spush(c, R_RAX);
 }
 
 emit_ret(c: *compiler): void {
 	// pop rax
-	emit(c, 0x58);
+	emit_spop(c, R_RAX);
+	emit_leave(c);
+}
+
+emit_leave(c: *compiler): void {
 	// mov rsp, rbp
 	emit(c, 0x48);
 	emit(c, 0x89);
@@ -3834,21 +10129,52 @@ emit_ret(c: *compiler): void {
 
 emit_call(c: *compiler, n: int): void {
 	// pop rax
-	emit(c, 0x58);
+	emit_spop(c, R_RAX);
+	n = emit_args(c, n);
 	// call rax
 	emit(c, 0xff);
 	emit(c, 0xd0);
 	// add rsp, 8*(n+1)
 	emit_pop(c, n);
 	// push rax
-	emit(c, 0x50);
+	emit_spush(c, R_RAX);
+}
+
+emit_call_label(c: *compiler, l: *label, n: int): void {
+	n = emit_args(c, n);
+	// call l
+	emit(c, 0xe8);
+	addfixup(c, l);
+	// add rsp, 8*n
+	emit_pop(c, n);
+	// push rax
+	emit_spush(c, R_RAX);
+}
+
+// Pop the pushed arguments that are passed in registers, returning how many
+// are left on the stack
+emit_args(c: *compiler, n: int): int {
+	var nregs: int;
+	var i: int;
+
+	nregs = arg_regs(c, n);
+	i = 0;
+	loop {
+		if (i == nregs) {
+			break;
+		}
+		emit_spop(c, arg_reg(c, i));
+		i = i + 1;
+	}
+
+	return n - nregs;
 }
 
 emit_gt(c: *compiler): void {
 	// pop rdx
-	emit(c, 0x5a);
+	emit_spop(c, R_RDX);
 	// pop rcx
-	emit(c, 0x59);
+	emit_spop(c, R_RCX);
 	// xor rax, rax
 	emit(c, 0x48);
 	emit(c, 0x31);
@@ -3861,15 +10187,15 @@ emit_gt(c: *compiler): void {
 	emit(c, 0x0f);
 	emit(c, 0x9f);
 	emit(c, 0xc0);
-	// mov rax
-	emit(c, 0x50);
+	// push rax
+	emit_spush(c, R_RAX);
 }
 
 emit_lt(c: *compiler): void {
 	// pop rdx
-	emit(c, 0x5a);
+	emit_spop(c, R_RDX);
 	// pop rcx
-	emit(c, 0x59);
+	emit_spop(c, R_RCX);
 	// xor rax, rax
 	emit(c, 0x48);
 	emit(c, 0x31);
@@ -3882,15 +10208,15 @@ emit_lt(c: *compiler): void {
 	emit(c, 0x0f);
 	emit(c, 0x9c);
 	emit(c, 0xc0);
-	// mov rax
-	emit(c, 0x50);
+	// push rax
+	emit_spush(c, R_RAX);
 }
 
 emit_ge(c: *compiler): void {
 	// pop rdx
-	emit(c, 0x5a);
+	emit_spop(c, R_RDX);
 	// pop rcx
-	emit(c, 0x59);
+	emit_spop(c, R_RCX);
 	// xor rax, rax
 	emit(c, 0x48);
 	emit(c, 0x31);
@@ -3903,15 +10229,15 @@ emit_ge(c: *compiler): void {
 	emit(c, 0x0f);
 	emit(c, 0x9d);
 	emit(c, 0xc0);
-	// mov rax
-	emit(c, 0x50);
+	// push rax
+	emit_spush(c, R_RAX);
 }
 
 emit_le(c: *compiler): void {
 	// pop rdx
-	emit(c, 0x5a);
+	emit_spop(c, R_RDX);
 	// pop rcx
-	emit(c, 0x59);
+	emit_spop(c, R_RCX);
 	// xor rax, rax
 	emit(c, 0x48);
 	emit(c, 0x31);
@@ -3924,15 +10250,15 @@ emit_le(c: *compiler): void {
 	emit(c, 0x0f);
 	emit(c, 0x9e);
 	emit(c, 0xc0);
-	// mov rax
-	emit(c, 0x50);
+	// push rax
+	emit_spush(c, R_RAX);
 }
 
 emit_eq(c: *compiler): void {
 	// pop rdx
-	emit(c, 0x5a);
+	emit_spop(c, R_RDX);
 	// pop rcx
-	emit(c, 0x59);
+	emit_spop(c, R_RCX);
 	// xor rax, rax
 	emit(c, 0x48);
 	emit(c, 0x31);
@@ -3945,15 +10271,15 @@ emit_eq(c: *compiler): void {
 	emit(c, 0x0f);
 	emit(c, 0x94);
 	emit(c, 0xc0);
-	// mov rax
-	emit(c, 0x50);
+	// push rax
+	emit_spush(c, R_RAX);
 }
 
 emit_ne(c: *compiler): void {
 	// pop rdx
-	emit(c, 0x5a);
+	emit_spop(c, R_RDX);
 	// pop rcx
-	emit(c, 0x59);
+	emit_spop(c, R_RCX);
 	// xor rax, rax
 	emit(c, 0x48);
 	emit(c, 0x31);
@@ -3966,41 +10292,41 @@ emit_ne(c: *compiler): void {
 	emit(c, 0x0f);
 	emit(c, 0x95);
 	emit(c, 0xc0);
-	// mov rax
-	emit(c, 0x50);
+	// push rax
+	emit_spush(c, R_RAX);
 }
 
 emit_sub(c: *compiler): void {
 	// pop rax
-	emit(c, 0x58);
+	emit_spop(c, R_RAX);
 	// pop rdx
-	emit(c, 0x5a);
+	emit_spop(c, R_RDX);
 	// add rax, rdx
 	emit(c, 0x48);
 	emit(c, 0x29);
 	emit(c, 0xd0);
 	// push rax
-	emit(c, 0x50);
+	emit_spush(c, R_RAX);
 }
 
 emit_mul(c: *compiler): void {
 	// pop rax
-	emit(c, 0x58);
+	emit_spop(c, R_RAX);
 	// pop rcx
-	emit(c, 0x59);
+	emit_spop(c, R_RCX);
 	// mul rcx
 	emit(c, 0x48);
 	emit(c, 0xf7);
 	emit(c, 0xe1);
 	// push rax
-	emit(c, 0x50);
+	emit_spush(c, R_RAX);
 }
 
 emit_div(c: *compiler): void {
 	// pop rax
-	emit(c, 0x58);
+	emit_spop(c, R_RAX);
 	// pop rcx
-	emit(c, 0x59);
+	emit_spop(c, R_RCX);
 	// xor rdx, rdx
 	emit(c, 0x48);
 	emit(c, 0x31);
@@ -4016,97 +10342,442 @@ emit_div(c: *compiler): void {
 	// neg rdx
 	emit(c, 0x48);
 	emit(c, 0xf7);
-	emit(c, 0xda);
-	// idiv rcx
+	emit(c, 0xda);
+	// idiv rcx
+	emit(c, 0x48);
+	emit(c, 0xf7);
+	emit(c, 0xf9);
+	// push rax
+	emit_spush(c, R_RAX);
+}
+
+emit_mod(c: *compiler): void {
+        // pop rax
+        emit_spop(c, R_RAX);
+        // pop rcx
+        emit_spop(c, R_RCX);
+        // xor rdx, rdx
+        emit(c, 0x48);
+        emit(c, 0x31);
+        emit(c, 0xd2);
+        // test rax, rax
+        emit(c, 0x48);
+        emit(c, 0x85);
+        emit(c, 0xc0);
+        // sets dl
+        emit(c, 0x0f);
+        emit(c, 0x98);
+        emit(c, 0xc2);
+        // neg rdx
+        emit(c, 0x48);
+        emit(c, 0xf7);
+        emit(c, 0xda);
+        // idiv rcx
+        emit(c, 0x48);
+        emit(c, 0xf7);
+        emit(c, 0xf9);
+        // push rdx
+        emit_spush(c, R_RDX);
+}
+
+emit_lsh(c: *compiler): void {
+	// pop rax
+	emit_spop(c, R_RAX);
+	// pop rcx
+	emit_spop(c, R_RCX);
+	// shl rax, cl
+	emit(c, 0x48);
+	emit(c, 0xd3);
+	emit(c, 0xe0);
+	// push rax
+	emit_spush(c, R_RAX);
+}
+
+emit_rsh(c: *compiler): void {
+	// pop rax
+	emit_spop(c, R_RAX);
+	// pop rcx
+	emit_spop(c, R_RCX);
+	// shr rax, cl
+	emit(c, 0x48);
+	emit(c, 0xd3);
+	emit(c, 0xe8);
+	// push rax
+	emit_spush(c, R_RAX);
+}
+
+emit_not(c: *compiler): void {
+	// pop rax
+	emit_spop(c, R_RAX);
+	// neg rax
+	emit(c, 0x48);
+	emit(c, 0xf7);
+	emit(c, 0xd0);
+	// push rax
+	emit_spush(c, R_RAX);
+}
+
+emit_neg(c: *compiler): void {
+	// pop rax
+	emit_spop(c, R_RAX);
+	// neg rax
+	emit(c, 0x48);
+	emit(c, 0xf7);
+	emit(c, 0xd8);
+	// push rax
+	emit_spush(c, R_RAX);
+}
+
+// Emit a REX prefix if the operands need one
+emit_rex(c: *compiler, w: int, r: int, b: int): void {
+	var x: int;
+
+	x = 0x40;
+	if (w) {
+		x = x | 8;
+	}
+	if (r & 8) {
+		x = x | 4;
+	}
+	if (b & 8) {
+		x = x | 1;
+	}
+
+	if (x != 0x40) {
+		emit(c, x);
+	}
+}
+
+// Byte operands need a REX prefix to name sil and dil instead of dh and bh
+emit_rex8(c: *compiler, r: int, b: int): void {
+	if (r >= 4 || b >= 4) {
+		emit(c, 0x40 | ((r >> 3) << 2) | (b >> 3));
+	}
+}
+
+// modrm for a register operand
+emit_modrr(c: *compiler, r: int, b: int): void {
+	emit(c, 0xc0 | ((r & 7) << 3) | (b & 7));
+}
+
+// modrm for a [base + disp] operand
+emit_modrm(c: *compiler, r: int, base: int, disp: int): void {
+	if (disp >= -128 && disp <= 127) {
+		emit(c, 0x40 | ((r & 7) << 3) | (base & 7));
+		if ((base & 7) == R_RSP) {
+			emit(c, 0x24);
+		}
+		emit(c, disp);
+	} else {
+		emit(c, 0x80 | ((r & 7) << 3) | (base & 7));
+		if ((base & 7) == R_RSP) {
+			emit(c, 0x24);
+		}
+		emit(c, disp);
+		emit(c, disp >> 8);
+		emit(c, disp >> 16);
+		emit(c, disp >> 24);
+	}
+}
+
+emit_imm32(c: *compiler, x: int): void {
+	emit(c, x);
+	emit(c, x >> 8);
+	emit(c, x >> 16);
+	emit(c, x >> 24);
+}
+
+// op dst, src
+emit_alu_rr(c: *compiler, op: int, dst: int, src: int): void {
+	emit_rex(c, 1, src, dst);
+	emit(c, (op << 3) + 1);
+	emit_modrr(c, src, dst);
+}
+
+// op r, [base + disp]
+emit_alu_rm(c: *compiler, op: int, r: int, base: int, disp: int): void {
+	emit_rex(c, 1, r, base);
+	emit(c, (op << 3) + 3);
+	emit_modrm(c, r, base, disp);
+}
+
+// op r, x
+emit_alu_ri(c: *compiler, op: int, r: int, x: int): void {
+	emit_rex(c, 1, 0, r);
+	if (x >= -128 && x <= 127) {
+		emit(c, 0x83);
+		emit_modrr(c, op, r);
+		emit(c, x);
+	} else {
+		emit(c, 0x81);
+		emit_modrr(c, op, r);
+		emit_imm32(c, x);
+	}
+}
+
+// mov dst, src
+emit_mov_rr(c: *compiler, dst: int, src: int): void {
+	if (dst == src) {
+		return;
+	}
+
+	emit_rex(c, 1, src, dst);
+	emit(c, 0x89);
+	emit_modrr(c, src, dst);
+}
+
+// mov r, x
+emit_mov_ri(c: *compiler, r: int, x: int): void {
+	if (x == 0) {
+		// xor r32, r32
+		emit_rex(c, 0, r, r);
+		emit(c, 0x31);
+		emit_modrr(c, r, r);
+	} else if (x > 0) {
+		// mov r32, x
+		emit_rex(c, 0, 0, r);
+		emit(c, 0xb8 + (r & 7));
+		emit_imm32(c, x);
+	} else {
+		// mov r, sign extended x
+		emit_rex(c, 1, 0, r);
+		emit(c, 0xc7);
+		emit_modrr(c, 0, r);
+		emit_imm32(c, x);
+	}
+}
+
+// mov r, [base + disp]
+emit_mov_rm(c: *compiler, r: int, base: int, disp: int): void {
+	emit_rex(c, 1, r, base);
+	emit(c, 0x8b);
+	emit_modrm(c, r, base, disp);
+}
+
+// lea r, [base + disp]
+emit_lea_rm(c: *compiler, r: int, base: int, disp: int): void {
+	emit_rex(c, 1, r, base);
+	emit(c, 0x8d);
+	emit_modrm(c, r, base, disp);
+}
+
+// lea r, [l]
+emit_lea_rl(c: *compiler, r: int, l: *label): void {
+	emit_rex(c, 1, r, 0);
+	emit(c, 0x8d);
+	emit(c, ((r & 7) << 3) | 5);
+	addfixup(c, l);
+}
+
+// Load a value of type t into r
+emit_load_rm(c: *compiler, t: *type, r: int, base: int, disp: int): void {
+	if (t.kind == TY_BYTE) {
+		// movzx r, byte [base + disp]
+		emit_rex(c, 1, r, base);
+		emit(c, 0x0f);
+		emit(c, 0xb6);
+		emit_modrm(c, r, base, disp);
+	} else if (type_isprim(c, t)) {
+		emit_mov_rm(c, r, base, disp);
+	} else {
+		die(c, "invalid load");
+	}
+}
+
+// Store r as a value of type t
+emit_store_rm(c: *compiler, t: *type, r: int, base: int, disp: int): void {
+	if (t.kind == TY_BYTE) {
+		// mov [base + disp], r8
+		emit_rex8(c, r, base);
+		emit(c, 0x88);
+		emit_modrm(c, r, base, disp);
+	} else if (type_isprim(c, t)) {
+		emit_mov_mr(c, base, disp, r);
+	} else {
+		die(c, "invalid store");
+	}
+}
+
+// mov [base + disp], r
+emit_mov_mr(c: *compiler, base: int, disp: int, r: int): void {
+	emit_rex(c, 1, r, base);
+	emit(c, 0x89);
+	emit_modrm(c, r, base, disp);
+}
+
+// push r
+emit_push_r(c: *compiler, r: int): void {
+	emit_rex(c, 0, 0, r);
+	emit(c, 0x50 + (r & 7));
+}
+
+// push [base + disp]
+emit_push_m(c: *compiler, base: int, disp: int): void {
+	emit_rex(c, 0, 0, base);
+	emit(c, 0xff);
+	emit_modrm(c, 6, base, disp);
+}
+
+// pop r
+emit_pop_r(c: *compiler, r: int): void {
+	emit_rex(c, 0, 0, r);
+	emit(c, 0x58 + (r & 7));
+}
+
+// test r, r
+emit_test_rr(c: *compiler, r: int): void {
+	emit_rex(c, 1, r, r);
+	emit(c, 0x85);
+	emit_modrr(c, r, r);
+}
+
+// setcc r8; movzx r, r8
+emit_setcc_r(c: *compiler, cc: int, r: int): void {
+	emit_rex8(c, 0, r);
+	emit(c, 0x0f);
+	emit(c, 0x90 + cc);
+	emit_modrr(c, 0, r);
+	emit_rex(c, 1, r, r);
+	emit(c, 0x0f);
+	emit(c, 0xb6);
+	emit_modrr(c, r, r);
+}
+
+// jcc l
+emit_jcc(c: *compiler, cc: int, l: *label): void {
+	emit(c, 0x0f);
+	emit(c, 0x80 + cc);
+	addbranch(c, l, FIX_JCC, cc);
+}
+
+// call r
+emit_call_r(c: *compiler, r: int): void {
+	emit_rex(c, 0, 0, r);
+	emit(c, 0xff);
+	emit_modrr(c, 2, r);
+}
+
+// call l
+emit_call_l(c: *compiler, l: *label): void {
+	emit(c, 0xe8);
+	addfixup(c, l);
+}
+
+// not r
+emit_not_r(c: *compiler, r: int): void {
+	emit_rex(c, 1, 0, r);
+	emit(c, 0xf7);
+	emit_modrr(c, 2, r);
+}
+
+// neg r
+emit_neg_r(c: *compiler, r: int): void {
+	emit_rex(c, 1, 0, r);
+	emit(c, 0xf7);
+	emit_modrr(c, 3, r);
+}
+
+// cqo
+emit_cqo(c: *compiler): void {
 	emit(c, 0x48);
+	emit(c, 0x99);
+}
+
+// idiv r
+emit_idiv_r(c: *compiler, r: int): void {
+	emit_rex(c, 1, 0, r);
 	emit(c, 0xf7);
-	emit(c, 0xf9);
-	// push rax
-	emit(c, 0x50);
+	emit_modrr(c, 7, r);
 }
 
-emit_mod(c: *compiler): void {
-        // pop rax
-        emit(c, 0x58);
-        // pop rcx
-        emit(c, 0x59);
-        // xor rdx, rdx
-        emit(c, 0x48);
-        emit(c, 0x31);
-        emit(c, 0xd2);
-        // test rax, rax
-        emit(c, 0x48);
-        emit(c, 0x85);
-        emit(c, 0xc0);
-        // sets dl
-        emit(c, 0x0f);
-        emit(c, 0x98);
-        emit(c, 0xc2);
-        // neg rdx
-        emit(c, 0x48);
-        emit(c, 0xf7);
-        emit(c, 0xda);
-        // idiv rcx
-        emit(c, 0x48);
-        emit(c, 0xf7);
-        emit(c, 0xf9);
-        // push rdx
-        emit(c, 0x52);
+// imul dst, src
+emit_imul_rr(c: *compiler, dst: int, src: int): void {
+	emit_rex(c, 1, dst, src);
+	emit(c, 0x0f);
+	emit(c, 0xaf);
+	emit_modrr(c, dst, src);
 }
 
-emit_lsh(c: *compiler): void {
-	// pop rax
-	emit(c, 0x58);
-	// pop rcx
-	emit(c, 0x59);
-	// shl rax, cl
-	emit(c, 0x48);
+// imul r, [base + disp]
+emit_imul_rm(c: *compiler, r: int, base: int, disp: int): void {
+	emit_rex(c, 1, r, base);
+	emit(c, 0x0f);
+	emit(c, 0xaf);
+	emit_modrm(c, r, base, disp);
+}
+
+// imul dst, src, x
+emit_imul_ri(c: *compiler, dst: int, src: int, x: int): void {
+	emit_rex(c, 1, dst, src);
+	if (x >= -128 && x <= 127) {
+		emit(c, 0x6b);
+		emit_modrr(c, dst, src);
+		emit(c, x);
+	} else {
+		emit(c, 0x69);
+		emit_modrr(c, dst, src);
+		emit_imm32(c, x);
+	}
+}
+
+// shl r, cl
+emit_shl_r(c: *compiler, r: int): void {
+	emit_rex(c, 1, 0, r);
 	emit(c, 0xd3);
-	emit(c, 0xe0);
-	// push rax
-	emit(c, 0x50);
+	emit_modrr(c, 4, r);
 }
 
-emit_rsh(c: *compiler): void {
-	// pop rax
-	emit(c, 0x58);
-	// pop rcx
-	emit(c, 0x59);
-	// shr rax, cl
-	emit(c, 0x48);
+// shr r, cl
+emit_shr_r(c: *compiler, r: int): void {
+	emit_rex(c, 1, 0, r);
 	emit(c, 0xd3);
-	emit(c, 0xe8);
-	// push rax
-	emit(c, 0x50);
+	emit_modrr(c, 5, r);
 }
 
-emit_not(c: *compiler): void {
-	// pop rax
-	emit(c, 0x58);
-	// neg rax
-	emit(c, 0x48);
-	emit(c, 0xf7);
-	emit(c, 0xd0);
-	// push rax
-	emit(c, 0x50);
+// shl r, x
+emit_shl_ri(c: *compiler, r: int, x: int): void {
+	emit_rex(c, 1, 0, r);
+	emit(c, 0xc1);
+	emit_modrr(c, 4, r);
+	emit(c, x);
 }
 
-emit_neg(c: *compiler): void {
-	// pop rax
-	emit(c, 0x58);
-	// neg rax
-	emit(c, 0x48);
-	emit(c, 0xf7);
-	emit(c, 0xd8);
-	// push rax
-	emit(c, 0x50);
+// shr r, x
+emit_shr_ri(c: *compiler, r: int, x: int): void {
+	emit_rex(c, 1, 0, r);
+	emit(c, 0xc1);
+	emit_modrr(c, 5, r);
+	emit(c, x);
+}
+
+// sar r, x
+emit_sar_ri(c: *compiler, r: int, x: int): void {
+	emit_rex(c, 1, 0, r);
+	emit(c, 0xc1);
+	emit_modrr(c, 7, r);
+	emit(c, x);
 }
 
 gen_builtins(c: *compiler): void {
 	var d: *decl;
 
-	d = find(c, "syscall", 0:*byte, 1);
-	if (d.func_defined && !d.func_label.fixed) {
+	d = find(c, intern_str(c, "syscall"), 0:*byte, 1);
+	if (d.func_defined && !d.func_label.fixed && c.opt_regcall) {
+		fixup_label(c, d.func_label);
+		emit_mov_rr(c, R_RAX, R_RDI);
+		emit_mov_rr(c, R_RDI, R_RSI);
+		emit_mov_rr(c, R_RSI, R_RDX);
+		emit_mov_rr(c, R_RDX, R_RCX);
+		emit_mov_rr(c, R_R10, R_R8);
+		emit_mov_rr(c, R_R8, R_R9);
+		// The seventh argument is on the stack
+		emit_mov_rm(c, R_R9, R_RSP, 8);
+		// syscall
+		emit(c, 0x0f);
+		emit(c, 0x05);
+		// ret
+		emit(c, 0xc3);
+	} else if (d.func_defined && !d.func_label.fixed) {
 		d.func_defined = 1;
 		fixup_label(c, d.func_label);
 		// push rbp
@@ -4158,6 +10829,271 @@ gen_builtins(c: *compiler): void {
 		// ret
 		emit(c, 0xc3);
 	}
+
+	d = find(c, intern_str(c, "rdtsc"), 0:*byte, 1);
+	if (d.func_defined && !d.func_label.fixed) {
+		fixup_label(c, d.func_label);
+		// rdtsc
+		emit(c, 0x0f);
+		emit(c, 0x31);
+		// shl rdx, 32
+		emit(c, 0x48);
+		emit(c, 0xc1);
+		emit(c, 0xe2);
+		emit(c, 0x20);
+		// or rax, rdx
+		emit(c, 0x48);
+		emit(c, 0x09);
+		emit(c, 0xd0);
+		// ret
+		emit(c, 0xc3);
+	}
+}
+
+// Position of old text offset x once the short jumps in sites are shrunk
+relax_pos(sites: **fixup, saved: *int, n: int, x: int): int {
+	var lo: int;
+	var hi: int;
+	var mid: int;
+
+	// Count the jumps that start before x
+	lo = 0;
+	hi = n;
+	loop {
+		if (lo >= hi) {
+			break;
+		}
+		mid = (lo + hi) >> 1;
+		if (sites[mid].op < x) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return x - saved[lo];
+}
+
+// Find the next jump from i on that was shortened
+relax_next(sites: **fixup, n: int, i: int): int {
+	loop {
+		if (i == n || sites[i].rel8) {
+			return i;
+		}
+		i = i + 1;
+	}
+}
+
+// Shorten jumps whose target is in reach of a rel8 and rebuild the text.
+// Shrinking code only brings targets closer, so iterate until no more
+// jumps fit.
+relax(c: *compiler): void {
+	var sites: **fixup;
+	var saved: *int;
+	var f: *fixup;
+	var l: *label;
+	var b: *chunk;
+	var buf: *byte;
+	var n: int;
+	var i: int;
+	var j: int;
+	var k: int;
+	var changed: int;
+	var disp: int;
+	var size: int;
+	var skip: int;
+	var pos: int;
+	var next: int;
+	var m: int;
+
+	n = c.nbranch;
+	if (n == 0) {
+		return;
+	}
+
+	sites = alloc(c, n * sizeof(f)):**fixup;
+	saved = alloc(c, (n + 1) * sizeof(n)):*int;
+
+	i = 0;
+	f = c.fixups;
+	loop {
+		if (!f) {
+			break;
+		}
+		if (f.kind != FIX_REL32) {
+			sites[i] = f;
+			i = i + 1;
+		}
+		f = f.all;
+	}
+
+	loop {
+		saved[0] = 0;
+		i = 0;
+		loop {
+			if (i == n) {
+				break;
+			}
+			f = sites[i];
+			saved[i + 1] = saved[i];
+			if (f.rel8 && f.kind == FIX_JMP) {
+				saved[i + 1] = saved[i] + 3;
+			} else if (f.rel8) {
+				saved[i + 1] = saved[i] + 4;
+			}
+			i = i + 1;
+		}
+
+		changed = 0;
+		i = 0;
+		loop {
+			if (i == n) {
+				break;
+			}
+			f = sites[i];
+			if (!f.rel8 && f.l.fixed) {
+				// The jump itself is the last one before its end
+				disp = relax_pos(sites, saved, n, f.l.at) - (f.at - saved[i + 1]);
+				if (disp >= -128 && disp <= 127) {
+					f.rel8 = 1;
+					changed = 1;
+				}
+			}
+			i = i + 1;
+		}
+
+		if (!changed) {
+			break;
+		}
+	}
+
+	if (saved[n] == 0) {
+		return;
+	}
+
+	// Copy the text, replacing shortened jumps by their rel8 forms
+	size = c.at - saved[n];
+	buf = alloc(c, size);
+
+	k = relax_next(sites, n, 0);
+	next = c.at;
+	if (k < n) {
+		next = sites[k].op;
+	}
+
+	pos = 0;
+	j = 0;
+	skip = 0;
+	b = c.text;
+	i = 0;
+	loop {
+		if (!b) {
+			break;
+		}
+
+		if (i == b.fill) {
+			b = b.next;
+			i = 0;
+			continue;
+		}
+
+		m = b.fill - i;
+		if (skip > 0) {
+			if (m > skip) {
+				m = skip;
+			}
+			skip = skip - m;
+			i = i + m;
+			pos = pos + m;
+			continue;
+		}
+
+		if (pos == next) {
+			f = sites[k];
+			if (f.kind == FIX_JMP) {
+				// jmp rel8
+				buf[j] = 0xeb:byte;
+				skip = 5;
+			} else {
+				// jcc rel8
+				buf[j] = (0x70 + f.cc):byte;
+				skip = 6;
+			}
+			buf[j + 1] = 0:byte;
+			j = j + 2;
+
+			k = relax_next(sites, n, k + 1);
+			next = c.at;
+			if (k < n) {
+				next = sites[k].op;
+			}
+			continue;
+		}
+
+		if (m > next - pos) {
+			m = next - pos;
+		}
+		memcpy(&buf[j], &b.buf[i], m);
+		i = i + m;
+		j = j + m;
+		pos = pos + m;
+	}
+
+	// Move every fixup and label to the new text. The fixups are in order.
+	k = 0;
+	f = c.fixups;
+	loop {
+		if (!f) {
+			break;
+		}
+		loop {
+			if (k == n || sites[k].op >= f.at) {
+				break;
+			}
+			k = k + 1;
+		}
+		f.at = f.at - saved[k];
+		if (f.rel8) {
+			f.ptr = &buf[f.at - 1];
+		} else {
+			f.ptr = &buf[f.at - 4];
+		}
+		f = f.all;
+	}
+
+	l = c.labels;
+	loop {
+		if (!l) {
+			break;
+		}
+		if (l.fixed) {
+			l.at = relax_pos(sites, saved, n, l.at);
+		}
+		l = l.next;
+	}
+
+	f = c.fixups;
+	loop {
+		if (!f) {
+			break;
+		}
+		if (f.l.fixed && f.rel8) {
+			f.ptr[0] = (f.l.at - f.at):byte;
+		} else if (f.l.fixed) {
+			fixup(c, f.ptr, f.l.at - f.at);
+		}
+		f = f.all;
+	}
+
+	b = alloc(c, sizeof(*b)):*chunk;
+	b.buf = buf;
+	b.fill = size;
+	b.cap = size;
+	b.next = 0:*chunk;
+
+	c.text = b;
+	c.text_end = b;
+	c.at = size;
 }
 
 writeout(c: *compiler): void {
@@ -4166,204 +11102,283 @@ writeout(c: *compiler): void {
 	var text_size: int;
 	var load_addr: int;
 	var entry: int;
+	var rodata_off: int;
+	var rodata_addr: int;
 	var d: *decl;
+	var p: *istr;
 
 	load_addr = 0x100000;
 	text_size = c.at;
 
-	d = find(c, "_start", 0:*byte, 0);
+	d = find(c, intern_str(c, "_start"), 0:*byte, 0);
 	if (!d || !d.func_defined || !d.func_label.fixed) {
 		die(c, "_start is not defined");
 	}
 
-	entry = load_addr + d.func_label.at + 128;
-	text_size = text_size + 128;
+	entry = load_addr + d.func_label.at + 176;
+	text_size = text_size + 176;
+
+	// The read-only data follows the text in the file but is mapped a page
+	// later so it does not share the executable mapping
+	rodata_off = text_size;
+	rodata_addr = load_addr + rodata_off + 4096;
+
+	p = c.rodata;
+	loop {
+		if (!p) {
+			break;
+		}
+		place_label(c, p.lit, c.at + 4096 + p.lit_at);
+		p = p.lit_next;
+	}
 
 	// magic
-	putchar(0x7f);
-	putchar('E');
-	putchar('L');
-	putchar('F');
+	putchar(c, 0x7f);
+	putchar(c, 'E');
+	putchar(c, 'L');
+	putchar(c, 'F');
 
 	// class
-	putchar(2);
+	putchar(c, 2);
 
 	// endian
-	putchar(1);
+	putchar(c, 1);
 
 	// version
-	putchar(1);
+	putchar(c, 1);
 
 	// abi
-	putchar(0);
+	putchar(c, 0);
 
 	// abi version
-	putchar(0);
+	putchar(c, 0);
 
 	// padding
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
 
 	// type
-	putchar(2);
-	putchar(0);
+	putchar(c, 2);
+	putchar(c, 0);
 
 	// machine
-	putchar(62);
-	putchar(0);
+	putchar(c, 62);
+	putchar(c, 0);
 
 	// version
-	putchar(1);
-	putchar(0);
-	putchar(0);
-	putchar(0);
+	putchar(c, 1);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
 
 	// entry point
-	putchar(entry);
-	putchar(entry >> 8);
-	putchar(entry >> 16);
-	putchar(entry >> 24);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
+	putchar(c, entry);
+	putchar(c, entry >> 8);
+	putchar(c, entry >> 16);
+	putchar(c, entry >> 24);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
 
 	// phoff
-	putchar(64);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
+	putchar(c, 64);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
 
 	// shoff
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
 
 	// flags
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
 
 	// ehsize
-	putchar(64);
-	putchar(0);
+	putchar(c, 64);
+	putchar(c, 0);
 
 	// phentsize
-	putchar(56);
-	putchar(0);
+	putchar(c, 56);
+	putchar(c, 0);
 
 	// phnum
-	putchar(1);
-	putchar(0);
+	putchar(c, 2);
+	putchar(c, 0);
 
 	// shentsize
-	putchar(64);
-	putchar(0);
+	putchar(c, 64);
+	putchar(c, 0);
 
 	// shnum
-	putchar(0);
-	putchar(0);
+	putchar(c, 0);
+	putchar(c, 0);
 
 	// shstrndx
-	putchar(0);
-	putchar(0);
+	putchar(c, 0);
+	putchar(c, 0);
 
 	// phdr[0].type
-	putchar(1);
-	putchar(0);
-	putchar(0);
-	putchar(0);
+	putchar(c, 1);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
 
 	// phdr[0].flags
-	putchar(5);
-	putchar(0);
-	putchar(0);
-	putchar(0);
+	putchar(c, 5);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
 
 	// phdr[0].offset
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
 
 	// phdr[0].vaddr
-	putchar(0);
-	putchar(0);
-	putchar(0x10);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0x10);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
 
 	// phdr[0].paddr
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
 
 	// phdr[0].filesize
-	putchar(text_size);
-	putchar(text_size >> 8);
-	putchar(text_size >> 16);
-	putchar(text_size >> 24);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
+	putchar(c, text_size);
+	putchar(c, text_size >> 8);
+	putchar(c, text_size >> 16);
+	putchar(c, text_size >> 24);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
 
 	// phdr[0].memsize
-	putchar(text_size);
-	putchar(text_size >> 8);
-	putchar(text_size >> 16);
-	putchar(text_size >> 24);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
+	putchar(c, text_size);
+	putchar(c, text_size >> 8);
+	putchar(c, text_size >> 16);
+	putchar(c, text_size >> 24);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
 
 	// phdr[0].align
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-	putchar(0);
-
-	// nop sled
-	putchar(0x90);
-	putchar(0x90);
-	putchar(0x90);
-	putchar(0x90);
-	putchar(0x90);
-	putchar(0x90);
-	putchar(0x90);
-	putchar(0x90);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+
+	// phdr[1].type
+	putchar(c, 1);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+
+	// phdr[1].flags
+	putchar(c, 4);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+
+	// phdr[1].offset
+	putchar(c, rodata_off);
+	putchar(c, rodata_off >> 8);
+	putchar(c, rodata_off >> 16);
+	putchar(c, rodata_off >> 24);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+
+	// phdr[1].vaddr
+	putchar(c, rodata_addr);
+	putchar(c, rodata_addr >> 8);
+	putchar(c, rodata_addr >> 16);
+	putchar(c, rodata_addr >> 24);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+
+	// phdr[1].paddr
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+
+	// phdr[1].filesize
+	putchar(c, c.rodata_size);
+	putchar(c, c.rodata_size >> 8);
+	putchar(c, c.rodata_size >> 16);
+	putchar(c, c.rodata_size >> 24);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+
+	// phdr[1].memsize
+	putchar(c, c.rodata_size);
+	putchar(c, c.rodata_size >> 8);
+	putchar(c, c.rodata_size >> 16);
+	putchar(c, c.rodata_size >> 24);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+
+	// phdr[1].align
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
+	putchar(c, 0);
 
 	b = c.text;
 	loop {
@@ -4375,19 +11390,156 @@ writeout(c: *compiler): void {
 			if (i >= b.fill) {
 				break;
 			}
-			putchar(b.buf[i]: int);
+			putchar(c, b.buf[i]: int);
 			i = i + 1;
 		}
 		b = b.next;
 	}
+
+	p = c.rodata;
+	loop {
+		if (!p) {
+			break;
+		}
+		i = 0;
+		loop {
+			if (i > p.len) {
+				break;
+			}
+			putchar(c, p.s[i]: int);
+			i = i + 1;
+		}
+		p = p.lit_next;
+	}
+}
+
+// Parse command line flags
+parse_args(c: *compiler, argv: **byte): void {
+	var i: int;
+	var arg: *byte;
+
+	if (!argv[0]) {
+		return;
+	}
+
+	i = 1;
+	loop {
+		arg = argv[i];
+		if (!arg) {
+			break;
+		}
+
+		if (!strcmp(arg, "-O")) {
+			c.opt_regs = 1;
+			c.opt_peep = 1;
+			c.opt_fold = 1;
+			c.opt_branch = 1;
+		} else if (!strcmp(arg, "-fregs")) {
+			c.opt_regs = 1;
+		} else if (!strcmp(arg, "-fpeep")) {
+			c.opt_peep = 1;
+		} else if (!strcmp(arg, "-fir")) {
+			c.opt_ir = 1;
+		} else if (!strcmp(arg, "-ffold")) {
+			c.opt_fold = 1;
+		} else if (!strcmp(arg, "-fbranch")) {
+			c.opt_branch = 1;
+		} else if (!strcmp(arg, "-finline")) {
+			c.opt_ir = 1;
+			c.opt_inline = 1;
+		} else if (!strcmp(arg, "-fregcall")) {
+			c.opt_regcall = 1;
+		} else if (!strcmp(arg, "-floop")) {
+			c.opt_ir = 1;
+			c.opt_loop = 1;
+		} else if (!strcmp(arg, "-fdfa")) {
+			c.opt_dfa = 1;
+		} else if (!strcmp(arg, "-stats")) {
+			c.opt_stats = 1;
+		} else {
+			die(c, "invalid option");
+		}
+
+		i = i + 1;
+	}
+}
+
+// Report the time since the last phase ended
+stat_phase(c: *compiler, name: *byte): void {
+	var ts: timespec;
+	var wall: int;
+	var tsc: int;
+
+	if (!c.opt_stats) {
+		return;
+	}
+
+	clock_gettime(1, &ts);
+	wall = ts.sec * 1000000000 + ts.nsec;
+	tsc = rdtsc();
+
+	if (name) {
+		fdput(2, "stats: ");
+		fdput(2, name);
+		fdput(2, " ");
+		fdputd(2, (wall - c.stat_wall) / 1000);
+		fdput(2, " us ");
+		fdputd(2, tsc - c.stat_tsc);
+		fdput(2, " cycles\n");
+	}
+
+	c.stat_wall = wall;
+	c.stat_tsc = tsc;
+}
+
+stat_count(c: *compiler, name: *byte, n: int): void {
+	fdput(2, "stats: ");
+	fdput(2, name);
+	fdput(2, " ");
+	fdputd(2, n);
+	fdput(2, "\n");
+}
+
+// Print what was allocated and emitted
+stat_report(c: *compiler): void {
+	if (!c.opt_stats) {
+		return;
+	}
+
+	// Lexing happens during parsing
+	fdput(2, "stats: lex ");
+	fdputd(2, c.stat_lex);
+	fdput(2, " cycles\n");
+
+	stat_count(c, "tokens", c.stat_tokens);
+
+	stat_count(c, "nodes", c.stat_nodes);
+	stat_count(c, "decls", c.decl_count);
+	stat_count(c, "strings", c.istr_count);
+	stat_count(c, "labels", c.stat_labels);
+	stat_count(c, "fixups", c.stat_fixups);
+	stat_count(c, "bytes", c.at);
+	stat_count(c, "rodata", c.rodata_size);
+	stat_count(c, "pages", c.stat_pages);
+	stat_count(c, "mapped", c.stat_mapped);
 }
 
-main(): void {
+main(argv: **byte): void {
 	var c: compiler;
 	var p: *node;
 	comp_setup(&c);
+	parse_args(&c, argv);
+	stat_phase(&c, 0:*byte);
+	lex_start(&c);
 	p = parse_program(&c);
+	stat_phase(&c, "parse");
 	compile(&c, p);
+	stat_phase(&c, "compile");
 	gen_builtins(&c);
+	relax(&c);
+	stat_phase(&c, "relax");
 	writeout(&c);
+	fflush(&c.out);
+	stat_phase(&c, "writeout");
+	stat_report(&c);
 }
@@ -8,29 +8,6 @@ write(fd: int, buf: *byte, n: int): int {
 	return syscall(1, fd, buf: int, n, 0, 0, 0);
 }
 
-getchar(): int {
-	var b: byte;
-	var ret: int;
-	ret = read(0, &b, 1);
-	if (ret < 0) {
-		exit(3);
-	}
-	if (ret == 0) {
-		return -1;
-	}
-	return b: int;
-}
-
-putchar(ch: int): void {
-	var b: byte;
-	var ret: int;
-	b = ch: byte;
-	ret = write(1, &b, 1);
-	if (ret != 1) {
-		exit(3);
-	}
-}
-
 exit(n: int): void {
 	syscall(60, n, 0, 0, 0, 0, 0);
 }
@@ -57,36 +34,6 @@ strcmp(a: *byte, b: *byte): int {
 	}
 }
 
-fdputc(fd: int, ch: int): void {
-	var b: byte;
-	var ret: int;
-	b = ch: byte;
-	ret = write(fd, &b, 1);
-	if (ret != 1) {
-		exit(3);
-	}
-}
-
-
-fdputd(fd: int, n: int): void {
-	var a: int;
-
-	if (n < 0) {
-		fdputc(fd, '-');
-		a = -(n % 10);
-		n = n / -10;
-	} else {
-		a = n % 10;
-		n = n / 10;
-	}
-
-	if (n != 0) {
-		fdputd(fd, n);
-	}
-
-	fdputc(fd, '0' + a);
-}
-
 fdput(fd: int, msg: *byte): void {
 	var len: int;
 	var ret: int;
@@ -190,13 +137,112 @@ alloc(a: *allocator, size: int): *byte {
 	return ret;
 }
 
-_start(): void {
-	main();
+struct file {
+	fd: int;
+	buf: *byte;
+	pos: int;
+	len: int;
+	cap: int;
+}
+
+open_file(a: *allocator, f: *file, fd: int): void {
+	f.fd = fd;
+	f.cap = 64 * 1024;
+	f.buf = alloc(a, f.cap);
+	f.pos = 0;
+	f.len = 0;
+}
+
+fgetc(f: *file): int {
+	var ret: int;
+
+	if (f.pos == f.len) {
+		ret = read(f.fd, f.buf, f.cap);
+		if (ret < 0) {
+			exit(3);
+		}
+		if (ret == 0) {
+			return -1;
+		}
+		f.pos = 0;
+		f.len = ret;
+	}
+
+	ret = f.buf[f.pos]: int;
+	f.pos = f.pos + 1;
+
+	return ret;
+}
+
+fflush(f: *file): void {
+	var ret: int;
+	var off: int;
+
+	off = 0;
+	loop {
+		if (off == f.len) {
+			break;
+		}
+		ret = write(f.fd, &f.buf[off], f.len - off);
+		if (ret <= 0) {
+			exit(3);
+		}
+		off = off + ret;
+	}
+
+	f.len = 0;
+}
+
+fputc(f: *file, ch: int): void {
+	if (f.len == f.cap) {
+		fflush(f);
+	}
+
+	f.buf[f.len] = ch: byte;
+	f.len = f.len + 1;
+}
+
+fputs(f: *file, s: *byte): void {
+	var i: int;
+
+	i = 0;
+	loop {
+		if (!s[i]) {
+			break;
+		}
+		fputc(f, s[i]:int);
+		i = i + 1;
+	}
+}
+
+fputd(f: *file, n: int): void {
+	var a: int;
+
+	if (n < 0) {
+		fputc(f, '-');
+		a = -(n % 10);
+		n = n / -10;
+	} else {
+		a = n % 10;
+		n = n / 10;
+	}
+
+	if (n != 0) {
+		fputd(f, n);
+	}
+
+	fputc(f, '0' + a);
+}
+
+_start(argv0: *byte): void {
+	main(&argv0);
 	exit(0);
 }
 
 struct compiler {
 	a: allocator;
+	in: file;
+	out: file;
 	nc: int;
 	lineno: int;
 	colno: int;
@@ -209,12 +255,30 @@ struct compiler {
 	ntags: int;
 	nnfa: int;
 	ndfa: int;
-	d: *dfa;
+	states: **dfa;
+	dtab: **dfa;
+	dcap: int;
+	bound: *byte;
+	nspan: int;
+	span_of: *int;
+	span_lo: *int;
+	moves: **nfa;
+	mcap: int;
+	mcount: *int;
+	mstart: *int;
+	prefix: *byte;
+	table: int;
+	ncls: int;
+	tchunk: int;
 }
 
 setup(c: *compiler): void {
+	var i: int;
+
 	setup_alloc(&c.a);
-	c.nc = getchar();
+	open_file(&c.a, &c.in, 0);
+	open_file(&c.a, &c.out, 1);
+	c.nc = fgetc(&c.in);
 	c.lineno = 1;
 	c.colno = 1;
 	c.tt = 0;
@@ -226,12 +290,34 @@ setup(c: *compiler): void {
 	c.ntags = 0;
 	c.nnfa = 0;
 	c.ndfa = 0;
-	c.d = 0:*dfa;
+	c.states = 0:**dfa;
+	c.dtab = 0:**dfa;
+	c.dcap = 0;
+	c.bound = alloc(&c.a, 257);
+	i = 0;
+	loop {
+		if (i == 257) {
+			break;
+		}
+		c.bound[i] = 0:byte;
+		i = i + 1;
+	}
+	c.nspan = 0;
+	c.span_of = 0:*int;
+	c.span_lo = 0:*int;
+	c.moves = 0:**nfa;
+	c.mcap = 0;
+	c.mcount = 0:*int;
+	c.mstart = 0:*int;
+	c.prefix = "T_";
+	c.table = 0;
+	c.ncls = 0;
+	c.tchunk = 0;
 	feed(c);
 }
 
 feedc(c: *compiler): void {
-	c.nc = getchar();
+	c.nc = fgetc(&c.in);
 	if (c.nc == '\n') {
 		c.lineno = c.lineno + 1;
 		c.colno = 0;
@@ -551,9 +637,7 @@ feed_charset(c: *compiler): void {
 			break;
 		}
 
-		a = nfa_empty(c);
-		a.left = left;
-		a.right = right;
+		a = nfa_range(c, left, right);
 
 		c.n = nfa_alt(c, c.n, a);
 	}
@@ -639,14 +723,21 @@ nfa_empty(c: *compiler): *nfa {
 	return n;
 }
 
-nfa_literal(c: *compiler, a: byte): *nfa {
+// Match one byte in [left, right) and note the ends for the spans
+nfa_range(c: *compiler, left: int, right: int): *nfa {
 	var n: *nfa;
 	n = nfa_empty(c);
-	n.left = a:int;
-	n.right = n.left + 1;
+	n.left = left;
+	n.right = right;
+	c.bound[left] = 1:byte;
+	c.bound[right] = 1:byte;
 	return n;
 }
 
+nfa_literal(c: *compiler, a: byte): *nfa {
+	return nfa_range(c, a:int, (a:int) + 1);
+}
+
 nfa_alt(c: *compiler, a: *nfa, b: *nfa): *nfa {
 	var i: *nfa;
 	var o: *nfa;
@@ -714,9 +805,7 @@ parse_dot(c: *compiler): *nfa {
 		return 0:*nfa;
 	}
 	feed(c);
-	n = nfa_empty(c);
-	n.left = 0;
-	n.right = 256;
+	n = nfa_range(c, 0, 256);
 	return n;
 }
 
@@ -891,8 +980,8 @@ struct dfa {
 	id: int;
 	link: **dfa;
 	key: nlist;
-	l: *dfa;
-	r: *dfa;
+	hash: int;
+	hnext: *dfa;
 	seen: int;
 }
 
@@ -1040,6 +1129,7 @@ nlist_sort(l: *nlist): void {
 			if (tmp.id >= l.live[k].id) {
 				break;
 			}
+			l.live[j] = l.live[k];
 			j = k;
 		}
 		l.live[j] = tmp;
@@ -1077,106 +1167,697 @@ nlist_copy(c: *compiler, dest: *nlist, src: *nlist): void {
 	}
 }
 
-nlist2dfa(c: *compiler, l: *nlist): *dfa {
+deactivate(l: *nlist): void {
+	var i: int;
+	i = 0;
+	loop {
+		if (i >= l.fill) {
+			l.fill = 0;
+			l.tag = 0: *tag;
+			break;
+		}
+		l.live[i].live = 0;
+		i = i + 1;
+	}
+}
+
+// Hash a sorted set of NFA states
+nlist_hash(l: *nlist): int {
+	var h: int;
+	var i: int;
+
+	h = 5381;
+	i = 0;
+	loop {
+		if (i >= l.fill) {
+			break;
+		}
+		h = h * 33 + l.live[i].id;
+		i = i + 1;
+	}
+
+	return h;
+}
+
+// Double the size of the table of DFA states
+dfa_grow(c: *compiler): void {
+	var table: **dfa;
+	var states: **dfa;
 	var link: **dfa;
 	var d: *dfa;
-	var n: *nfa;
-	var t: *tag;
-	var dir: int;
+	var cap: int;
 	var i: int;
-	var j: int;
+
+	cap = c.dcap * 2;
+	if (cap == 0) {
+		cap = 256;
+	}
+
+	table = alloc(&c.a, sizeof(d) * cap):**dfa;
+	states = alloc(&c.a, sizeof(d) * cap):**dfa;
+
+	i = 0;
+	loop {
+		if (i == cap) {
+			break;
+		}
+		table[i] = 0:*dfa;
+		states[i] = 0:*dfa;
+		i = i + 1;
+	}
+
+	i = 0;
+	loop {
+		if (i == c.ndfa) {
+			break;
+		}
+		d = c.states[i];
+		states[i] = d;
+		link = &table[d.hash & (cap - 1)];
+		d.hnext = *link;
+		*link = d;
+		i = i + 1;
+	}
+
+	c.dtab = table;
+	c.states = states;
+	c.dcap = cap;
+}
+
+// Find the DFA state for a sorted set of NFA states, or queue a new one
+nlist2dfa(c: *compiler, l: *nlist): *dfa {
+	var link: **dfa;
+	var d: *dfa;
+	var h: int;
 
 	if (l.fill == 0 && !l.tag) {
 		return 0:*dfa;
 	}
 
-	link = &c.d;
+	if (c.ndfa * 2 >= c.dcap) {
+		dfa_grow(c);
+	}
+
+	h = nlist_hash(l);
+	link = &c.dtab[h & (c.dcap - 1)];
 	loop {
 		d = *link;
 		if (!d) {
 			break;
 		}
 
-		dir = nlist_cmp(l, &d.key);
-
-		if (dir < 0) {
-			link = &d.l;
-		} else if (dir > 0) {
-			link = &d.r;
-		} else {
+		if (d.hash == h && !nlist_cmp(l, &d.key)) {
 			return d;
 		}
+
+		link = &d.hnext;
 	}
 
 	d = alloc(&c.a, sizeof(*d)): *dfa;
 	d.id = c.ndfa;
 	d.link = alloc_link(c);
 	nlist_copy(c, &d.key, l);
-	d.l = 0: *dfa;
-	d.r = 0: *dfa;
+	d.hash = h;
+	d.hnext = 0:*dfa;
 	d.seen = 0;
 
+	*link = d;
+	c.states[c.ndfa] = d;
 	c.ndfa = c.ndfa + 1;
 
-	*link = d;
+	return d;
+}
+
+// Check if two spans have the same moves out of the state being expanded
+same_moves(c: *compiler, a: int, b: int): int {
+	var i: int;
+	var j: int;
+
+	i = c.mstart[a];
+	j = c.mstart[b];
+	if (c.mstart[a + 1] - i != c.mstart[b + 1] - j) {
+		return 0;
+	}
 
-	i = 0;
 	loop {
-		if (i == 256) {
+		if (i == c.mstart[a + 1]) {
 			break;
 		}
+		if (c.moves[i] != c.moves[j]) {
+			return 0;
+		}
+		i = i + 1;
+		j = j + 1;
+	}
 
-		deactivate(l);
-		j = 0;
-		loop {
-			if (j >= d.key.fill) {
-				break;
+	return 1;
+}
+
+// Fill in the links of a DFA state. The range states in its set are
+// bucketed by the spans they match, and each span with any moves leads to
+// the closure of their successors. Runs of spans with the same moves, such
+// as the letters that only continue an identifier, share one closure.
+dfa_expand(c: *compiler, d: *dfa, l: *nlist): void {
+	var n: *nfa;
+	var t: *dfa;
+	var count: *int;
+	var start: *int;
+	var total: int;
+	var prev: int;
+	var i: int;
+	var j: int;
+	var k: int;
+	var hi: int;
+
+	count = c.mcount;
+	start = c.mstart;
+
+	k = 0;
+	loop {
+		if (k > c.nspan) {
+			break;
+		}
+		count[k] = 0;
+		k = k + 1;
+	}
+
+	total = 0;
+	j = 0;
+	loop {
+		if (j >= d.key.fill) {
+			break;
+		}
+		n = d.key.live[j];
+		if (n.left >= 0 && n.left < n.right) {
+			k = c.span_of[n.left];
+			hi = c.span_of[n.right - 1];
+			loop {
+				if (k > hi) {
+					break;
+				}
+				count[k] = count[k] + 1;
+				total = total + 1;
+				k = k + 1;
+			}
+		}
+		j = j + 1;
+	}
+
+	if (total > c.mcap) {
+		c.mcap = total * 2;
+		c.moves = alloc(&c.a, sizeof(n) * c.mcap):**nfa;
+	}
+
+	start[0] = 0;
+	k = 0;
+	loop {
+		if (k == c.nspan) {
+			break;
+		}
+		start[k + 1] = start[k] + count[k];
+		count[k] = start[k];
+		k = k + 1;
+	}
+
+	j = 0;
+	loop {
+		if (j >= d.key.fill) {
+			break;
+		}
+		n = d.key.live[j];
+		if (n.left >= 0 && n.left < n.right) {
+			k = c.span_of[n.left];
+			hi = c.span_of[n.right - 1];
+			loop {
+				if (k > hi) {
+					break;
+				}
+				c.moves[count[k]] = n;
+				count[k] = count[k] + 1;
+				k = k + 1;
 			}
+		}
+		j = j + 1;
+	}
+
+	t = 0:*dfa;
+	prev = -1;
+	k = 0;
+	loop {
+		if (k == c.nspan) {
+			break;
+		}
 
-			n = d.key.live[j];
-			if (n.left <= i && i < n.right) {
+		if (start[k] != start[k + 1] && (prev < 0 || !same_moves(c, prev, k))) {
+			deactivate(l);
+			i = start[k];
+			loop {
+				if (i == start[k + 1]) {
+					break;
+				}
+				n = c.moves[i];
 				if (n.a) {
 					activate(l, n.a);
 				}
 				if (n.b) {
 					activate(l, n.b);
 				}
+				i = i + 1;
 			}
+			nlist_sort(l);
 
-			j = j + 1;
+			t = nlist2dfa(c, l);
+			prev = k;
 		}
 
-		d.link[i] = nlist2dfa(c, l);
+		if (start[k] != start[k + 1]) {
+			i = c.span_lo[k];
+			loop {
+				if (i == c.span_lo[k + 1]) {
+					break;
+				}
+				d.link[i] = t;
+				i = i + 1;
+			}
+		}
 
-		i = i + 1;
+		k = k + 1;
 	}
-
-	return d;
 }
 
-deactivate(l: *nlist): void {
+// Split the bytes into spans at the ends of every range in the NFA
+spans(c: *compiler): void {
 	var i: int;
+	var k: int;
+
+	c.span_of = alloc(&c.a, sizeof(i) * 256):*int;
+	c.span_lo = alloc(&c.a, sizeof(i) * 257):*int;
+
+	k = -1;
 	i = 0;
 	loop {
-		if (i >= l.fill) {
-			l.fill = 0;
-			l.tag = 0: *tag;
+		if (i == 256) {
 			break;
 		}
-		l.live[i].live = 0;
+		if (i == 0 || c.bound[i]) {
+			k = k + 1;
+			c.span_lo[k] = i;
+		}
+		c.span_of[i] = k;
 		i = i + 1;
 	}
+
+	c.nspan = k + 1;
+	c.span_lo[c.nspan] = 256;
+
+	c.mcount = alloc(&c.a, sizeof(i) * (c.nspan + 1)):*int;
+	c.mstart = alloc(&c.a, sizeof(i) * (c.nspan + 1)):*int;
 }
 
+// Build the DFA with the subset construction. The states are expanded in
+// the order they are found, so the work list is just the table of states.
 powerset(c: *compiler, n: *nfa): *dfa {
 	var live: nlist;
+	var a: *dfa;
+	var i: int;
+
+	spans(c);
 	alloc_nlist(c, &live, c.nnfa);
 	activate(&live, n);
-	return nlist2dfa(c, &live);
+	nlist_sort(&live);
+	a = nlist2dfa(c, &live);
+
+	i = 0;
+	loop {
+		if (i >= c.ndfa) {
+			break;
+		}
+		dfa_expand(c, c.states[i], &live);
+		i = i + 1;
+	}
+
+	return a;
 }
 
-codegen(c: *compiler, a: *dfa): void {
-	var i: int;
+// Partition of the DFA states for minimisation. The states of each block
+// are kept together in elem, and the ones marked by the current splitter
+// are moved to the front of their block up to mid.
+struct partition {
+	n: int;
+	nblocks: int;
+	block: *int;
+	elem: *int;
+	loc: *int;
+	first: *int;
+	end: *int;
+	mid: *int;
+	inw: *int;
+	work: *int;
+	nwork: int;
+	touched: *int;
+	ntouched: int;
+}
+
+alloc_ints(c: *compiler, n: int, x: int): *int {
+	var p: *int;
+	var i: int;
+	p = alloc(&c.a, sizeof(i) * n):*int;
+	i = 0;
+	loop {
+		if (i == n) {
+			break;
+		}
+		p[i] = x;
+		i = i + 1;
+	}
+	return p;
+}
+
+part_push(p: *partition, b: int): void {
+	if (p.inw[b]) {
+		return;
+	}
+	p.inw[b] = 1;
+	p.work[p.nwork] = b;
+	p.nwork = p.nwork + 1;
+}
+
+part_mark(p: *partition, s: int): void {
+	var b: int;
+	var i: int;
+	var t: int;
+
+	b = p.block[s];
+	i = p.loc[s];
+	if (i < p.mid[b]) {
+		return;
+	}
+
+	if (p.mid[b] == p.first[b]) {
+		p.touched[p.ntouched] = b;
+		p.ntouched = p.ntouched + 1;
+	}
+
+	t = p.elem[p.mid[b]];
+	p.elem[i] = t;
+	p.loc[t] = i;
+	p.elem[p.mid[b]] = s;
+	p.loc[s] = p.mid[b];
+	p.mid[b] = p.mid[b] + 1;
+}
+
+// Split the touched blocks into their marked and unmarked states
+part_split(p: *partition): void {
+	var b: int;
+	var nb: int;
+	var i: int;
+
+	loop {
+		if (p.ntouched == 0) {
+			break;
+		}
+		p.ntouched = p.ntouched - 1;
+		b = p.touched[p.ntouched];
+
+		if (p.mid[b] == p.end[b]) {
+			p.mid[b] = p.first[b];
+			continue;
+		}
+
+		nb = p.nblocks;
+		p.nblocks = p.nblocks + 1;
+		p.first[nb] = p.first[b];
+		p.end[nb] = p.mid[b];
+		p.mid[nb] = p.first[nb];
+		p.inw[nb] = 0;
+		p.first[b] = p.mid[b];
+
+		i = p.first[nb];
+		loop {
+			if (i == p.end[nb]) {
+				break;
+			}
+			p.block[p.elem[i]] = nb;
+			i = i + 1;
+		}
+
+		// Both halves need to be splitters if the block was waiting,
+		// otherwise the smaller one is enough
+		if (p.inw[b] || p.end[nb] - p.first[nb] < p.end[b] - p.first[b]) {
+			part_push(p, nb);
+		} else {
+			part_push(p, b);
+		}
+	}
+}
+
+// Merge equivalent states with Hopcroft's partition refinement. States start
+// out split by the tag they accept. A sink stands in for the missing
+// transitions, so states that can never accept join it and are dropped.
+minimize(c: *compiler, a: *dfa): *dfa {
+	var p: partition;
+	var all: **dfa;
+	var head: *int;
+	var nextp: *int;
+	var key: *int;
+	var rep: *int;
+	var splitter: *int;
+	var n: int;
+	var sink: int;
+	var s: int;
+	var t: int;
+	var b: int;
+	var e: int;
+	var i: int;
+	var ch: int;
+	var len: int;
+	var d: *dfa;
+
+	if (!a) {
+		return a;
+	}
+
+	n = c.ndfa + 1;
+	sink = c.ndfa;
+	all = c.states;
+
+	// Link the predecessors of each state on each byte
+	head = alloc_ints(c, n * 256, -1);
+	nextp = alloc_ints(c, n * 256, -1);
+	s = 0;
+	loop {
+		if (s == n) {
+			break;
+		}
+		ch = 0;
+		loop {
+			if (ch == 256) {
+				break;
+			}
+			t = sink;
+			if (s != sink && all[s].link[ch]) {
+				t = all[s].link[ch].id;
+			}
+			e = s * 256 + ch;
+			nextp[e] = head[t * 256 + ch];
+			head[t * 256 + ch] = e;
+			ch = ch + 1;
+		}
+		s = s + 1;
+	}
+
+	p.n = n;
+	p.nblocks = 0;
+	p.block = alloc_ints(c, n, 0);
+	p.elem = alloc_ints(c, n, 0);
+	p.loc = alloc_ints(c, n, 0);
+	p.first = alloc_ints(c, n, 0);
+	p.end = alloc_ints(c, n, 0);
+	p.mid = alloc_ints(c, n, 0);
+	p.inw = alloc_ints(c, n, 0);
+	p.work = alloc_ints(c, n, 0);
+	p.nwork = 0;
+	p.touched = alloc_ints(c, n, 0);
+	p.ntouched = 0;
+
+	// Start with a block for each tag
+	key = alloc_ints(c, c.ntags + 1, -1);
+	s = 0;
+	loop {
+		if (s == n) {
+			break;
+		}
+		i = 0;
+		if (s != sink && all[s].key.tag) {
+			i = all[s].key.tag.id + 1;
+		}
+		if (key[i] == -1) {
+			key[i] = p.nblocks;
+			p.nblocks = p.nblocks + 1;
+		}
+		b = key[i];
+		p.block[s] = b;
+		p.end[b] = p.end[b] + 1;
+		s = s + 1;
+	}
+
+	i = 0;
+	b = 0;
+	loop {
+		if (b == p.nblocks) {
+			break;
+		}
+		len = p.end[b];
+		p.first[b] = i;
+		p.mid[b] = i;
+		p.end[b] = i;
+		i = i + len;
+		part_push(&p, b);
+		b = b + 1;
+	}
+
+	s = 0;
+	loop {
+		if (s == n) {
+			break;
+		}
+		b = p.block[s];
+		p.elem[p.end[b]] = s;
+		p.loc[s] = p.end[b];
+		p.end[b] = p.end[b] + 1;
+		s = s + 1;
+	}
+
+	// Refine until no splitter separates any block
+	splitter = alloc_ints(c, n, 0);
+	loop {
+		if (p.nwork == 0) {
+			break;
+		}
+		p.nwork = p.nwork - 1;
+		b = p.work[p.nwork];
+		p.inw[b] = 0;
+
+		// The block may be split while it is used, so keep its states
+		len = p.end[b] - p.first[b];
+		i = 0;
+		loop {
+			if (i == len) {
+				break;
+			}
+			splitter[i] = p.elem[p.first[b] + i];
+			i = i + 1;
+		}
+
+		ch = 0;
+		loop {
+			if (ch == 256) {
+				break;
+			}
+
+			i = 0;
+			loop {
+				if (i == len) {
+					break;
+				}
+				e = head[splitter[i] * 256 + ch];
+				loop {
+					if (e == -1) {
+						break;
+					}
+					part_mark(&p, e >> 8);
+					e = nextp[e];
+				}
+				i = i + 1;
+			}
+
+			part_split(&p);
+
+			ch = ch + 1;
+		}
+	}
+
+	// The start state stands for its block, and the first state found for
+	// each of the others
+	rep = alloc_ints(c, p.nblocks, -1);
+	rep[p.block[a.id]] = a.id;
+	s = 0;
+	loop {
+		if (s == sink) {
+			break;
+		}
+		if (rep[p.block[s]] == -1) {
+			rep[p.block[s]] = s;
+		}
+		s = s + 1;
+	}
+
+	// Point the links of the representatives at each other
+	s = 0;
+	loop {
+		if (s == sink) {
+			break;
+		}
+		d = all[s];
+		if (rep[p.block[s]] == s) {
+			ch = 0;
+			loop {
+				if (ch == 256) {
+					break;
+				}
+				if (d.link[ch]) {
+					b = p.block[d.link[ch].id];
+					if (b == p.block[sink]) {
+						d.link[ch] = 0:*dfa;
+					} else {
+						d.link[ch] = all[rep[b]];
+					}
+				}
+				ch = ch + 1;
+			}
+		}
+		s = s + 1;
+	}
+
+	s = 0;
+	loop {
+		if (s == sink) {
+			break;
+		}
+		all[s].id = -1;
+		s = s + 1;
+	}
+
+	c.ndfa = 0;
+	renumber(c, a);
+
+	return a;
+}
+
+// Number the states left reachable from the start in depth first order
+renumber(c: *compiler, a: *dfa): void {
+	var i: int;
+
+	if (a.id != -1) {
+		return;
+	}
+	a.id = c.ndfa;
+	c.ndfa = c.ndfa + 1;
+
+	i = 0;
+	loop {
+		if (i == 256) {
+			break;
+		}
+		if (a.link[i]) {
+			renumber(c, a.link[i]);
+		}
+		i = i + 1;
+	}
+}
+
+codegen(c: *compiler, a: *dfa): void {
+	var i: int;
 	var b: *dfa;
 	var lo: int;
 	var hi: int;
@@ -1186,17 +1867,18 @@ codegen(c: *compiler, a: *dfa): void {
 	}
 	a.seen = 1;
 
-	fdput(1, ":_");
-	fdputd(1, a.id);
-	fdput(1, ";\n");
+	fputs(&c.out, ":_");
+	fputd(&c.out, a.id);
+	fputs(&c.out, ";\n");
 
 	if (a.key.tag) {
-		fdput(1, "\tlexmark(l, T_");
-		fdput(1, a.key.tag.s);
-		fdput(1, ");\n");
+		fputs(&c.out, "\tlexmark(l, ");
+		fputs(&c.out, c.prefix);
+		fputs(&c.out, a.key.tag.s);
+		fputs(&c.out, ");\n");
 	}
 
-	fdput(1, "\tch = lexfeedc(l);\n");
+	fputs(&c.out, "\tch = lexfeedc(l);\n");
 
 	i = 0;
 	loop {
@@ -1223,22 +1905,22 @@ codegen(c: *compiler, a: *dfa): void {
 		}
 
 		if (lo != (hi - 1)) {
-			fdput(1, "\tif (ch >= ");
-			fdputd(1, lo);
-			fdput(1, " && ch <= ");
-			fdputd(1, hi - 1);
+			fputs(&c.out, "\tif (ch >= ");
+			fputd(&c.out, lo);
+			fputs(&c.out, " && ch <= ");
+			fputd(&c.out, hi - 1);
 		} else {
-			fdput(1, "\tif (ch == ");
-			fdputd(1, lo);
+			fputs(&c.out, "\tif (ch == ");
+			fputd(&c.out, lo);
 		}
-		fdput(1, ") { ");
-		fdput(1, "goto _");
-		fdputd(1, b.id);
-		fdput(1, "; }\n");
+		fputs(&c.out, ") { ");
+		fputs(&c.out, "goto _");
+		fputd(&c.out, b.id);
+		fputs(&c.out, "; }\n");
 
 	}
 
-	fdput(1, "\treturn;\n");
+	fputs(&c.out, "\treturn;\n");
 
 	i = 0;
 	loop {
@@ -1254,36 +1936,576 @@ codegen(c: *compiler, a: *dfa): void {
 	}
 }
 
+// Index the states reachable from a by id
+gather(a: *dfa, all: **dfa): void {
+	var i: int;
+
+	if (all[a.id]) {
+		return;
+	}
+	all[a.id] = a;
+
+	i = 0;
+	loop {
+		if (i == 256) {
+			break;
+		}
+		if (a.link[i]) {
+			gather(a.link[i], all);
+		}
+		i = i + 1;
+	}
+}
+
+// Split the bytes into classes that every state treats the same. Each
+// state splits the classes so far by where their bytes lead.
+byte_classes(c: *compiler, all: **dfa, n: int): *int {
+	var cls: *int;
+	var next: *int;
+	var tmp: *int;
+	var link: **dfa;
+	var ncls: int;
+	var s: int;
+	var i: int;
+	var j: int;
+
+	cls = alloc_ints(c, 256, 0);
+	next = alloc_ints(c, 256, 0);
+	ncls = 1;
+
+	s = 0;
+	loop {
+		if (s == n) {
+			break;
+		}
+		link = all[s].link;
+
+		i = 0;
+		loop {
+			if (i == 256) {
+				break;
+			}
+			next[i] = -1;
+			i = i + 1;
+		}
+
+		ncls = 0;
+		i = 0;
+		loop {
+			if (i == 256) {
+				break;
+			}
+
+			if (next[i] == -1) {
+				next[i] = ncls;
+				j = i + 1;
+				loop {
+					if (j == 256) {
+						break;
+					}
+					if (next[j] == -1 && cls[j] == cls[i] && link[j] == link[i]) {
+						next[j] = ncls;
+					}
+					j = j + 1;
+				}
+				ncls = ncls + 1;
+			}
+
+			i = i + 1;
+		}
+
+		tmp = cls;
+		cls = next;
+		next = tmp;
+
+		s = s + 1;
+	}
+
+	c.ncls = ncls;
+
+	return cls;
+}
+
+// Write a byte of a string literal
+tab_byte(c: *compiler, b: int): void {
+	if (b >= 32 && b < 127 && b != '"' && b != '\\') {
+		fputc(&c.out, b);
+		return;
+	}
+
+	fputs(&c.out, "\\x");
+	fputc(&c.out, "0123456789abcdef"[b >> 4]:int);
+	fputc(&c.out, "0123456789abcdef"[b & 15]:int);
+}
+
+// Write a number of the table data. The digits are base 127 with the low
+// digit first. All but the last have the high bit set, and the last is
+// offset by one, so the data never contains a zero byte. The literals are
+// split to stay under the limit on the length of a string.
+tab_num(c: *compiler, x: int): void {
+	if (c.tchunk >= 4000) {
+		fputs(&c.out, "\");\n\tlextable(l, \"");
+		c.tchunk = 0;
+	}
+
+	loop {
+		c.tchunk = c.tchunk + 1;
+		if (x < 127) {
+			tab_byte(c, x + 1);
+			break;
+		}
+		tab_byte(c, 128 + x % 127);
+		x = x / 127;
+	}
+}
+
+tab_ref(c: *compiler, base: int, x: *byte): void {
+	fputs(&c.out, "t[");
+	fputd(&c.out, base);
+	fputs(&c.out, " + ");
+	fputs(&c.out, x);
+	fputs(&c.out, "]");
+}
+
+// Emit the automaton as a transition table indexed by state and byte class,
+// packed by displacing the rows into one array. A state takes the entries
+// whose check holds its number, starting at its base. States are numbered
+// from 1 so that 0 is free to mark empty entries.
+// Check if two rows have entries in the same classes
+same_shape(a: **dfa, b: **dfa, rep: *int, ncls: int): int {
+	var k: int;
+
+	k = 0;
+	loop {
+		if (k == ncls) {
+			break;
+		}
+		if (!a[rep[k]] != !b[rep[k]]) {
+			return 0;
+		}
+		k = k + 1;
+	}
+
+	return 1;
+}
+
+gen_table(c: *compiler, a: *dfa): void {
+	var all: **dfa;
+	var cls: *int;
+	var rep: *int;
+	var count: *int;
+	var order: *int;
+	var start: *int;
+	var base: *int;
+	var check: *int;
+	var next: *int;
+	var fnext: *int;
+	var fprev: *int;
+	var shead: *int;
+	var snext: *int;
+	var shash: *int;
+	var slast: *int;
+	var smask: int;
+	var h: int;
+	var t: int;
+	var link: **dfa;
+	var n: int;
+	var ncls: int;
+	var size: int;
+	var free: int;
+	var used: int;
+	var first: int;
+	var acc: int;
+	var s: int;
+	var b: int;
+	var f: int;
+	var k: int;
+	var i: int;
+
+	n = c.ndfa;
+	all = alloc(&c.a, sizeof(a) * n):**dfa;
+	i = 0;
+	loop {
+		if (i == n) {
+			break;
+		}
+		all[i] = 0:*dfa;
+		i = i + 1;
+	}
+	gather(a, all);
+
+	cls = byte_classes(c, all, n);
+	ncls = c.ncls;
+
+	// Any byte of a class stands for it
+	rep = alloc_ints(c, ncls, 0);
+	i = 255;
+	loop {
+		rep[cls[i]] = i;
+		if (i == 0) {
+			break;
+		}
+		i = i - 1;
+	}
+
+	// Place the fullest rows first
+	count = alloc_ints(c, n, 0);
+	start = alloc_ints(c, ncls + 2, 0);
+	s = 0;
+	loop {
+		if (s == n) {
+			break;
+		}
+		k = 0;
+		loop {
+			if (k == ncls) {
+				break;
+			}
+			if (all[s].link[rep[k]]) {
+				count[s] = count[s] + 1;
+			}
+			k = k + 1;
+		}
+		start[ncls - count[s] + 1] = start[ncls - count[s] + 1] + 1;
+		s = s + 1;
+	}
+
+	i = 1;
+	loop {
+		if (i == ncls + 2) {
+			break;
+		}
+		start[i] = start[i] + start[i - 1];
+		i = i + 1;
+	}
+
+	order = alloc_ints(c, n, 0);
+	s = 0;
+	loop {
+		if (s == n) {
+			break;
+		}
+		i = ncls - count[s];
+		order[start[i]] = s;
+		start[i] = start[i] + 1;
+		s = s + 1;
+	}
+
+	size = n * ncls + ncls;
+	base = alloc_ints(c, n, 0);
+	check = alloc_ints(c, size, 0);
+	next = alloc_ints(c, size, 0);
+	used = ncls;
+
+	// The free slots are chained in order, so each attempt goes straight
+	// to the next base that puts the first entry on an empty slot
+	fnext = alloc_ints(c, size, 0);
+	fprev = alloc_ints(c, size, 0);
+	i = 0;
+	loop {
+		if (i == size) {
+			break;
+		}
+		fnext[i] = i + 1;
+		fprev[i] = i - 1;
+		i = i + 1;
+	}
+	free = 0;
+
+	// Rows of the same shape are chained by a hash of their classes. The
+	// slots only ever fill up, so a row can skip every base up to the last
+	// one taken by its shape.
+	smask = 1;
+	loop {
+		if (smask >= 2 * n) {
+			break;
+		}
+		smask = smask * 2;
+	}
+	shead = alloc_ints(c, smask, -1);
+	smask = smask - 1;
+	snext = alloc_ints(c, n, -1);
+	shash = alloc_ints(c, n, 0);
+	slast = alloc_ints(c, n, 0);
+
+	i = 0;
+	loop {
+		if (i == n) {
+			break;
+		}
+		s = order[i];
+		link = all[s].link;
+
+		first = -1;
+		h = 5381;
+		k = 0;
+		loop {
+			if (k == ncls) {
+				break;
+			}
+			if (link[rep[k]]) {
+				if (first == -1) {
+					first = k;
+				}
+				h = h * 33 + k;
+			}
+			k = k + 1;
+		}
+
+		if (first != -1) {
+			t = shead[h & smask];
+			loop {
+				if (t == -1) {
+					break;
+				}
+				if (shash[t] == h && same_shape(all[t].link, link, rep, ncls)) {
+					break;
+				}
+				t = snext[t];
+			}
+
+			f = first;
+			if (t != -1) {
+				f = slast[t] + first + 1;
+			}
+			if (f < free) {
+				f = free;
+			}
+			loop {
+				if (check[f] == 0) {
+					break;
+				}
+				f = f + 1;
+			}
+
+			loop {
+				b = f - first;
+				k = first + 1;
+				loop {
+					if (k == ncls) {
+						break;
+					}
+					if (link[rep[k]] && check[b + k]) {
+						break;
+					}
+					k = k + 1;
+				}
+
+				if (k == ncls) {
+					break;
+				}
+
+				f = fnext[f];
+			}
+
+			base[s] = b;
+			k = first;
+			loop {
+				if (k == ncls) {
+					break;
+				}
+				if (link[rep[k]]) {
+					f = b + k;
+					check[f] = s + 1;
+					next[f] = link[rep[k]].id + 1;
+
+					// Unchain the slot
+					if (fprev[f] == -1) {
+						free = fnext[f];
+					} else {
+						fnext[fprev[f]] = fnext[f];
+					}
+					if (fnext[f] < size) {
+						fprev[fnext[f]] = fprev[f];
+					}
+				}
+				k = k + 1;
+			}
+
+			if (t == -1) {
+				t = s;
+				shash[t] = h;
+				snext[t] = shead[h & smask];
+				shead[h & smask] = t;
+			}
+			slast[t] = b;
+
+			if (b + ncls > used) {
+				used = b + ncls;
+			}
+		}
+
+		i = i + 1;
+	}
+
+	// The data holds the class of each byte, then the tag accepted, base,
+	// check and next entries for each state
+	acc = 256;
+	fputs(&c.out, "lexload(l: *lex_state): void {\n");
+	fputs(&c.out, "\tlexsize(l, ");
+	fputd(&c.out, 256 + 2 * (n + 1) + 2 * used);
+	fputs(&c.out, ");\n");
+	fputs(&c.out, "\tlextable(l, \"");
+	c.tchunk = 0;
+
+	i = 0;
+	loop {
+		if (i == 256) {
+			break;
+		}
+		tab_num(c, cls[i]);
+		i = i + 1;
+	}
+
+	tab_num(c, 0);
+	s = 0;
+	loop {
+		if (s == n) {
+			break;
+		}
+		if (all[s].key.tag) {
+			tab_num(c, all[s].key.tag.id + 2);
+		} else {
+			tab_num(c, 0);
+		}
+		s = s + 1;
+	}
+
+	tab_num(c, 0);
+	s = 0;
+	loop {
+		if (s == n) {
+			break;
+		}
+		tab_num(c, base[s]);
+		s = s + 1;
+	}
+
+	i = 0;
+	loop {
+		if (i == used) {
+			break;
+		}
+		tab_num(c, check[i]);
+		i = i + 1;
+	}
+
+	i = 0;
+	loop {
+		if (i == used) {
+			break;
+		}
+		tab_num(c, next[i]);
+		i = i + 1;
+	}
+
+	fputs(&c.out, "\");\n");
+	fputs(&c.out, "}\n");
+	fputs(&c.out, "\n");
+
+	fputs(&c.out, "lexstep(l: *lex_state): void {\n");
+	fputs(&c.out, "\tvar t: *int;\n");
+	fputs(&c.out, "\tvar s: int;\n");
+	fputs(&c.out, "\tvar ch: int;\n");
+	fputs(&c.out, "\tvar i: int;\n");
+	fputs(&c.out, "\tt = l.tab;\n");
+	fputs(&c.out, "\ts = 1;\n");
+	fputs(&c.out, "\tlexmark(l, ");
+	fputs(&c.out, c.prefix);
+	fputs(&c.out, "invalid);\n");
+	fputs(&c.out, "\tloop {\n");
+	fputs(&c.out, "\t\tif (");
+	tab_ref(c, acc, "s");
+	fputs(&c.out, ") {\n");
+	fputs(&c.out, "\t\t\tlexmark(l, ");
+	tab_ref(c, acc, "s");
+	fputs(&c.out, ");\n");
+	fputs(&c.out, "\t\t}\n");
+	fputs(&c.out, "\t\tch = lexfeedc(l);\n");
+	fputs(&c.out, "\t\tif (ch == -1) {\n");
+	fputs(&c.out, "\t\t\treturn;\n");
+	fputs(&c.out, "\t\t}\n");
+	fputs(&c.out, "\t\ti = ");
+	tab_ref(c, acc + n + 1, "s");
+	fputs(&c.out, " + t[ch];\n");
+	fputs(&c.out, "\t\tif (");
+	tab_ref(c, acc + 2 * (n + 1), "i");
+	fputs(&c.out, " != s) {\n");
+	fputs(&c.out, "\t\t\treturn;\n");
+	fputs(&c.out, "\t\t}\n");
+	fputs(&c.out, "\t\ts = ");
+	tab_ref(c, acc + 2 * (n + 1) + used, "i");
+	fputs(&c.out, ";\n");
+	fputs(&c.out, "\t}\n");
+	fputs(&c.out, "}\n");
+}
+
 gen(c: *compiler, a: *dfa): void {
 	var t: *tag;
 	t = c.tags;
-	fdput(1, "enum {\n");
-	fdput(1, "\tT_invalid,\n");
-	fdput(1, "\tT_eof,\n");
+	fputs(&c.out, "enum {\n");
+	fputs(&c.out, "\t");
+	fputs(&c.out, c.prefix);
+	fputs(&c.out, "invalid,\n");
+	fputs(&c.out, "\t");
+	fputs(&c.out, c.prefix);
+	fputs(&c.out, "eof,\n");
 	loop {
 		if (!t) {
 			break;
 		}
-		fdput(1, "\tT_");
-		fdput(1, t.s);
-		fdput(1, ",\n");
+		fputs(&c.out, "\t");
+		fputs(&c.out, c.prefix);
+		fputs(&c.out, t.s);
+		fputs(&c.out, ",\n");
 		t = t.next;
 	}
-	fdput(1, "}\n");
-	fdput(1, "\n");
-	fdput(1, "lexstep(l: *lex_state): void {\n");
-	fdput(1, "\tvar ch: int;\n");
-	fdput(1, "\tlexmark(l, T_invalid);\n");
+	fputs(&c.out, "}\n");
+	fputs(&c.out, "\n");
+
+	if (c.table) {
+		gen_table(c, a);
+		return;
+	}
+
+	// The goto form has no tables to load
+	fputs(&c.out, "lexload(l: *lex_state): void {\n");
+	fputs(&c.out, "}\n");
+	fputs(&c.out, "\n");
+	fputs(&c.out, "lexstep(l: *lex_state): void {\n");
+	fputs(&c.out, "\tvar ch: int;\n");
+	fputs(&c.out, "\tlexmark(l, ");
+	fputs(&c.out, c.prefix);
+	fputs(&c.out, "invalid);\n");
 	codegen(c, a);
-	fdput(1, "}\n");
+	fputs(&c.out, "}\n");
 }
 
-main(): void {
+// -t selects the table driven output. Any other argument replaces the T_
+// prefix of the generated names.
+main(argv: **byte): void {
 	var c: compiler;
 	var n: *nfa;
 	var a: *dfa;
+	var i: int;
 	setup(&c);
+	if (argv[0]) {
+		i = 1;
+		loop {
+			if (!argv[i]) {
+				break;
+			}
+			if (!strcmp(argv[i], "-t")) {
+				c.table = 1;
+			} else {
+				c.prefix = argv[i];
+			}
+			i = i + 1;
+		}
+	}
 	n = parse_program(&c);
 	a = powerset(&c, n);
+	a = minimize(&c, a);
 	gen(&c, a);
+	fflush(&c.out);
 }
@@ -97,6 +97,6 @@ chacha20_stream(byte *cipher, byte *plain, int len, u64 *index, byte *key, byte
 			cipher[j] = plain[j] ^ block[i];
 		}
 
-		*index += 64;
+		*index += i;
 	}
 }
@@ -0,0 +1,514 @@
+#define ROL32(x, k)	(((x) << (k)) | ((x) >> (32 - (k))))
+#define ROL64(x, k)	(((x) << (k)) | ((x) >> (64 - (k))))
+
+#define ROR32(x, k)	(((x) >> (k)) | ((x) << (32 - (k))))
+#define ROR64(x, k)	(((x) >> (k)) | ((x) << (64 - (k))))
+
+typedef unsigned char byte;
+typedef unsigned int u32;
+typedef unsigned long u64;
+
+#include "chacha20.c"
+#include "poly1305.c"
+#include "sha1.c"
+#include "sha256.c"
+#include "sha512.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Longest message and worst misalignment tried per iteration */
+#define MAXLEN	4096
+#define MAXOFF	16
+
+/* Bytes hashed per backend when measuring throughput */
+#define BENCHLEN	(1 << 20)
+#define BENCHREP	32
+
+struct backend {
+	char *name;
+	void (*fn)(byte *out, byte *data, int len);
+};
+
+u64 seed = 0x9e3779b97f4a7c15;
+
+u32
+rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return seed >> 32;
+}
+
+void
+fill(byte *p, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		p[i] = rnd();
+	}
+}
+
+/* Pick a length, biased towards the block and padding boundaries */
+int
+rndlen(void)
+{
+	int mode;
+	int len;
+
+	len = rnd() % MAXLEN;
+	mode = rnd() % 4;
+
+	if (mode == 0) {
+		len &= ~63;
+	} else if (mode == 1) {
+		len = (len & ~63) + 55 + rnd() % 3;
+	} else if (mode == 2) {
+		len = (len & ~127) + 111 + rnd() % 3;
+	}
+
+	return len < MAXLEN ? len : MAXLEN - 1;
+}
+
+/* Pad a message by hand and run it through the block function */
+void
+ref_pad(byte *buf, int *nblocks, byte *data, int len, int bsize, int lsize)
+{
+	u64 bits;
+	int n;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = data[i];
+	}
+
+	buf[i++] = 0x80;
+
+	n = (len + 1 + lsize + bsize - 1) / bsize * bsize;
+	for (; i < n; i++) {
+		buf[i] = 0;
+	}
+
+	for (i = n - 1, bits = (u64)len * 8; i >= n - 8; i--, bits >>= 8) {
+		buf[i] = bits;
+	}
+
+	*nblocks = n / bsize;
+}
+
+byte padbuf[BENCHLEN + 256];
+
+void
+ref_sha1(byte *out, byte *data, int len)
+{
+	u32 r[5];
+	int n;
+	int i;
+
+	ref_pad(padbuf, &n, data, len, 64, 8);
+	sha1_init(r);
+	for (i = 0; i < n; i++) {
+		sha1_rounds(r, padbuf + i * 64);
+	}
+	sha1_digest(out, r);
+}
+
+void
+ref_sha256(byte *out, byte *data, int len)
+{
+	u32 r[8];
+	int n;
+	int i;
+
+	ref_pad(padbuf, &n, data, len, 64, 8);
+	sha256_init(r);
+	for (i = 0; i < n; i++) {
+		sha256_rounds(r, padbuf + i * 64);
+	}
+	sha256_digest(out, r);
+}
+
+void
+ref_sha512(byte *out, byte *data, int len)
+{
+	u64 r[8];
+	int n;
+	int i;
+
+	ref_pad(padbuf, &n, data, len, 128, 16);
+	sha512_init(r);
+	for (i = 0; i < n; i++) {
+		sha512_rounds(r, padbuf + i * 128);
+	}
+	sha512_digest(out, r);
+}
+
+/* Feed a random number of leading blocks separately, then finish */
+void
+split_sha1(byte *out, byte *data, int len)
+{
+	u32 r[5];
+	int n;
+	int i;
+
+	n = len / 64 ? rnd() % (len / 64 + 1) : 0;
+
+	sha1_init(r);
+	for (i = 0; i < n; i++) {
+		sha1_rounds(r, data + i * 64);
+	}
+	sha1_finish(r, n, data + n * 64, len - n * 64);
+	sha1_digest(out, r);
+}
+
+void
+split_sha256(byte *out, byte *data, int len)
+{
+	u32 r[8];
+	int n;
+	int k;
+
+	sha256_init(r);
+	for (n = 0; len - n * 64 >= 64 && rnd() % 2; n += k) {
+		k = 1 + rnd() % ((len - n * 64) / 64);
+		sha256_compress(r, data + n * 64, k);
+	}
+	sha256_finish(r, n, data + n * 64, len - n * 64);
+	sha256_digest(out, r);
+}
+
+void
+split_sha512(byte *out, byte *data, int len)
+{
+	u64 r[8];
+	int n;
+	int k;
+
+	sha512_init(r);
+	for (n = 0; len - n * 128 >= 128 && rnd() % 2; n += k) {
+		k = 1 + rnd() % ((len - n * 128) / 128);
+		sha512_compress(r, data + n * 128, k);
+	}
+	sha512_finish(r, n, data + n * 128, len - n * 128);
+	sha512_digest(out, r);
+}
+
+byte chacha20_key[32];
+byte chacha20_nonce[12];
+
+/* Keystream from the block function, xored byte by byte */
+void
+ref_chacha20(byte *out, byte *data, int len)
+{
+	byte block[64];
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if ((i & 63) == 0) {
+			chacha20_block(block, chacha20_key, i / 64 + 1, chacha20_nonce);
+		}
+		out[i] = data[i] ^ block[i & 63];
+	}
+}
+
+void
+one_chacha20(byte *out, byte *data, int len)
+{
+	u64 index = 64;
+
+	chacha20_stream(out, data, len, &index, chacha20_key, chacha20_nonce);
+}
+
+/* Encrypt in random sized pieces, carrying the stream index across */
+void
+split_chacha20(byte *out, byte *data, int len)
+{
+	u64 index = 64;
+	int off;
+	int n;
+
+	for (off = 0; off < len; off += n) {
+		n = 1 + rnd() % (len - off < 200 ? len - off : 200);
+		chacha20_stream(out + off, data + off, n, &index, chacha20_key, chacha20_nonce);
+	}
+}
+
+byte poly1305_key[32];
+
+/*
+ * Poly1305 on a plain bignum of 16 bit limbs, sharing nothing with
+ * poly1305.c. Products are reduced with 2^130 = 5 mod p until they fit in
+ * 131 bits, then p is subtracted while it still fits.
+ */
+#define BIGLEN	18
+
+void
+big_norm(u64 *x)
+{
+	u64 c;
+	int i;
+
+	for (i = 0, c = 0; i < BIGLEN; i++) {
+		c += x[i];
+		x[i] = c & 0xffff;
+		c >>= 16;
+	}
+}
+
+void
+big_mod(u64 *x)
+{
+	static const u64 p[9] = {
+		0xfffb, 0xffff, 0xffff, 0xffff, 0xffff, 0xffff, 0xffff, 0xffff, 3
+	};
+	u64 hi[BIGLEN];
+	u64 b;
+	int ge;
+	int i;
+
+	big_norm(x);
+
+	for (;;) {
+		for (i = 9, b = x[8] >> 2; i < BIGLEN; i++) {
+			b |= x[i];
+		}
+		if (!b) {
+			break;
+		}
+
+		for (i = 0; i < BIGLEN; i++) {
+			hi[i] = i + 8 < BIGLEN ? x[i + 8] >> 2 : 0;
+			hi[i] |= i + 9 < BIGLEN ? (x[i + 9] & 3) << 14 : 0;
+		}
+
+		x[8] &= 3;
+		for (i = 9; i < BIGLEN; i++) {
+			x[i] = 0;
+		}
+		for (i = 0; i < BIGLEN; i++) {
+			x[i] += 5 * hi[i];
+		}
+
+		big_norm(x);
+	}
+
+	for (;;) {
+		for (i = 8, ge = 1; i >= 0; i--) {
+			if (x[i] != p[i]) {
+				ge = x[i] > p[i];
+				break;
+			}
+		}
+		if (!ge) {
+			break;
+		}
+
+		for (i = 0, b = 0; i < 9; i++) {
+			b = x[i] - p[i] - b;
+			x[i] = b & 0xffff;
+			b = (b >> 16) & 1;
+		}
+	}
+}
+
+void
+big_load(u64 *x, byte *p, int n)
+{
+	int i;
+
+	for (i = 0; i < BIGLEN; i++) {
+		x[i] = 0;
+	}
+
+	for (i = 0; i < n; i++) {
+		x[i / 2] |= (u64)p[i] << (i % 2 * 8);
+	}
+}
+
+void
+ref_poly1305(byte *out, byte *data, int len)
+{
+	byte key[32];
+	u64 a[BIGLEN];
+	u64 r[BIGLEN];
+	u64 n[BIGLEN];
+	u64 t[BIGLEN];
+	int off;
+	int k;
+	int i;
+	int j;
+
+	memcpy(key, poly1305_key, 32);
+	key[3] &= 15; key[7] &= 15; key[11] &= 15; key[15] &= 15;
+	key[4] &= 252; key[8] &= 252; key[12] &= 252;
+
+	big_load(r, key, 16);
+	big_load(a, key, 0);
+
+	for (off = 0; off < len; off += 16) {
+		k = len - off < 16 ? len - off : 16;
+		big_load(n, data + off, k);
+		n[k / 2] |= (u64)1 << (k % 2 * 8);
+
+		for (i = 0; i < 9; i++) {
+			a[i] += n[i];
+		}
+		big_mod(a);
+
+		big_load(t, key, 0);
+		for (i = 0; i < 9; i++) {
+			for (j = 0; j < 9; j++) {
+				t[i + j] += a[i] * r[j];
+			}
+		}
+		big_mod(t);
+		memcpy(a, t, sizeof(a));
+	}
+
+	big_load(n, key + 16, 16);
+	for (i = 0; i < 9; i++) {
+		a[i] += n[i];
+	}
+	big_norm(a);
+
+	for (i = 0; i < 16; i++) {
+		out[i] = a[i / 2] >> (i % 2 * 8);
+	}
+}
+
+void
+one_poly1305(byte *out, byte *data, int len)
+{
+	poly1305(out, poly1305_key, data, len);
+}
+
+struct backend sha1_backends[] = {
+	{ "sha1/ref", ref_sha1 },
+	{ "sha1", sha1 },
+	{ "sha1/split", split_sha1 },
+	{ 0, 0 }
+};
+
+struct backend sha256_backends[] = {
+	{ "sha256/ref", ref_sha256 },
+	{ "sha256", sha256 },
+	{ "sha256/split", split_sha256 },
+	{ 0, 0 }
+};
+
+struct backend sha512_backends[] = {
+	{ "sha512/ref", ref_sha512 },
+	{ "sha512", sha512 },
+	{ "sha512/split", split_sha512 },
+	{ 0, 0 }
+};
+
+struct backend chacha20_backends[] = {
+	{ "chacha20/ref", ref_chacha20 },
+	{ "chacha20", one_chacha20 },
+	{ "chacha20/split", split_chacha20 },
+	{ 0, 0 }
+};
+
+struct backend poly1305_backends[] = {
+	{ "poly1305/ref", ref_poly1305 },
+	{ "poly1305", one_poly1305 },
+	{ 0, 0 }
+};
+
+byte input[MAXLEN + MAXOFF];
+byte expected[MAXLEN];
+byte output[MAXLEN + MAXOFF];
+
+/* Compare every backend against the first on random inputs */
+int
+fuzz(struct backend *b, int outlen, int iters)
+{
+	struct backend *x;
+	byte *data;
+	byte *out;
+	int len;
+	int i;
+
+	for (i = 0; i < iters; i++) {
+		len = rndlen();
+		data = input + rnd() % MAXOFF;
+		fill(data, len);
+
+		b->fn(expected, data, len);
+
+		for (x = b + 1; x->name; x++) {
+			out = output + rnd() % MAXOFF;
+			x->fn(out, data, len);
+
+			if (memcmp(out, expected, outlen ? outlen : len)) {
+				printf("FAIL: %s len %d align %d/%d\n", x->name, len,
+					(int)(data - input), (int)(out - output));
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+byte benchin[BENCHLEN];
+byte benchout[BENCHLEN];
+
+void
+bench(struct backend *b)
+{
+	clock_t start;
+	double secs;
+	int i;
+
+	fill(benchin, BENCHLEN);
+
+	for (; b->name; b++) {
+		start = clock();
+		for (i = 0; i < BENCHREP; i++) {
+			b->fn(benchout, benchin, BENCHLEN);
+		}
+		secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+		printf("# %-16s %8.1f MB/s\n", b->name,
+			secs > 0 ? BENCHREP * (BENCHLEN / 1e6) / secs : 0.0);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	int iters;
+	int status;
+
+	iters = argc > 1 ? atoi(argv[1]) : 2000;
+	if (argc > 2) {
+		seed = strtoul(argv[2], 0, 0);
+	}
+
+	printf("# seed %#lx, %d iterations\n", seed, iters);
+
+	fill(chacha20_key, sizeof(chacha20_key));
+	fill(chacha20_nonce, sizeof(chacha20_nonce));
+	fill(poly1305_key, sizeof(poly1305_key));
+
+	status = 0;
+	status |= fuzz(sha1_backends, 20, iters);
+	status |= fuzz(sha256_backends, 32, iters);
+	status |= fuzz(sha512_backends, 64, iters);
+	status |= fuzz(chacha20_backends, 0, iters);
+	status |= fuzz(poly1305_backends, 16, iters);
+
+	bench(sha1_backends);
+	bench(sha256_backends);
+	bench(sha512_backends);
+	bench(chacha20_backends);
+	bench(poly1305_backends);
+
+	return status;
+}
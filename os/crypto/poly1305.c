@@ -12,6 +12,15 @@ poly1305_reduce(u32 *a)
 	u64 c;
 	int i;
 
+	/* Fold the bits above 2^130 back in, leaving a < 2p */
+	c = (u64)(a[4] >> 2) * 5;
+	a[4] &= 3;
+
+	for (i = 0; i < 5; i++, c >>= 32) {
+		c += a[i];
+		a[i] = c;
+	}
+
 	for (i = 0, c = 1; i < 5; i++, c >>= 32) {
 		c += a[i];
 		c += ~m[i];
@@ -19,7 +28,7 @@ poly1305_reduce(u32 *a)
 
 	k = -c;
 
-	for (i = 0; i < 8; i++, c >>= 32) {
+	for (i = 0; i < 5; i++, c >>= 32) {
 		c += a[i];
 		c += ~m[i] & k;
 		a[i] = c;
@@ -44,8 +53,6 @@ poly1305_digest(byte *dest, u32 *src)
 {
 	int i;
 
-	poly1305_reduce(src);
-
 	for (i = 0; i < 4; i++) {
 		*dest++ = *src;
 		*dest++ = *src >> 8;
@@ -138,7 +145,7 @@ poly1305(byte *mac, byte *key, byte *msg, int len)
 
 	poly1305_truncate(r, key);
 
-	for (i = 0; i <= len; i += 16) {
+	for (i = 0; i < len; i += 16) {
 		if (len - i >= 16) {
 			poly1305_pad(s, msg + i, 16);
 		} else {
@@ -150,7 +157,10 @@ poly1305(byte *mac, byte *key, byte *msg, int len)
 		poly1305_mul(a, r);
 	}
 
+	poly1305_reduce(a);
+
 	poly1305_load(s, key + 16, 4);
+	s[4] = 0;
 	poly1305_add(a, s);
 
 	poly1305_digest(mac, a);
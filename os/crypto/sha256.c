@@ -34,6 +34,7 @@ u32 sha256_k[64] = {
 	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
 };
 
+/* Reference version of sha256_compress with the schedule expanded up front */
 void
 sha256_rounds(u32 *r, byte *block)
 {
@@ -79,6 +80,96 @@ sha256_rounds(u32 *r, byte *block)
 	r[4] += e; r[5] += f; r[6] += g; r[7] += h;
 }
 
+#define SHA256_LOAD(p)	(((u32)(p)[0] << 24) | ((u32)(p)[1] << 16) \
+			| ((u32)(p)[2] << 8) | (p)[3])
+#define SHA256_S0(x)	(ROR32(x, 2) ^ ROR32(x, 13) ^ ROR32(x, 22))
+#define SHA256_S1(x)	(ROR32(x, 6) ^ ROR32(x, 11) ^ ROR32(x, 25))
+#define SHA256_s0(x)	(ROR32(x, 7) ^ ROR32(x, 18) ^ ((x) >> 3))
+#define SHA256_s1(x)	(ROR32(x, 17) ^ ROR32(x, 19) ^ ((x) >> 10))
+#define SHA256_CH(e, f, g)	((g) ^ ((e) & ((f) ^ (g))))
+#define SHA256_MAJ(a, b, c)	(((a) & (b)) | ((c) & ((a) | (b))))
+
+/* Message word i, or word i + 16 of the schedule computed over it */
+#define SHA256_W(i, j, k, l)	(w##i)
+#define SHA256_WS(i, j, k, l)	(w##i += SHA256_s1(w##l) + w##k + SHA256_s0(w##j))
+
+/* The caller rotates the names of a..h instead of moving the values */
+#define SHA256_ROUND(a, b, c, d, e, f, g, h, w, k) \
+	t = (h) + SHA256_S1(e) + SHA256_CH(e, f, g) + (k) + (w); \
+	(d) += t; \
+	(h) = t + SHA256_S0(a) + SHA256_MAJ(a, b, c)
+
+#define SHA256_16(W, k0, k1, k2, k3, k4, k5, k6, k7, k8, k9, k10, k11, k12, k13, k14, k15) \
+	SHA256_ROUND(a, b, c, d, e, f, g, h, W(0, 1, 9, 14), k0); \
+	SHA256_ROUND(h, a, b, c, d, e, f, g, W(1, 2, 10, 15), k1); \
+	SHA256_ROUND(g, h, a, b, c, d, e, f, W(2, 3, 11, 0), k2); \
+	SHA256_ROUND(f, g, h, a, b, c, d, e, W(3, 4, 12, 1), k3); \
+	SHA256_ROUND(e, f, g, h, a, b, c, d, W(4, 5, 13, 2), k4); \
+	SHA256_ROUND(d, e, f, g, h, a, b, c, W(5, 6, 14, 3), k5); \
+	SHA256_ROUND(c, d, e, f, g, h, a, b, W(6, 7, 15, 4), k6); \
+	SHA256_ROUND(b, c, d, e, f, g, h, a, W(7, 8, 0, 5), k7); \
+	SHA256_ROUND(a, b, c, d, e, f, g, h, W(8, 9, 1, 6), k8); \
+	SHA256_ROUND(h, a, b, c, d, e, f, g, W(9, 10, 2, 7), k9); \
+	SHA256_ROUND(g, h, a, b, c, d, e, f, W(10, 11, 3, 8), k10); \
+	SHA256_ROUND(f, g, h, a, b, c, d, e, W(11, 12, 4, 9), k11); \
+	SHA256_ROUND(e, f, g, h, a, b, c, d, W(12, 13, 5, 10), k12); \
+	SHA256_ROUND(d, e, f, g, h, a, b, c, W(13, 14, 6, 11), k13); \
+	SHA256_ROUND(c, d, e, f, g, h, a, b, W(14, 15, 7, 12), k14); \
+	SHA256_ROUND(b, c, d, e, f, g, h, a, W(15, 0, 8, 13), k15)
+
+/* Hash nblocks consecutive blocks with the schedule kept in sixteen words */
+void
+sha256_compress(u32 *r, byte *data, int nblocks)
+{
+	u32 a; u32 b; u32 c; u32 d; u32 e; u32 f; u32 g; u32 h;
+	u32 w0; u32 w1; u32 w2; u32 w3;
+	u32 w4; u32 w5; u32 w6; u32 w7;
+	u32 w8; u32 w9; u32 w10; u32 w11;
+	u32 w12; u32 w13; u32 w14; u32 w15;
+	u32 t;
+
+	for (; nblocks > 0; nblocks--, data += 64) {
+		a = r[0]; b = r[1]; c = r[2]; d = r[3];
+		e = r[4]; f = r[5]; g = r[6]; h = r[7];
+
+		w0 = SHA256_LOAD(data); w1 = SHA256_LOAD(data + 4);
+		w2 = SHA256_LOAD(data + 8); w3 = SHA256_LOAD(data + 12);
+		w4 = SHA256_LOAD(data + 16); w5 = SHA256_LOAD(data + 20);
+		w6 = SHA256_LOAD(data + 24); w7 = SHA256_LOAD(data + 28);
+		w8 = SHA256_LOAD(data + 32); w9 = SHA256_LOAD(data + 36);
+		w10 = SHA256_LOAD(data + 40); w11 = SHA256_LOAD(data + 44);
+		w12 = SHA256_LOAD(data + 48); w13 = SHA256_LOAD(data + 52);
+		w14 = SHA256_LOAD(data + 56); w15 = SHA256_LOAD(data + 60);
+
+		SHA256_16(SHA256_W,
+			0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+			0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+			0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+			0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174);
+
+		SHA256_16(SHA256_WS,
+			0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+			0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+			0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+			0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967);
+
+		SHA256_16(SHA256_WS,
+			0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+			0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+			0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+			0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070);
+
+		SHA256_16(SHA256_WS,
+			0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+			0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+			0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+			0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2);
+
+		r[0] += a; r[1] += b; r[2] += c; r[3] += d;
+		r[4] += e; r[5] += f; r[6] += g; r[7] += h;
+	}
+}
+
 void
 sha256_finish(u32 *r, int nblocks, byte *data, int len)
 {
@@ -86,11 +177,13 @@ sha256_finish(u32 *r, int nblocks, byte *data, int len)
 	u64 pad;
 	int i;
 
-	pad = (u64)nblocks * 512;
-	for (; len >= 64; data += 64, len -= 64, pad += 512) {
-		sha256_rounds(r, data);
-	}
-	pad += len * 8;
+	/* Full blocks are hashed in place, only the tail is copied */
+	sha256_compress(r, data, len >> 6);
+	nblocks += len >> 6;
+	data += len & ~63;
+	len &= 63;
+
+	pad = (u64)nblocks * 512 + len * 8;
 
 	for (i = 0; i < len; i++) {
 		final[i] = data[i];
@@ -98,23 +191,25 @@ sha256_finish(u32 *r, int nblocks, byte *data, int len)
 
 	final[i++] = 0x80;
 
-	for (; i < 64; i++) {
-		final[i] = 0;
-	}
-
 	if (len + 9 > 64) {
-		sha256_rounds(r, final);
-
-		for (i = 0; i < 64; i++) {
+		for (; i < 64; i++) {
 			final[i] = 0;
 		}
+
+		sha256_compress(r, final, 1);
+
+		i = 0;
+	}
+
+	for (; i < 56; i++) {
+		final[i] = 0;
 	}
 
 	for (i = 63; i >= 56; i--, pad >>= 8) {
 		final[i] = pad;
 	}
 
-	sha256_rounds(r, final);
+	sha256_compress(r, final, 1);
 }
 
 void
@@ -170,12 +265,12 @@ sha256_hmac(byte *mac, byte *key, int klen, byte *data, int dlen)
 	}
 
 	sha256_init(r);
-	sha256_rounds(r, ipad);
+	sha256_compress(r, ipad, 1);
 	sha256_finish(r, 1, data, dlen);
 	sha256_digest(digest, r);
 
 	sha256_init(r);
-	sha256_rounds(r, opad);
+	sha256_compress(r, opad, 1);
 	sha256_finish(r, 1, digest, 32);
 	sha256_digest(mac, r);
 }
@@ -38,6 +38,7 @@ u64 sha512_k[80] = {
 	0x4cc5d4becb3e42b6, 0x597f299cfc657e2a, 0x5fcb6fab3ad6faec, 0x6c44198c4a475817
 };
 
+/* Reference version of sha512_compress with the schedule expanded up front */
 void
 sha512_rounds(u64 *r, byte *block)
 {
@@ -87,6 +88,124 @@ sha512_rounds(u64 *r, byte *block)
 	r[4] += e; r[5] += f; r[6] += g; r[7] += h;
 }
 
+#define SHA512_LOAD(p)	(((u64)(p)[0] << 56) | ((u64)(p)[1] << 48) \
+			| ((u64)(p)[2] << 40) | ((u64)(p)[3] << 32) \
+			| ((u64)(p)[4] << 24) | ((u64)(p)[5] << 16) \
+			| ((u64)(p)[6] << 8) | (p)[7])
+#define SHA512_S0(x)	(ROR64(x, 28) ^ ROR64(x, 34) ^ ROR64(x, 39))
+#define SHA512_S1(x)	(ROR64(x, 14) ^ ROR64(x, 18) ^ ROR64(x, 41))
+#define SHA512_s0(x)	(ROR64(x, 1) ^ ROR64(x, 8) ^ ((x) >> 7))
+#define SHA512_s1(x)	(ROR64(x, 19) ^ ROR64(x, 61) ^ ((x) >> 6))
+#define SHA512_CH(e, f, g)	((g) ^ ((e) & ((f) ^ (g))))
+#define SHA512_MAJ(a, b, c)	(((a) & (b)) | ((c) & ((a) | (b))))
+
+/* Message word i, or word i + 16 of the schedule computed over it */
+#define SHA512_W(i, j, k, l)	(w##i)
+#define SHA512_WS(i, j, k, l)	(w##i += SHA512_s1(w##l) + w##k + SHA512_s0(w##j))
+
+/* The caller rotates the names of a..h instead of moving the values */
+#define SHA512_ROUND(a, b, c, d, e, f, g, h, w, k) \
+	t = (h) + SHA512_S1(e) + SHA512_CH(e, f, g) + (k) + (w); \
+	(d) += t; \
+	(h) = t + SHA512_S0(a) + SHA512_MAJ(a, b, c)
+
+#define SHA512_16(W, k0, k1, k2, k3, k4, k5, k6, k7, k8, k9, k10, k11, k12, k13, k14, k15) \
+	SHA512_ROUND(a, b, c, d, e, f, g, h, W(0, 1, 9, 14), k0); \
+	SHA512_ROUND(h, a, b, c, d, e, f, g, W(1, 2, 10, 15), k1); \
+	SHA512_ROUND(g, h, a, b, c, d, e, f, W(2, 3, 11, 0), k2); \
+	SHA512_ROUND(f, g, h, a, b, c, d, e, W(3, 4, 12, 1), k3); \
+	SHA512_ROUND(e, f, g, h, a, b, c, d, W(4, 5, 13, 2), k4); \
+	SHA512_ROUND(d, e, f, g, h, a, b, c, W(5, 6, 14, 3), k5); \
+	SHA512_ROUND(c, d, e, f, g, h, a, b, W(6, 7, 15, 4), k6); \
+	SHA512_ROUND(b, c, d, e, f, g, h, a, W(7, 8, 0, 5), k7); \
+	SHA512_ROUND(a, b, c, d, e, f, g, h, W(8, 9, 1, 6), k8); \
+	SHA512_ROUND(h, a, b, c, d, e, f, g, W(9, 10, 2, 7), k9); \
+	SHA512_ROUND(g, h, a, b, c, d, e, f, W(10, 11, 3, 8), k10); \
+	SHA512_ROUND(f, g, h, a, b, c, d, e, W(11, 12, 4, 9), k11); \
+	SHA512_ROUND(e, f, g, h, a, b, c, d, W(12, 13, 5, 10), k12); \
+	SHA512_ROUND(d, e, f, g, h, a, b, c, W(13, 14, 6, 11), k13); \
+	SHA512_ROUND(c, d, e, f, g, h, a, b, W(14, 15, 7, 12), k14); \
+	SHA512_ROUND(b, c, d, e, f, g, h, a, W(15, 0, 8, 13), k15)
+
+/* Hash nblocks consecutive blocks with the schedule kept in sixteen words */
+void
+sha512_compress(u64 *r, byte *data, int nblocks)
+{
+	u64 a; u64 b; u64 c; u64 d; u64 e; u64 f; u64 g; u64 h;
+	u64 w0; u64 w1; u64 w2; u64 w3;
+	u64 w4; u64 w5; u64 w6; u64 w7;
+	u64 w8; u64 w9; u64 w10; u64 w11;
+	u64 w12; u64 w13; u64 w14; u64 w15;
+	u64 t;
+
+	for (; nblocks > 0; nblocks--, data += 128) {
+		a = r[0]; b = r[1]; c = r[2]; d = r[3];
+		e = r[4]; f = r[5]; g = r[6]; h = r[7];
+
+		w0 = SHA512_LOAD(data); w1 = SHA512_LOAD(data + 8);
+		w2 = SHA512_LOAD(data + 16); w3 = SHA512_LOAD(data + 24);
+		w4 = SHA512_LOAD(data + 32); w5 = SHA512_LOAD(data + 40);
+		w6 = SHA512_LOAD(data + 48); w7 = SHA512_LOAD(data + 56);
+		w8 = SHA512_LOAD(data + 64); w9 = SHA512_LOAD(data + 72);
+		w10 = SHA512_LOAD(data + 80); w11 = SHA512_LOAD(data + 88);
+		w12 = SHA512_LOAD(data + 96); w13 = SHA512_LOAD(data + 104);
+		w14 = SHA512_LOAD(data + 112); w15 = SHA512_LOAD(data + 120);
+
+		SHA512_16(SHA512_W,
+			0x428a2f98d728ae22, 0x7137449123ef65cd,
+			0xb5c0fbcfec4d3b2f, 0xe9b5dba58189dbbc,
+			0x3956c25bf348b538, 0x59f111f1b605d019,
+			0x923f82a4af194f9b, 0xab1c5ed5da6d8118,
+			0xd807aa98a3030242, 0x12835b0145706fbe,
+			0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2,
+			0x72be5d74f27b896f, 0x80deb1fe3b1696b1,
+			0x9bdc06a725c71235, 0xc19bf174cf692694);
+
+		SHA512_16(SHA512_WS,
+			0xe49b69c19ef14ad2, 0xefbe4786384f25e3,
+			0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65,
+			0x2de92c6f592b0275, 0x4a7484aa6ea6e483,
+			0x5cb0a9dcbd41fbd4, 0x76f988da831153b5,
+			0x983e5152ee66dfab, 0xa831c66d2db43210,
+			0xb00327c898fb213f, 0xbf597fc7beef0ee4,
+			0xc6e00bf33da88fc2, 0xd5a79147930aa725,
+			0x06ca6351e003826f, 0x142929670a0e6e70);
+
+		SHA512_16(SHA512_WS,
+			0x27b70a8546d22ffc, 0x2e1b21385c26c926,
+			0x4d2c6dfc5ac42aed, 0x53380d139d95b3df,
+			0x650a73548baf63de, 0x766a0abb3c77b2a8,
+			0x81c2c92e47edaee6, 0x92722c851482353b,
+			0xa2bfe8a14cf10364, 0xa81a664bbc423001,
+			0xc24b8b70d0f89791, 0xc76c51a30654be30,
+			0xd192e819d6ef5218, 0xd69906245565a910,
+			0xf40e35855771202a, 0x106aa07032bbd1b8);
+
+		SHA512_16(SHA512_WS,
+			0x19a4c116b8d2d0c8, 0x1e376c085141ab53,
+			0x2748774cdf8eeb99, 0x34b0bcb5e19b48a8,
+			0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb,
+			0x5b9cca4f7763e373, 0x682e6ff3d6b2b8a3,
+			0x748f82ee5defb2fc, 0x78a5636f43172f60,
+			0x84c87814a1f0ab72, 0x8cc702081a6439ec,
+			0x90befffa23631e28, 0xa4506cebde82bde9,
+			0xbef9a3f7b2c67915, 0xc67178f2e372532b);
+
+		SHA512_16(SHA512_WS,
+			0xca273eceea26619c, 0xd186b8c721c0c207,
+			0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178,
+			0x06f067aa72176fba, 0x0a637dc5a2c898a6,
+			0x113f9804bef90dae, 0x1b710b35131c471b,
+			0x28db77f523047d84, 0x32caab7b40c72493,
+			0x3c9ebe0a15c9bebc, 0x431d67c49c100d4c,
+			0x4cc5d4becb3e42b6, 0x597f299cfc657e2a,
+			0x5fcb6fab3ad6faec, 0x6c44198c4a475817);
+
+		r[0] += a; r[1] += b; r[2] += c; r[3] += d;
+		r[4] += e; r[5] += f; r[6] += g; r[7] += h;
+	}
+}
+
 void
 sha512_finish(u64 *r, int nblocks, byte *data, int len)
 {
@@ -94,11 +213,13 @@ sha512_finish(u64 *r, int nblocks, byte *data, int len)
 	u64 pad;
 	int i;
 
-	pad = (u64)nblocks * 1024;
-	for (; len >= 128; data += 128, len -= 128, pad += 1024) {
-		sha512_rounds(r, data);
-	}
-	pad += len * 8;
+	/* Full blocks are hashed in place, only the tail is copied */
+	sha512_compress(r, data, len >> 7);
+	nblocks += len >> 7;
+	data += len & ~127;
+	len &= 127;
+
+	pad = (u64)nblocks * 1024 + len * 8;
 
 	for (i = 0; i < len; i++) {
 		final[i] = data[i];
@@ -106,23 +227,25 @@ sha512_finish(u64 *r, int nblocks, byte *data, int len)
 
 	final[i++] = 0x80;
 
-	for (; i < 128; i++) {
-		final[i] = 0;
-	}
-
 	if (len + 17 > 128) {
-		sha512_rounds(r, final);
-
-		for (i = 0; i < 128; i++) {
+		for (; i < 128; i++) {
 			final[i] = 0;
 		}
+
+		sha512_compress(r, final, 1);
+
+		i = 0;
+	}
+
+	for (; i < 120; i++) {
+		final[i] = 0;
 	}
 
 	for (i = 127; i >= 120; i--, pad >>= 8) {
 		final[i] = pad;
 	}
 
-	sha512_rounds(r, final);
+	sha512_compress(r, final, 1);
 }
 
 void
@@ -182,12 +305,12 @@ sha512_hmac(byte *mac, byte *key, int klen, byte *data, int dlen)
 	}
 
 	sha512_init(r);
-	sha512_rounds(r, ipad);
+	sha512_compress(r, ipad, 1);
 	sha512_finish(r, 1, data, dlen);
 	sha512_digest(digest, r);
 
 	sha512_init(r);
-	sha512_rounds(r, opad);
+	sha512_compress(r, opad, 1);
 	sha512_finish(r, 1, digest, 64);
 	sha512_digest(mac, r);
 }
@@ -144,6 +144,63 @@ test_poly1305(void)
 	return memcmp(mac, expected, sizeof(expected)) != 0;
 }
 
+/* Vectors from RFC 7539 A.3 for the edges of the reduction */
+int
+test_poly1305_edges(void)
+{
+	byte key[32];
+	byte msg[48];
+	byte mac[16];
+	byte expected[16];
+	int ret;
+
+	ret = 0;
+
+	/* The accumulator is 2^130 - 2 and needs the final subtraction */
+	memset(key, 0, sizeof(key));
+	key[0] = 2;
+	memset(msg, 0xff, 16);
+	memset(expected, 0, sizeof(expected));
+	expected[0] = 3;
+
+	poly1305(mac, key, msg, 16);
+
+	printf("# mac\n");
+	dump(mac, sizeof(mac));
+
+	ret |= memcmp(mac, expected, sizeof(expected)) != 0;
+
+	/* Adding s overflows 2^128 */
+	memset(key + 16, 0xff, 16);
+	memset(msg, 0, 16);
+	msg[0] = 2;
+
+	poly1305(mac, key, msg, 16);
+
+	printf("# mac\n");
+	dump(mac, sizeof(mac));
+
+	ret |= memcmp(mac, expected, sizeof(expected)) != 0;
+
+	/* Three whole blocks, with no padding block after them */
+	memset(key, 0, sizeof(key));
+	key[0] = 1;
+	memset(msg, 0xff, 16);
+	msg[16] = 0xfb;
+	memset(msg + 17, 0xfe, 15);
+	memset(msg + 32, 0x01, 16);
+	memset(expected, 0, sizeof(expected));
+
+	poly1305(mac, key, msg, 48);
+
+	printf("# mac\n");
+	dump(mac, sizeof(mac));
+
+	ret |= memcmp(mac, expected, sizeof(expected)) != 0;
+
+	return ret;
+}
+
 int
 test_sha1(void)
 {
@@ -189,6 +246,29 @@ test_sha256(void)
 	return memcmp(digest, expected, sizeof(expected)) != 0;
 }
 
+int
+test_sha256_long(void)
+{
+	byte data[56] = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	byte digest[32];
+	byte expected[32] = {
+		0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8,
+		0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+		0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67,
+		0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1
+	};
+
+	printf("# data\n");
+	dump(data, sizeof(data));
+
+	sha256(digest, data, sizeof(data));
+
+	printf("# sha256\n");
+	dump(digest, sizeof(digest));
+
+	return memcmp(digest, expected, sizeof(expected)) != 0;
+}
+
 int
 test_sha512(void)
 {
@@ -216,6 +296,34 @@ test_sha512(void)
 	return memcmp(digest, expected, sizeof(expected)) != 0;
 }
 
+int
+test_sha512_long(void)
+{
+	byte data[112] = "abcdefghbcdefghicdefghijdefghijk" "efghijklfghijklmghijklmnhijklmno"
+		"ijklmnopjklmnopqklmnopqrlmnopqrs" "mnopqrstnopqrstu";
+	byte digest[64];
+	byte expected[64] = {
+		0x8e, 0x95, 0x9b, 0x75, 0xda, 0xe3, 0x13, 0xda,
+		0x8c, 0xf4, 0xf7, 0x28, 0x14, 0xfc, 0x14, 0x3f,
+		0x8f, 0x77, 0x79, 0xc6, 0xeb, 0x9f, 0x7f, 0xa1,
+		0x72, 0x99, 0xae, 0xad, 0xb6, 0x88, 0x90, 0x18,
+		0x50, 0x1d, 0x28, 0x9e, 0x49, 0x00, 0xf7, 0xe4,
+		0x33, 0x1b, 0x99, 0xde, 0xc4, 0xb5, 0x43, 0x3a,
+		0xc7, 0xd3, 0x29, 0xee, 0xb6, 0xdd, 0x26, 0x54,
+		0x5e, 0x96, 0xe5, 0x5b, 0x87, 0x4b, 0xe9, 0x09
+	};
+
+	printf("# data\n");
+	dump(data, sizeof(data));
+
+	sha512(digest, data, sizeof(data));
+
+	printf("# sha512\n");
+	dump(digest, sizeof(digest));
+
+	return memcmp(digest, expected, sizeof(expected)) != 0;
+}
+
 int
 test_aes(void)
 {
@@ -312,6 +420,12 @@ main(int argc, char **argv)
 		printf("FAIL: test_poly1305\n");
 	}
 
+	ret = test_poly1305_edges();
+	status |= ret;
+	if (ret) {
+		printf("FAIL: test_poly1305_edges\n");
+	}
+
 	ret = test_sha1();
 	status |= ret;
 	if (ret) {
@@ -324,12 +438,24 @@ main(int argc, char **argv)
 		printf("FAIL: test_sha256\n");
 	}
 
+	ret = test_sha256_long();
+	status |= ret;
+	if (ret) {
+		printf("FAIL: test_sha256_long\n");
+	}
+
 	ret = test_sha512();
 	status |= ret;
 	if (ret) {
 		printf("FAIL: test_sha512\n");
 	}
 
+	ret = test_sha512_long();
+	status |= ret;
+	if (ret) {
+		printf("FAIL: test_sha512_long\n");
+	}
+
 	ret = test_aes();
 	status |= ret;
 	if (ret) {